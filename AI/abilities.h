@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <initializer_list>
+
+// Every ability in the game. The order is also the menu order, so keep each
+// gear level's abilities together.
+enum class AbilityId : uint8_t {
+    SOUL_STEAL,
+    POISON,
+    MULTI_ATTACK,
+    DEATH_BLOW,
+    RESTRAIN,
+    HOLY_ARMOR,
+    HOLY_TAKEDOWN,
+    DIVINE_PROTECTION,
+    COUNT
+};
+
+constexpr int ABILITY_COUNT = (int)AbilityId::COUNT;
+
+// Static facts about an ability. Names are for display only; nothing
+// dispatches on them. Keys name the ability in scripts.
+struct AbilityInfo {
+    const char* name;
+    const char* key;
+    bool needsTarget;
+    bool passive;      // Always on; choosing it from the menu just explains it
+    const char* description;
+};
+
+inline constexpr std::array<AbilityInfo, ABILITY_COUNT> abilityTable = {{
+    {"Soul Steal",        "soul_steal",        false, false, "Drains souls from every badly wounded enemy"},
+    {"Poison",            "poison",            true,  false, "Poisons one enemy for 3 turns"},
+    {"Multi-Attack",      "multi_attack",      false, false, "Hits every enemy for 70% damage"},
+    {"Death Blow",        "death_blow",        false, true,  "Strikes back at the killer on death"},
+    {"Restrain",          "restrain",          true,  false, "Stops one enemy from acting next turn"},
+    {"Holy Armor",        "holy_armor",        false, true,  "Armor grows by half while above 75% health"},
+    {"Holy Takedown",     "holy_takedown",     true,  false, "Hits one enemy for damage plus armor"},
+    {"Divine Protection", "divine_protection", false, false, "Gains a worshipper and heals 15 HP"},
+}};
+
+constexpr const AbilityInfo& abilityInfo(AbilityId id) {
+    return abilityTable[(int)id];
+}
+
+// A gear's abilities as one bit per AbilityId.
+class AbilitySet {
+public:
+    constexpr AbilitySet() = default;
+    constexpr AbilitySet(std::initializer_list<AbilityId> ids) {
+        for (AbilityId id : ids) add(id);
+    }
+    
+    constexpr void add(AbilityId id) { bits |= (uint16_t)(1u << (int)id); }
+    constexpr bool has(AbilityId id) const { return id < AbilityId::COUNT && (bits >> (int)id) & 1u; }
+    constexpr bool empty() const { return bits == 0; }
+    constexpr int size() const { return std::popcount(bits); }
+    
+    // Raw bits, for binary formats
+    constexpr uint16_t raw() const { return bits; }
+    static constexpr AbilitySet fromRaw(uint16_t bits) {
+        AbilitySet set;
+        set.bits = bits;
+        return set;
+    }
+    
+    // The n-th ability in menu order, or COUNT when n is out of range.
+    constexpr AbilityId at(int n) const {
+        if (n < 0) return AbilityId::COUNT;
+        uint16_t rest = bits;
+        for (; rest != 0 && n > 0; n--) {
+            rest &= rest - 1;  // Drop the lowest set bit
+        }
+        return rest ? (AbilityId)std::countr_zero(rest) : AbilityId::COUNT;
+    }
+    
+    template <typename F>
+    constexpr void forEach(F f) const {
+        for (uint16_t rest = bits; rest != 0; rest &= rest - 1) {
+            f((AbilityId)std::countr_zero(rest));
+        }
+    }
+    
+private:
+    uint16_t bits = 0;
+};
+
+inline constexpr AbilitySet demonAbilities = {
+    AbilityId::SOUL_STEAL, AbilityId::POISON, AbilityId::MULTI_ATTACK, AbilityId::DEATH_BLOW
+};
+inline constexpr AbilitySet godAbilities = {
+    AbilityId::RESTRAIN, AbilityId::HOLY_ARMOR, AbilityId::HOLY_TAKEDOWN, AbilityId::DIVINE_PROTECTION
+};
+
+static_assert(demonAbilities.at(3) == AbilityId::DEATH_BLOW);
+static_assert(godAbilities.size() == 4);
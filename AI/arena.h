@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+// Memory for one battle's combat state. Allocations bump a pointer through
+// an inline buffer, then through heap chunks once that is full; frees do
+// nothing, and everything goes back in one piece when the arena is
+// destroyed with its Game. A battle's store columns fit in the inline
+// buffer, so a headless battle mostly never touches malloc for them.
+//
+// Only for memory owned by the battle alone: gear is shared with loot and
+// search rollouts that can outlive the battle, so it stays on the heap.
+class BattleArena : public std::pmr::monotonic_buffer_resource {
+public:
+    static constexpr size_t INLINE_BYTES = 4096;
+
+    BattleArena() : std::pmr::monotonic_buffer_resource(buffer, sizeof(buffer), std::pmr::new_delete_resource()) {}
+
+    BattleArena(const BattleArena&) = delete;
+    BattleArena& operator=(const BattleArena&) = delete;
+
+private:
+    alignas(std::max_align_t) std::byte buffer[INLINE_BYTES];
+};
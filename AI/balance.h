@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "fixed_point.h"
+#include "rng.h"
+
+// Every balance number in the combat rules: gear stats by type and level,
+// and the DEMON/GOD stat multipliers. The defaults are the shipped game.
+// Multipliers and fractions are fixed-point, so the rules never touch a
+// float.
+struct Balance {
+    // Gear stats by type
+    int swordDamage = 15;
+    int swordArmor = 5;
+    int swordHealth = 10;
+    int spearDamage = 20;
+    int spearArmor = 2;
+    int spearHealth = 5;
+    int arrowDamage = 25;
+    int arrowArmor = 0;
+    int arrowHealth = 0;
+
+    // Bonuses by level
+    int demonDamage = 10;
+    int godArmor = 20;
+    int godHealth = 30;
+
+    // DEMON: more damage the closer to death, plus souls
+    StatFactor demonRageBelow = StatFactor::fromDouble(0.5);  // Health fraction
+    StatFactor demonRageMultiplier = StatFactor::fromDouble(1.5);
+    StatFactor demonFuryBelow = StatFactor::fromDouble(0.25);
+    StatFactor demonFuryMultiplier = StatFactor::fromDouble(2.0);
+    int soulDamage = 2;
+
+    // GOD: more armor while healthy, plus worshippers
+    StatFactor godGuardAbove = StatFactor::fromDouble(0.75);
+    StatFactor godGuardMultiplier = StatFactor::fromDouble(1.5);
+    int worshipperDamage = 5;
+};
+
+inline const Balance defaultBalance{};
+
+// The rules' own fractions, fixed rather than tuned
+using HolyDamage = Ratio<3, 2>;         // GOD gear hitting DEMON gear
+using ExecutionBelow = Ratio<3, 10>;    // DEMON gear's execution bonus, on targets under this health
+using ExecutionDamage = Ratio<3, 2>;
+using MultiAttackDamage = Ratio<7, 10>; // Per target
+using SoulStealBelow = Ratio<3, 10>;    // Soul Steal reaps enemies under this health
+using DarkEnergyDamage = Ratio<6, 5>;   // DEMON enemies' special attack
+using HolyStrikeArmor = Ratio<1, 2>;    // GOD enemies' special attack adds this much of their armor
+
+// The current thread's balance table. Tuning runs point it at candidate
+// tables; everything else plays with the defaults.
+inline thread_local const Balance* gameBalance = &defaultBalance;
+
+// A tunable field, by name. Exactly one of the member pointers is set.
+// Values go in and out as decimals; factors keep the nearest fixed-point
+// step.
+struct BalanceParam {
+    const char* name;
+    int Balance::* intField;
+    StatFactor Balance::* factorField;
+
+    double get(const Balance& balance) const {
+        return intField ? balance.*intField : (balance.*factorField).toDouble();
+    }
+
+    void set(Balance& balance, double value) const {
+        if (intField) {
+            balance.*intField = (int)(value < 0 ? value - 0.5 : value + 0.5);
+        } else {
+            balance.*factorField = StatFactor::fromDouble(value);
+        }
+    }
+};
+
+inline constexpr BalanceParam balanceParams[] = {
+    {"sword.damage", &Balance::swordDamage, nullptr},
+    {"sword.armor", &Balance::swordArmor, nullptr},
+    {"sword.health", &Balance::swordHealth, nullptr},
+    {"spear.damage", &Balance::spearDamage, nullptr},
+    {"spear.armor", &Balance::spearArmor, nullptr},
+    {"spear.health", &Balance::spearHealth, nullptr},
+    {"arrow.damage", &Balance::arrowDamage, nullptr},
+    {"arrow.armor", &Balance::arrowArmor, nullptr},
+    {"arrow.health", &Balance::arrowHealth, nullptr},
+    {"demon.damage", &Balance::demonDamage, nullptr},
+    {"god.armor", &Balance::godArmor, nullptr},
+    {"god.health", &Balance::godHealth, nullptr},
+    {"demon.rage_below", nullptr, &Balance::demonRageBelow},
+    {"demon.rage_multiplier", nullptr, &Balance::demonRageMultiplier},
+    {"demon.fury_below", nullptr, &Balance::demonFuryBelow},
+    {"demon.fury_multiplier", nullptr, &Balance::demonFuryMultiplier},
+    {"demon.soul_damage", &Balance::soulDamage, nullptr},
+    {"god.guard_above", nullptr, &Balance::godGuardAbove},
+    {"god.guard_multiplier", nullptr, &Balance::godGuardMultiplier},
+    {"god.worshipper_damage", &Balance::worshipperDamage, nullptr},
+};
+
+inline const BalanceParam* findBalanceParam(std::string_view name) {
+    for (const BalanceParam& param : balanceParams) {
+        if (name == param.name) return &param;
+    }
+    return nullptr;
+}
+
+// Digest of every value in a table, for caching results per table.
+inline uint64_t balanceHash(const Balance& balance) {
+    uint64_t hash = 0;
+    for (const BalanceParam& param : balanceParams) {
+        double value = param.get(balance);
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        hash = mix64(hash ^ bits) + 0x9e3779b97f4a7c15ull;
+    }
+    return hash;
+}
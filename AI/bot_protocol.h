@@ -0,0 +1,264 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "abilities.h"
+#include "game.h"
+#include "rng.h"
+
+// Line protocol for programs that play the game (game --bot): one request
+// per line in, one reply per line out, numbers where the menus print prose.
+// Requests are read in order and need not wait for replies, so a bot may
+// send many at once; batching several moves into one request saves a round
+// trip per turn as well.
+//
+// Requests (words separated by spaces):
+//   new [SEED [GEAR]]   start a battle; default seed is the next of the run
+//   act MOVE...         play moves in order, one per player turn, until
+//                       the moves or the battle run out
+//   state               repeat the current state
+//   quit
+//
+// Moves:
+//   aN        attack enemy N (from 0)
+//   h         heal
+//   s         skip the turn
+//   KEY[:N]   use ability KEY (abilityTable: poison, multi_attack, ...),
+//             at enemy N when it needs a target
+//
+// Replies:
+//   bot 1                                  once, on start
+//   state BATTLE TURN PLAYER enemies N ENEMY... legal K MOVE...
+//       PLAYER = player HP MAX_HP DAMAGE ARMOR LEVEL SOULS WORSHIPPERS POISON RESTRAINED
+//       ENEMY  = HP MAX_HP DAMAGE ARMOR LEVEL POISON RESTRAINED
+//       LEVEL is 0 normal, 1 demon, 2 god. legal lists the moves open this
+//       turn: a (any enemy), h, s, and each usable ability, with a trailing
+//       ':' when it takes a target
+//   end BATTLE WON TIMED_OUT TURNS MOVES   the battle is over; send new
+//   error TEXT                             the request (or the rest of its
+//                                          moves) was not played; a state
+//                                          or end line follows for act
+//
+// A move that Game rejects (a dead target, say) still uses the turn, as at
+// the menus. Gear swaps from storage are not offered.
+struct BotConfig {
+    uint64_t seed = 1;        // Battle n of the run defaults to deriveSeed(seed, n)
+    int gearChoice = 1;
+    int maxTurns = 0;         // 0 = play until someone wins
+    EnemyPolicy* enemyAi = nullptr;  // nullptr = the dice
+};
+
+class BotProtocol {
+public:
+    static constexpr int VERSION = 1;
+
+    explicit BotProtocol(const BotConfig& botConfig) : config(botConfig) {}
+
+    static void greet(std::string& out) {
+        out += "bot ";
+        appendNumber(out, VERSION);
+        out += '\n';
+    }
+
+    // Answer one request line (without its newline). False after quit.
+    bool handle(std::string_view line, std::string& out) {
+        std::string_view word = nextWord(line);
+        if (word == "act") {
+            act(line, out);
+        } else if (word == "new") {
+            start(line, out);
+        } else if (word == "state") {
+            reply(out);
+        } else if (word == "quit") {
+            return false;
+        } else if (!word.empty()) {
+            out += "error unknown request '";
+            out += word;
+            out += "'\n";
+        }
+        return true;
+    }
+
+    uint64_t getBattles() const { return battles; }
+    uint64_t getMovesPlayed() const { return totalMoves; }
+
+private:
+    BotConfig config;
+    std::unique_ptr<Game> game;
+    bool live = false;  // The game waits for a move
+    uint64_t battles = 0;
+    uint64_t moves = 0;  // This battle
+    uint64_t totalMoves = 0;
+
+    static std::string_view nextWord(std::string_view& text) {
+        size_t begin = text.find_first_not_of(' ');
+        if (begin == std::string_view::npos) {
+            text = {};
+            return {};
+        }
+        size_t end = text.find(' ', begin);
+        if (end == std::string_view::npos) end = text.size();
+        std::string_view word = text.substr(begin, end - begin);
+        text.remove_prefix(end);
+        return word;
+    }
+
+    template <typename T>
+    static bool parseNumber(std::string_view text, T& value) {
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc() && end == text.data() + text.size();
+    }
+
+    template <typename T>
+    static void appendNumber(std::string& out, T value) {
+        char digits[24];
+        auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, end);
+    }
+
+    static AbilityId findAbility(std::string_view key) {
+        for (int a = 0; a < ABILITY_COUNT; a++) {
+            if (key == abilityTable[a].key) return (AbilityId)a;
+        }
+        return AbilityId::COUNT;
+    }
+
+    void start(std::string_view args, std::string& out) {
+        uint64_t seed = deriveSeed(config.seed, battles);
+        int gear = config.gearChoice;
+        std::string_view word = nextWord(args);
+        if (!word.empty() && !parseNumber(word, seed)) {
+            out += "error bad seed\n";
+            return;
+        }
+        word = nextWord(args);
+        if (!word.empty() && (!parseNumber(word, gear) || gear < 1 || gear > 3)) {
+            out += "error gear must be 1, 2 or 3\n";
+            return;
+        }
+        battles++;
+        moves = 0;
+        game = std::make_unique<Game>(gear, seed, config.maxTurns, "Bot");
+        game->setEnemyPolicy(config.enemyAi);
+        game->journalBattleStart();
+        live = game->toDecision();
+        reply(out);
+    }
+
+    // One move from its word; false if it doesn't parse
+    static bool parseMove(std::string_view word, PlayerAction& action) {
+        action = PlayerAction();
+        if (word == "h") {
+            action.type = ActionType::HEAL;
+            return true;
+        }
+        if (word == "s") return true;
+        if (word.size() > 1 && word[0] == 'a') {
+            action.type = ActionType::ATTACK;
+            return parseNumber(word.substr(1), action.target);
+        }
+        size_t colon = word.find(':');
+        action.type = ActionType::ABILITY;
+        action.ability = findAbility(word.substr(0, colon));
+        if (action.ability == AbilityId::COUNT) return false;
+        return colon == std::string_view::npos || parseNumber(word.substr(colon + 1), action.target);
+    }
+
+    void act(std::string_view args, std::string& out) {
+        if (!game) {
+            out += "error no battle; send new\n";
+            return;
+        }
+        while (live) {
+            std::string_view word = nextWord(args);
+            if (word.empty()) break;
+            PlayerAction action;
+            if (!parseMove(word, action)) {
+                out += "error bad move '";
+                out += word;
+                out += "'\n";
+                break;
+            }
+            game->decide(action);
+            moves++;
+            totalMoves++;
+            live = game->toDecision();
+        }
+        reply(out);
+    }
+
+    void reply(std::string& out) const {
+        if (!game) {
+            out += "error no battle; send new\n";
+        } else if (live) {
+            appendState(out);
+        } else {
+            appendEnd(out);
+        }
+    }
+
+    void appendEnd(std::string& out) const {
+        const EntityStore& party = game->getParty();
+        bool alive = party.currentHealth[game->getPlayerIndex()] > 0;
+        bool cleared = game->getEnemies().empty();
+        out += "end ";
+        appendNumber(out, battles);
+        out += alive && cleared ? " 1 " : " 0 ";
+        out += alive && !cleared ? "1 " : "0 ";
+        appendNumber(out, game->getTurn());
+        out += ' ';
+        appendNumber(out, moves);
+        out += '\n';
+    }
+
+    void appendState(std::string& out) const {
+        const EntityStore& party = game->getParty();
+        const EntityStore& enemies = game->getEnemies();
+        uint32_t self = game->getPlayerIndex();
+        auto field = [&out](int value) {
+            out += ' ';
+            appendNumber(out, value);
+        };
+
+        out += "state ";
+        appendNumber(out, battles);
+        field(game->getTurn());
+        out += " player";
+        for (int value : {party.currentHealth[self], party.maxHealth[self], party.cachedDamage[self],
+                          party.cachedArmor[self], (int)party.gearLevel[self], party.souls[self],
+                          party.worshippers[self], party.poisonTurns[self], (int)party.restrained[self]}) {
+            field(value);
+        }
+        out += " enemies";
+        field((int)enemies.size());
+        for (uint32_t i = 0; i < enemies.size(); i++) {
+            for (int value : {enemies.currentHealth[i], enemies.maxHealth[i], enemies.cachedDamage[i],
+                              enemies.cachedArmor[i], (int)enemies.gearLevel[i], enemies.poisonTurns[i],
+                              (int)enemies.restrained[i]}) {
+                field(value);
+            }
+        }
+
+        int count = 3;
+        AbilitySet usable;
+        if (const Gear* gear = party.gearAt(self)) {
+            gear->abilities.forEach([&](AbilityId id) {
+                if (!abilityInfo(id).passive) usable.add(id);
+            });
+            count += usable.size();
+        }
+        out += " legal";
+        field(count);
+        out += " a h s";
+        usable.forEach([&](AbilityId id) {
+            out += ' ';
+            out += abilityInfo(id).key;
+            if (abilityInfo(id).needsTarget) out += ':';
+        });
+        out += '\n';
+    }
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "damage_kernel.h"
+#include "entity_store.h"
+#include "gear.h"
+#include "journal.h"
+#include "output.h"
+#include "status_effects.h"
+#include "trace.h"
+
+// Derived stats for row i of a store, as cached by the store. Free
+// functions so read-only callers (policies, status screens) can use them
+// on a const store.
+inline int totalDamage(const EntityStore& s, uint32_t i) {
+    return s.cachedDamage[i];
+}
+
+inline int totalArmor(const EntityStore& s, uint32_t i) {
+    return s.cachedArmor[i];
+}
+
+inline void displayStatus(const EntityStore& s, uint32_t i) {
+    if (!gameOut) return;  // Headless: don't even build the gear label
+    say("\n=== ", s.names[i], " ===");
+    say("Health: ", s.currentHealth[i], "/", s.maxHealth[i]);
+    say("Damage: ", totalDamage(s, i));
+    say("Armor: ", totalArmor(s, i));
+    if (const Gear* gear = s.gearAt(i)) {
+        say("Equipped: ", gear->name, " (", gear->levelLabel(), ")");
+    }
+    if (s.souls[i] > 0) {
+        say("Souls collected: ", s.souls[i]);
+    }
+    if (s.worshippers[i] > 0) {
+        say("Worshippers: ", s.worshippers[i]);
+    }
+    for (const StatusInfo& status : statusTable) {
+        int turns = status.get(s, i);
+        if (turns <= 0) continue;
+        if (status.period > 0) {
+            say(makeColoredLine(status.color, status.name, " (", turns, " turns)"));
+        } else {
+            say(Colored{status.name, status.color});
+        }
+    }
+}
+
+// Character is a lightweight view of one row in an EntityStore, used for
+// the rules that touch two combatants at once (an attack, Death Blow). It
+// is a (store, dense index) pair, so it is only valid until that store next
+// removes a row; keep an EntityHandle for anything longer lived.
+class Character {
+public:
+    EntityStore* store;
+    uint32_t index;
+    
+    Character(EntityStore& s, uint32_t i) : store(&s), index(i) {}
+    
+    std::string_view name() const { return store->names[index]; }
+    int currentHealth() const { return store->currentHealth[index]; }
+    int maxHealth() const { return store->maxHealth[index]; }
+    int souls() const { return store->souls[index]; }
+    int worshippers() const { return store->worshippers[index]; }
+    int poisonTurns() const { return store->poisonTurns[index]; }
+    const Gear* equippedGear() const { return store->gearAt(index); }
+    GearLevel gearLevel() const { return store->gearLevel[index]; }
+    
+    bool isPoisoned() const { return store->poisonTurns[index] > 0; }
+    bool isRestrained() const { return store->restrained[index] != 0; }
+    
+    JournalRef ref() const { return JournalRef{store->side, store->handleAt(index).slot}; }
+    
+    int getTotalDamage() const { return totalDamage(*store, index); }
+    int getTotalArmor() const { return totalArmor(*store, index); }
+    
+    // Gear goes into this store's armory; for shared gear use
+    // EntityStore::equip with an existing armory id.
+    void equipGear(std::shared_ptr<const Gear> gear) const {
+        store->equip(index, store->addGear(std::move(gear)));
+    }
+    
+    // One combatant hitting another: journal the attack, then resolve it.
+    void strike(const Character& target, int damage) const {
+        record(EventType::ATTACK, target.ref(), ref(), damage);
+        target.takeDamage(damage, this);
+    }
+    
+    void takeDamage(int damage, const Character* attacker = nullptr) const {
+        // GOD level special: sometimes take 0 damage
+        if (rollDivineProtection()) {
+            divineProtection(attacker);
+            return;
+        }
+        
+        int actualDamage = std::max(1, damage - getTotalArmor());
+        
+        // DEMON vs GOD: 1.5x damage
+        bool holy = attacker && isHolyHit(*attacker);
+        if (holy) {
+            actualDamage = HolyDamage::scale(actualDamage);
+        }
+        
+        TRACE_COUNT("damage events", 1);
+        store->setHealth(index, currentHealth() - actualDamage);
+        afterHit(actualDamage, holy, attacker);
+    }
+    
+    // One attack on every row of `targets`, e.g. an attack on all enemies.
+    // Plays out exactly like striking each row in turn, dice and messages
+    // included, but the damage is worked out for the whole wave at once
+    // from the armor and health columns (applyHits).
+    void strikeAll(EntityStore& targets, int damage) const {
+        thread_local std::vector<uint8_t> blocked;
+        thread_local std::vector<int> dealt;
+        uint32_t count = (uint32_t)targets.size();
+        blocked.resize(count);
+        dealt.resize(count);
+        
+        // The dice first, in row order, as the hits one by one would roll them
+        for (uint32_t i = 0; i < count; i++) {
+            blocked[i] = Character(targets, i).rollDivineProtection();
+        }
+        bool holy = gearLevel() == GearLevel::GOD;
+        TRACE_COUNT("damage events", count);
+        applyHits(damage, holy, targets.cachedArmor.data(), targets.gearLevel.data(), blocked.data(),
+                  targets.currentHealth.data(), dealt.data(), count);
+        targets.healthLowered(dealt.data());
+        
+        // Then the reports and whatever the hits set off, in the same order
+        for (uint32_t i = 0; i < count; i++) {
+            Character target(targets, i);
+            record(EventType::ATTACK, target.ref(), ref(), damage);
+            if (blocked[i]) {
+                target.divineProtection(this);
+            } else {
+                target.afterHit(dealt[i], target.isHolyHit(*this), this);
+            }
+        }
+    }
+    
+    void heal(int amount) const {
+        int health = std::min(currentHealth() + amount, maxHealth());
+        store->setHealth(index, health);
+        record(EventType::HEAL, ref(), {}, amount, health);
+        say(name(), " heals for ", amount, " HP! (Health: ", health, "/", maxHealth(), ")");
+    }
+    
+    bool isAlive() const {
+        return currentHealth() > 0;
+    }
+    
+    void addSouls(int count) const { store->addSouls(index, count); }
+    void addWorshippers(int count) const { store->addWorshippers(index, count); }
+    
+    void displayStatus() const {
+        ::displayStatus(*store, index);
+    }
+    
+private:
+    // 20% chance, for GOD gear only
+    bool rollDivineProtection() const {
+        return gearLevel() == GearLevel::GOD && store->rng.chance(20);
+    }
+    
+    void divineProtection(const Character* attacker) const {
+        TRACE_COUNT("procs", 1);
+        record(EventType::DIVINE_PROTECTION, ref(), attacker ? attacker->ref() : JournalRef{});
+        say(name(), "'s Divine Protection activated! No damage taken!");
+    }
+    
+    bool isHolyHit(const Character& attacker) const {
+        return attacker.gearLevel() == GearLevel::GOD && gearLevel() == GearLevel::DEMON;
+    }
+    
+    // Report a hit already taken, then Death Blow if it killed a DEMON.
+    void afterHit(int actualDamage, bool holy, const Character* attacker) const {
+        if (holy) {
+            TRACE_COUNT("procs", 1);
+            say("Holy damage! Extra effective against demons!");
+        }
+        int health = currentHealth();
+        record(EventType::DAMAGE, ref(), attacker ? attacker->ref() : JournalRef{}, actualDamage, health);
+        say(name(), " takes ", actualDamage, " damage! (Health: ", std::max(0, health), "/", maxHealth(), ")");
+        
+        if (health <= 0 && gearLevel() == GearLevel::DEMON && attacker) {
+            // Death Blow ability
+            TRACE_COUNT("procs", 1);
+            record(EventType::DEATH_BLOW, attacker->ref(), ref(), store->baseDamage[index]);
+            say(name(), " triggers Death Blow!");
+            attacker->takeDamage(store->baseDamage[index]);
+        }
+    }
+};
@@ -0,0 +1,59 @@
+#include "combat_env.h"
+
+
+#include "vec_env.h"
+
+using namespace std;
+
+struct CombatEnv {
+    explicit CombatEnv(const VecEnv::Config& config) : env(config) {}
+
+    VecEnv env;
+};
+
+CombatEnv* env_create(const CombatEnvConfig* config) {
+    if (!config || config->envs == 0 || config->gear < 1 || config->gear > 3 || config->max_turns < 0) return nullptr;
+    VecEnv::Config vec;
+    vec.envs = config->envs;
+    vec.threads = config->threads;
+    vec.gearChoice = config->gear;
+    vec.maxTurns = config->max_turns;
+    vec.seed = config->seed;
+    try {
+        return new CombatEnv(vec);
+    } catch (...) {
+        return nullptr;  // Out of memory or threads; nothing may unwind into C
+    }
+}
+
+void env_destroy(CombatEnv* env) {
+    delete env;
+}
+
+uint32_t env_count(const CombatEnv* env) {
+    return env->env.size();
+}
+
+uint32_t env_observation_size(void) {
+    return VecEnv::OBSERVATION_SIZE;
+}
+
+uint32_t env_action_count(void) {
+    return VecEnv::ACTION_COUNT;
+}
+
+int32_t env_reset(CombatEnv* env, float* observations) {
+    if (!env) return COMBAT_ENV_BAD_ARGUMENT;
+    return env->env.reset(observations) ? COMBAT_ENV_OK : COMBAT_ENV_FAILED;
+}
+
+int32_t env_step(CombatEnv* env, const int32_t* actions, float* observations, float* rewards, uint8_t* dones) {
+    if (!env || !actions) return COMBAT_ENV_BAD_ARGUMENT;
+    return env->env.step(actions, observations, rewards, dones) ? COMBAT_ENV_OK : COMBAT_ENV_FAILED;
+}
+
+int32_t env_action_mask(const CombatEnv* env, uint8_t* masks) {
+    if (!env || !masks) return COMBAT_ENV_BAD_ARGUMENT;
+    env->env.actionMask(masks);
+    return COMBAT_ENV_OK;
+}
@@ -0,0 +1,73 @@
+/* C interface to VecEnv (vec_env.h): many battles stepped at once, for
+ * training agents from any language with a C FFI (Python's ctypes, say).
+ * Built as the combat_env shared library.
+ *
+ *   CombatEnvConfig config = {1024, 0, 1, 100, 42};
+ *   CombatEnv* env = env_create(&config);
+ *   env_reset(env, observations);                     envs * env_observation_size() floats
+ *   env_step(env, actions, observations, rewards, dones);
+ *   env_destroy(env);
+ *
+ * Every array belongs to the caller and is written in place: observations
+ * battle after battle, one reward and done flag per battle. A battle that
+ * ends is reset during the same step, so its observation is already the
+ * next episode's first. Layouts and action numbers are described in
+ * vec_env.h. Calls on one CombatEnv must not overlap.
+ *
+ * env_reset, env_step and env_action_mask return COMBAT_ENV_OK or an
+ * error. After COMBAT_ENV_FAILED the battles that failed have not written
+ * their outputs and start a new episode on the next step; the rest played
+ * as usual. */
+
+#ifndef COMBAT_ENV_H
+#define COMBAT_ENV_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define COMBAT_ENV_API __declspec(dllexport)
+#else
+#define COMBAT_ENV_API __attribute__((visibility("default")))
+#endif
+
+typedef struct CombatEnv CombatEnv;
+
+#define COMBAT_ENV_OK 0
+#define COMBAT_ENV_FAILED (-1)        /* Some battles threw (out of memory, say) */
+#define COMBAT_ENV_BAD_ARGUMENT (-2)  /* A required pointer was NULL */
+
+typedef struct CombatEnvConfig {
+    uint32_t envs;      /* Battles stepped together, at least 1 */
+    uint32_t threads;   /* Workers; 0 = one per hardware thread */
+    int32_t gear;       /* Starting gear, 1 to 3 */
+    int32_t max_turns;  /* Per episode; 0 = until someone wins */
+    uint64_t seed;
+} CombatEnvConfig;
+
+/* NULL if the config is unusable */
+COMBAT_ENV_API CombatEnv* env_create(const CombatEnvConfig* config);
+COMBAT_ENV_API void env_destroy(CombatEnv* env);
+
+COMBAT_ENV_API uint32_t env_count(const CombatEnv* env);
+COMBAT_ENV_API uint32_t env_observation_size(void);
+COMBAT_ENV_API uint32_t env_action_count(void);
+
+/* observations may be NULL */
+COMBAT_ENV_API int32_t env_reset(CombatEnv* env, float* observations);
+
+/* actions: one per battle. observations, rewards and dones may be NULL. */
+COMBAT_ENV_API int32_t env_step(CombatEnv* env, const int32_t* actions, float* observations, float* rewards,
+                                uint8_t* dones);
+
+/* env_action_count() bytes per battle: 1 where the action would be carried out */
+COMBAT_ENV_API int32_t env_action_mask(const CombatEnv* env, uint8_t* masks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "balance.h"
+#include "entity_store.h"
+#include "gear.h"
+#include "gear_catalog.h"
+#include "names.h"
+#include "rng.h"
+#include "trace.h"
+
+// Procedural enemy waves: thousands of enemies from a seed, a difficulty
+// budget and a mix of the three factions of Faerdya.
+//
+// Enemy i is a pure function of (seed, i, budget, mix), rolled from its
+// own counter-based stream, so waves are identical however many threads
+// build them and in whatever order the rows get filled.
+
+enum class Faction : uint8_t {
+    DEMONS,
+    GODS,
+    ENGINEERS
+};
+
+constexpr int FACTION_COUNT = 3;
+constexpr int FACTION_TIERS = 3;
+
+// One kind of enemy, with the gear every one of its kind wears.
+struct EnemyArchetype {
+    const char* name;
+    int health;
+    int damage;
+    int armor;
+    const char* gearName;
+    GearType gearType;
+    GearLevel gearLevel;
+
+    // What one of these costs out of a wave's budget
+    constexpr int threat() const { return health + 4 * damage + 4 * armor; }
+};
+
+// Weakest to strongest, per faction. Demons carry DEMON gear and Gods GOD
+// gear; the Engineers' machines are plain steel. The Gods' best is a
+// hybrid built on captured Engineer technology.
+inline constexpr EnemyArchetype enemyArchetypes[FACTION_COUNT][FACTION_TIERS] = {
+    {
+        {"Imp", 35, 9, 1, "Ember Claw", GearType::SWORD, GearLevel::DEMON},
+        {"Demon Knight", 80, 15, 8, "Hell Sword", GearType::SWORD, GearLevel::DEMON},
+        {"Soul Devourer", 160, 22, 12, "Soul Reaver", GearType::SPEAR, GearLevel::DEMON},
+    },
+    {
+        {"Acolyte", 45, 7, 6, "Prayer Bow", GearType::ARROW, GearLevel::GOD},
+        {"Angel Guardian", 120, 12, 15, "Celestial Spear", GearType::SPEAR, GearLevel::GOD},
+        {"Seraph Engine", 200, 18, 22, "Storm Lance", GearType::SPEAR, GearLevel::GOD},
+    },
+    {
+        {"Thrall Tinker", 40, 8, 3, "Rusty Dagger", GearType::SWORD, GearLevel::NORMAL},
+        {"Scrap Drone", 60, 11, 6, "Rivet Gun", GearType::ARROW, GearLevel::NORMAL},
+        {"Siege Automaton", 140, 16, 18, "Piston Hammer", GearType::SWORD, GearLevel::NORMAL},
+    },
+};
+
+struct EncounterSpec {
+    uint64_t seed = 1;
+    uint32_t count = 1000;
+    uint64_t budget = 0;  // Total threat of the wave; 0 = count * DEFAULT_THREAT
+    std::array<unsigned, FACTION_COUNT> mix{1, 1, 1};  // Relative weights, Demons/Gods/Engineers
+    unsigned threads = 0;  // 0 = one per hardware thread; never changes the result
+
+    static constexpr uint64_t DEFAULT_THREAT = 150;
+
+    // Average threat per enemy, at least 1
+    uint64_t share() const {
+        uint64_t total = budget ? budget : (uint64_t)count * DEFAULT_THREAT;
+        return std::max<uint64_t>(1, count ? total / count : 0);
+    }
+};
+
+// One rolled enemy, before it goes into a store
+struct EnemyRoll {
+    uint8_t faction;
+    uint8_t tier;
+    int health;
+    int damage;
+    int armor;
+};
+
+// Enemy `index` of a wave. Picks a faction by the mix, then the strongest
+// tier its share of the budget affords (one weaker a quarter of the time,
+// for variety), then scales the tier's stats so its threat lands near the
+// share, give or take a tenth. Integer math only, so every platform rolls
+// the same wave.
+inline EnemyRoll rollEnemy(const EncounterSpec& spec, uint64_t share, uint32_t index) {
+    Rng rng(spec.seed, index);
+    unsigned total = spec.mix[0] + spec.mix[1] + spec.mix[2];
+    int faction = 0;
+    if (total == 0) {
+        faction = rng.roll(0, FACTION_COUNT - 1);
+    } else {
+        int pick = rng.roll(0, (int)total - 1);
+        while (pick >= (int)spec.mix[faction]) {
+            pick -= (int)spec.mix[faction];
+            faction++;
+        }
+    }
+
+    const EnemyArchetype* tiers = enemyArchetypes[faction];
+    int tier = 0;
+    while (tier + 1 < FACTION_TIERS && (uint64_t)tiers[tier + 1].threat() <= share) {
+        tier++;
+    }
+    if (tier > 0 && rng.chance(25)) tier--;
+
+    const EnemyArchetype& kind = tiers[tier];
+    int64_t percent = std::clamp<int64_t>((int64_t)(share * 100 / kind.threat()), 50, 400);
+    percent = percent * rng.roll(90, 110) / 100;
+    EnemyRoll roll;
+    roll.faction = (uint8_t)faction;
+    roll.tier = (uint8_t)tier;
+    roll.health = std::max<int>(1, (int)(kind.health * percent / 100));
+    roll.damage = (int)(kind.damage * percent / 100);
+    roll.armor = (int)(kind.armor * percent / 100);
+    return roll;
+}
+
+// Append spec.count generated enemies to a store. The armory gets one gear
+// per archetype and the store grows once; then workers claim chunks of
+// rows, write them in place and hash them. Each worker plays by the
+// caller's balance table.
+inline void generateEncounter(EntityStore& store, const EncounterSpec& spec) {
+    TRACE_ZONE("generate encounter");
+    Name names[FACTION_COUNT][FACTION_TIERS];
+    int gear[FACTION_COUNT][FACTION_TIERS];
+    for (int f = 0; f < FACTION_COUNT; f++) {
+        for (int t = 0; t < FACTION_TIERS; t++) {
+            const EnemyArchetype& kind = enemyArchetypes[f][t];
+            names[f][t] = kind.name;
+            gear[f][t] = store.addGear(makeGear(kind.gearName, kind.gearType, kind.gearLevel));
+        }
+    }
+
+    uint32_t first = store.appendRows(spec.count);
+    uint64_t share = spec.share();
+    const uint32_t chunk = 4096;
+    std::atomic<uint32_t> next{0};
+    std::atomic<uint64_t> rows{0};  // XOR of the filled rows' hashes
+    auto fill = [&] {
+        uint64_t hashed = 0;
+        while (true) {
+            uint32_t begin = next.fetch_add(chunk);
+            if (begin >= spec.count) break;
+            uint32_t end = std::min(spec.count - begin, chunk) + begin;
+            for (uint32_t i = begin; i < end; i++) {
+                EnemyRoll r = rollEnemy(spec, share, i);
+                store.setRow(first + i, names[r.faction][r.tier], r.health, r.damage, r.armor, gear[r.faction][r.tier]);
+                hashed ^= store.rowHash(first + i);
+            }
+        }
+        rows.fetch_xor(hashed);
+    };
+
+    unsigned threads = spec.threads ? spec.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<unsigned>(threads, (spec.count + chunk - 1) / chunk);
+    const Balance* balance = gameBalance;
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) {
+        pool.emplace_back([&fill, balance] {
+            TRACE_THREAD_NAME("encounter worker");
+            gameBalance = balance;
+            fill();
+        });
+    }
+    fill();
+    for (auto& t : pool) {
+        t.join();
+    }
+    store.foldHash(rows.load());
+}
@@ -0,0 +1,461 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game.h"
+#include "journal.h"
+#include "output.h"
+#include "policies.h"
+#include "rng.h"
+#include "search_threads.h"
+#include "trace.h"
+#include "transposition.h"
+
+// Tuning for the search AI.
+struct SearchConfig {
+    double budgetMs = 5.0;     // Thinking time per enemy phase, split between the enemies acting
+    int iterations = 0;        // Fixed rollouts per decision instead of a time budget (reproducible)
+    unsigned threads = 1;      // Rollout threads, the caller included
+    int horizon = 6;           // Turns a rollout plays past the decision
+    double exploration = 1.4;  // UCB1 exploration constant
+    size_t nodesPerThread = 1 << 15;
+    double ponderSliceMs = 2.0;    // Longest the game waits on pondering between key presses
+    int ponderIterations = 20000;  // Rollouts per thread a timed search ponders at most
+    uint32_t reuseVisits = 200;    // A table estimate this well sampled answers a timed decision outright
+};
+
+// Difficulty tiers. "normal" is the original dice and has no search config.
+// Reproducible tiers trade the time budget for a rollout count of about
+// the same strength, so a decision depends on nothing but the battle.
+inline bool difficultyConfig(const std::string& name, bool reproducible, SearchConfig& config) {
+    if (name == "hard") {
+        config.budgetMs = 2.0;
+        config.horizon = 4;
+        config.iterations = reproducible ? 200 : 0;
+        return true;
+    }
+    if (name == "brutal") {
+        config.budgetMs = 5.0;
+        config.horizon = 8;
+        config.iterations = reproducible ? 500 : 0;
+        return true;
+    }
+    return false;
+}
+
+// One node of an open-loop search tree: it stands for a sequence of enemy
+// decisions, not a particular state, since the dice and the player's
+// answers are sampled afresh on every rollout.
+struct SearchNode {
+    uint32_t firstChild = 0;  // 0 until expanded; the root is never a child
+    uint32_t visits = 0;
+    double score = 0.0;       // Sum of rollout results, enemies' point of view
+    EnemyAction action = EnemyAction::ATTACK;
+};
+
+// Fixed-capacity node storage. Reset between decisions, so after the first
+// search a tree costs no allocation at all. A full pool stops the tree
+// growing; rollouts carry on from its leaves.
+class NodePool {
+public:
+    explicit NodePool(size_t capacity) { nodes.reserve(capacity); }
+
+    void reset() { nodes.clear(); }
+
+    // Index of `count` fresh nodes, or 0 when the pool is full.
+    uint32_t allocate(uint32_t count) {
+        if (nodes.size() + count > nodes.capacity()) return 0;
+        uint32_t first = (uint32_t)nodes.size();
+        nodes.resize(nodes.size() + count);
+        return first;
+    }
+
+    SearchNode& operator[](uint32_t index) { return nodes[index]; }
+    const SearchNode& operator[](uint32_t index) const { return nodes[index]; }
+    size_t size() const { return nodes.size(); }
+
+private:
+    std::vector<SearchNode> nodes;
+};
+
+// Keeps a search thread from printing or journaling rollouts, whichever
+// thread it is, and has it play by the caller's balance table.
+class QuietRollouts {
+public:
+    explicit QuietRollouts(const Balance* balance)
+        : savedOut(gameOut), savedJournal(combatJournal), savedBalance(gameBalance) {
+        gameOut = nullptr;
+        combatJournal = nullptr;
+        gameBalance = balance;
+    }
+
+    ~QuietRollouts() {
+        gameOut = savedOut;
+        combatJournal = savedJournal;
+        gameBalance = savedBalance;
+    }
+
+private:
+    Renderer* savedOut;
+    Journal* savedJournal;
+    const Balance* savedBalance;
+};
+
+// Enemy AI that plans with Monte-Carlo tree search over the real combat
+// rules. Every decision copies the battle into a scratch Game per thread
+// and plays it forward a few turns, the tree choosing enemy moves (UCB1),
+// the player answering with GreedyPolicy, and the dice rolled from a
+// rollout seed. Threads search independent trees (root parallelism) and
+// their root visit counts are summed to pick the move.
+//
+// With a fixed iteration count a decision depends only on the battle seed,
+// turn, enemy and thread count, so seeded battles and simulations replay
+// exactly; with a time budget the move can vary with machine load.
+//
+// With a transposition table, decisions start from whatever earlier
+// searches of the same position (this AI's or any other sharing the table)
+// left there: a fixed-count search runs only the rollouts still missing,
+// a timed one is skipped once the estimate has reuseVisits behind it, and
+// the pooled result goes back into the table. Decisions then depend on
+// what the table holds, so seeded replays and thread-count-independent
+// simulations need it left off (the default).
+//
+// In interactive games the AI also ponders: while the player chooses, it
+// guesses their move (GreedyPolicy), plays it out on an exact copy of the
+// battle and starts searching the first enemy decision that follows. If
+// the real battle then reaches that very position, the search carries on
+// from the pondered tree; a fixed-count search finishes the same rollouts
+// it would have run anyway, so pondering never changes its answer.
+class SearchEnemyAi : public EnemyPolicy {
+public:
+    explicit SearchEnemyAi(const SearchConfig& searchConfig)
+        : config(searchConfig), pool(std::max(1u, searchConfig.threads)), speculation(predictor) {
+        for (unsigned i = 0; i < pool.size(); i++) {
+            workers.push_back(std::make_unique<Worker>(config));
+        }
+    }
+
+    EnemyAction chooseAction(const Game& game, uint32_t enemy) override {
+        TRACE_ZONE("enemy search");
+        const EntityStore& enemies = game.getEnemies();
+        uint32_t acting = 0;
+        for (uint32_t i = 0; i < enemies.size(); i++) {
+            if (enemies.currentHealth[i] > 0) acting++;
+        }
+        auto budget = std::chrono::duration<double, std::milli>(config.budgetMs / std::max(1u, acting));
+        auto deadline = config.iterations > 0 ? NO_DEADLINE
+                      : std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(budget);
+
+        bool resumed = pondered && enemy == ponderEnemy && game.sameBattle(speculation);
+        pondered = false;
+        ponderHits += resumed;
+
+        // What earlier searches of this position already found
+        OutcomeEstimate known;
+        uint64_t key = deriveSeed(game.stateHash() ^ mix64((uint64_t)config.horizon), enemy);
+        bool cached = table && table->probe(key, known);
+        uint64_t wanted = config.iterations > 0 ? (uint64_t)config.iterations : UINT64_MAX;
+        uint64_t missing = cached && !resumed ? wanted - std::min(wanted, known.totalVisits()) : wanted;
+        if (cached && !resumed && (config.iterations > 0 ? missing == 0 : known.totalVisits() >= config.reuseVisits)) {
+            lastIterations = 0;
+            reusedRollouts += known.totalVisits();
+            tableAnswers++;
+            decisions++;
+            return bestAction(known);
+        }
+
+        const Balance* balance = gameBalance;
+        uint64_t decisionSeed = deriveSeed(deriveSeed(game.getSeed(), game.getTurn()), enemy);
+        int enemyHealth = totalMaxHealth(game);
+        pool.run([&](unsigned id) {
+            TRACE_ZONE("rollouts");
+            TRACE_MUTE();  // Not every rollout turn
+            QuietRollouts quiet(balance);
+            if (!resumed) workers[id]->begin(deriveSeed(decisionSeed, id));
+            workers[id]->search(game, enemy, enemyHealth, share(id, missing), deadline);
+        });
+
+        OutcomeEstimate found;
+        lastIterations = 0;
+        for (const auto& worker : workers) {
+            const SearchNode& root = worker->tree[0];
+            lastIterations += root.visits;
+            if (root.firstChild == 0) continue;
+            for (int a = 0; a < ENEMY_ACTION_COUNT; a++) {
+                found.visits[a] += worker->tree[root.firstChild + a].visits;
+                found.score[a] += worker->tree[root.firstChild + a].score;
+            }
+        }
+        if (table) {
+            if (cached && !resumed) {
+                reusedRollouts += known.totalVisits();
+                found.merge(known);
+            }
+            table->store(key, found);
+        }
+        totalIterations += lastIterations;
+        decisions++;
+        return bestAction(found);
+    }
+
+    // Share estimates with other searches (nullptr to stop). The table
+    // must outlive its use here.
+    void setTable(TranspositionTable* transpositions) { table = transpositions; }
+
+    // One slice of searching the guessed position. Returns false once the
+    // guess needs no more work (or there is nothing to guess).
+    bool ponder(const Game& game) override {
+        TRACE_ZONE("enemy ponder");
+        if (!pondered || game.getTurn() != speculation.getTurn() || game.getSeed() != speculation.getSeed()) {
+            if (!guessNextDecision(game)) return false;
+        }
+        auto slice = std::chrono::duration<double, std::milli>(config.ponderSliceMs);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(slice);
+        const Balance* balance = gameBalance;
+        int enemyHealth = totalMaxHealth(speculation);
+        pool.run([&](unsigned id) {
+            TRACE_ZONE("rollouts");
+            TRACE_MUTE();
+            QuietRollouts quiet(balance);
+            workers[id]->search(speculation, ponderEnemy, enemyHealth, quota(id, config.ponderIterations), deadline);
+        });
+        for (unsigned id = 0; id < workers.size(); id++) {
+            if (workers[id]->rollouts < quota(id, config.ponderIterations)) return true;
+        }
+        return false;
+    }
+
+    // Rollouts behind the last decision, and across all of them
+    uint64_t getLastIterations() const { return lastIterations; }
+    uint64_t getTotalIterations() const { return totalIterations; }
+    uint64_t getDecisions() const { return decisions; }
+    uint64_t getPonderHits() const { return ponderHits; }
+    uint64_t getTableAnswers() const { return tableAnswers; }      // Decisions made without searching
+    uint64_t getReusedRollouts() const { return reusedRollouts; }  // Table rollouts decisions built on
+
+private:
+    // Plays the enemies inside a rollout: tree moves while the walk is in
+    // the tree, the original dice once it has left it.
+    class TreeWalk : public EnemyPolicy {
+    public:
+        TreeWalk(NodePool& nodes, const SearchConfig& config) : tree(nodes), config(config) {}
+
+        std::vector<uint32_t> path;  // Nodes visited, root first
+        Rng rng;
+
+        void begin(uint64_t seed) {
+            path.clear();
+            path.push_back(0);
+            inTree = true;
+            rng = Rng(seed, 4);
+        }
+
+        EnemyAction chooseAction(const Game& game, uint32_t enemy) override {
+            if (inTree) {
+                uint32_t node = path.back();
+                if (tree[node].firstChild == 0 && (node == 0 || tree[node].visits > 0)) {
+                    expand(node);
+                }
+                if (tree[node].firstChild != 0) {
+                    uint32_t child = select(node);
+                    path.push_back(child);
+                    inTree = tree[child].visits > 0;
+                    return tree[child].action;
+                }
+                inTree = false;
+            }
+            int action = rng.roll(1, 10);
+            if (action <= 6) return EnemyAction::ATTACK;
+            if (action <= 8 && game.getEnemies().gearAt(enemy)) return EnemyAction::SPECIAL;
+            return EnemyAction::HEAL;
+        }
+
+    private:
+        NodePool& tree;
+        const SearchConfig& config;
+        bool inTree = true;
+
+        void expand(uint32_t node) {
+            uint32_t first = tree.allocate(ENEMY_ACTION_COUNT);
+            if (first == 0) return;
+            for (int a = 0; a < ENEMY_ACTION_COUNT; a++) {
+                tree[first + a].action = (EnemyAction)a;
+            }
+            tree[node].firstChild = first;
+        }
+
+        // UCB1, trying every move once first
+        uint32_t select(uint32_t node) const {
+            const SearchNode& parent = tree[node];
+            double logVisits = std::log((double)std::max(1u, parent.visits));
+            uint32_t best = parent.firstChild;
+            double bestValue = -1.0;
+            for (int a = 0; a < ENEMY_ACTION_COUNT; a++) {
+                const SearchNode& child = tree[parent.firstChild + a];
+                if (child.visits == 0) return parent.firstChild + a;
+                double value = child.score / child.visits + config.exploration * std::sqrt(logVisits / child.visits);
+                if (value > bestValue) {
+                    bestValue = value;
+                    best = parent.firstChild + a;
+                }
+            }
+            return best;
+        }
+    };
+
+    // Per-thread search state, all of it reused from decision to decision.
+    struct Worker {
+        NodePool tree;
+        GreedyPolicy hero;
+        Game scratch;
+        TreeWalk walk;
+        uint64_t seed = 0;
+        uint64_t rollouts = 0;  // In the current tree
+
+        explicit Worker(const SearchConfig& config)
+            : tree(config.nodesPerThread), scratch(hero), walk(tree, config), config(config) {
+            walk.path.reserve(64);
+            scratch.setEnemyPolicy(&walk);
+        }
+
+        // Fresh tree for a new decision
+        void begin(uint64_t searchSeed) {
+            tree.reset();
+            tree.allocate(1);
+            seed = searchSeed;
+            rollouts = 0;
+        }
+
+        // Grow the tree until it holds `limit` rollouts or the deadline
+        // passes, with at least one rollout per call. Rollout i always has
+        // the same seed, so a search split over several calls plays exactly
+        // the rollouts of one long call.
+        void search(const Game& game, uint32_t enemy, int enemyHealth, uint64_t limit,
+                    std::chrono::steady_clock::time_point deadline) {
+            for (uint64_t done = 0; rollouts < limit; done++, rollouts++) {
+                if (done > 0 && deadline != NO_DEADLINE && std::chrono::steady_clock::now() >= deadline) {
+                    break;
+                }
+                uint64_t rolloutSeed = deriveSeed(seed, rollouts);
+                scratch.copyBattleFrom(game, rolloutSeed);
+                walk.begin(rolloutSeed);
+                scratch.playOn(enemy, config.horizon);
+
+                double result = evaluate(enemyHealth);
+                for (uint32_t node : walk.path) {
+                    tree[node].visits++;
+                    tree[node].score += result;
+                }
+            }
+        }
+
+        // 1 for a dead hero, 0 for a wiped-out enemy side, otherwise how
+        // far the health race leans the enemies' way.
+        double evaluate(int enemyHealth) const {
+            const EntityStore& party = scratch.getParty();
+            const EntityStore& enemies = scratch.getEnemies();
+            uint32_t self = scratch.getPlayerIndex();
+            if (party.currentHealth[self] <= 0) return 1.0;
+
+            int remaining = 0;
+            for (uint32_t i = 0; i < enemies.size(); i++) {
+                remaining += std::max(0, enemies.currentHealth[i]);
+            }
+            if (remaining == 0) return 0.0;
+
+            double heroShare = (double)party.currentHealth[self] / party.maxHealth[self];
+            double enemyShare = (double)remaining / std::max(1, enemyHealth);
+            return 0.5 + 0.5 * (std::min(1.0, enemyShare) - std::min(1.0, heroShare));
+        }
+
+    private:
+        const SearchConfig& config;
+    };
+
+    static constexpr auto NO_DEADLINE = std::chrono::steady_clock::time_point::max();
+
+    SearchConfig config;
+    SearchThreads pool;
+    std::vector<std::unique_ptr<Worker>> workers;
+    uint64_t lastIterations = 0;
+    uint64_t totalIterations = 0;
+    uint64_t decisions = 0;
+    TranspositionTable* table = nullptr;
+    uint64_t tableAnswers = 0;
+    uint64_t reusedRollouts = 0;
+
+    // The guessed position being pondered
+    GreedyPolicy predictor;
+    Game speculation;
+    uint32_t ponderEnemy = 0;
+    bool pondered = false;
+    uint64_t ponderHits = 0;
+
+    // Worker id's share of the rollouts: the fixed count when there is one,
+    // otherwise `unlimited`.
+    uint64_t quota(unsigned id, uint64_t unlimited) const {
+        return config.iterations > 0 ? share(id, config.iterations) : unlimited;
+    }
+
+    // Worker id's part of `total` rollouts (UINT64_MAX: no limit)
+    uint64_t share(unsigned id, uint64_t total) const {
+        if (total == UINT64_MAX) return total;
+        unsigned threads = pool.size();
+        return total / threads + (id < total % threads);
+    }
+
+    // Most visited action, the better scoring one on a tie
+    static EnemyAction bestAction(const OutcomeEstimate& estimate) {
+        int best = 0;
+        for (int a = 1; a < ENEMY_ACTION_COUNT; a++) {
+            if (estimate.visits[a] > estimate.visits[best] ||
+                (estimate.visits[a] == estimate.visits[best] && estimate.score[a] > estimate.score[best])) {
+                best = a;
+            }
+        }
+        return (EnemyAction)best;
+    }
+
+    static int totalMaxHealth(const Game& game) {
+        const EntityStore& enemies = game.getEnemies();
+        int total = 0;
+        for (uint32_t i = 0; i < enemies.size(); i++) {
+            total += enemies.maxHealth[i];
+        }
+        return total;
+    }
+
+    // Play the predicted player move on a copy of the battle, up to the
+    // first enemy decision after it, and start fresh trees there.
+    bool guessNextDecision(const Game& game) {
+        pondered = false;
+        {
+            QuietRollouts quiet(gameBalance);
+            speculation.copyBattleFrom(game);
+            speculation.performAction(predictor.chooseAction(speculation));
+            speculation.removeDeadEnemies();
+            ponderEnemy = speculation.nextActingEnemy(0);
+        }
+        if (ponderEnemy >= speculation.getEnemies().size()) return false;
+
+        uint64_t decisionSeed = deriveSeed(deriveSeed(speculation.getSeed(), speculation.getTurn()), ponderEnemy);
+        for (unsigned id = 0; id < workers.size(); id++) {
+            workers[id]->begin(deriveSeed(decisionSeed, id));
+        }
+        pondered = true;
+        return true;
+    }
+};
+
+// Enemy AI for a difficulty tier, or nullptr for the dice ("normal").
+inline std::unique_ptr<SearchEnemyAi> makeEnemyAi(const std::string& difficulty, unsigned threads, bool reproducible) {
+    SearchConfig config;
+    if (!difficultyConfig(difficulty, reproducible, config)) return nullptr;
+    config.threads = threads;
+    return std::make_unique<SearchEnemyAi>(config);
+}
@@ -0,0 +1,469 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "balance.h"
+#include "gear.h"
+#include "names.h"
+#include "rng.h"
+
+// Stable reference to an entity. Dense indices move when entities die
+// (swap-remove), handles do not; a handle whose entity is gone simply
+// stops being valid.
+struct EntityHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+    
+    bool operator==(const EntityHandle& other) const {
+        return slot == other.slot && generation == other.generation;
+    }
+};
+
+// Struct-of-arrays storage for combatants. Every column is indexed by dense
+// position 0..size()-1, so per-turn passes (poison, enemy actions, the dead
+// sweep) walk contiguous ints instead of chasing a pointer per character.
+// Gear is cold data: each row keeps an index into the store's armory plus
+// hot copies of the numbers the combat rules actually read.
+//
+// Columns allocate from the memory resource the store was made with: a
+// Game's stores use its BattleArena, anything else the heap. Copies made
+// with the copy constructor go on the heap; assigning one store to
+// another keeps each one's own resource.
+class EntityStore {
+public:
+    template <typename T>
+    using Column = std::pmr::vector<T>;
+    
+    // Hot columns
+    Column<int> currentHealth;
+    Column<int> maxHealth;
+    Column<int> baseDamage;
+    Column<int> armor;
+    Column<int> gearDamage;
+    Column<int> gearArmor;
+    Column<GearLevel> gearLevel;  // NORMAL when nothing is equipped
+    Column<int> souls;            // For DEMON gear
+    Column<int> worshippers;      // For GOD gear
+    Column<int> poisonTurns;      // Poisoned while > 0
+    Column<uint8_t> restrained;
+    
+    // Derived columns: total damage and armor with every bonus applied.
+    // They depend on health, gear, souls and worshippers, so those change
+    // only through the setters below, which recompute the row; attacks
+    // then read a number instead of redoing the multipliers per hit. Not
+    // persisted: snapshots recompute them on load.
+    Column<int> cachedDamage;
+    Column<int> cachedArmor;
+    
+    // Cold columns
+    Column<int> gearId;  // Index into armory, -1 for none
+    Column<Name> names;
+    
+    // Gear owned by this store. Rows share entries, so a wave of identical
+    // enemies costs one Gear, not one each. Gear never changes once added,
+    // so copies of a store (search rollouts) share it too.
+    Column<std::shared_ptr<const Gear>> armory;
+    
+    // Chance rolls made by this store's combatants (Divine Protection).
+    // Seeded by the owning Game so every roll is reproducible.
+    Rng rng;
+    
+    // Which side of the fight this store is, as recorded in the journal
+    uint8_t side = 0;
+    
+    explicit EntityStore(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : currentHealth(memory), maxHealth(memory), baseDamage(memory), armor(memory), gearDamage(memory),
+          gearArmor(memory), gearLevel(memory), souls(memory), worshippers(memory), poisonTurns(memory),
+          restrained(memory), cachedDamage(memory), cachedArmor(memory), gearId(memory), names(memory),
+          armory(memory), denseSlot(memory), slotIndex(memory), slotGeneration(memory), freeSlots(memory) {}
+    
+    size_t size() const { return currentHealth.size(); }
+    bool empty() const { return currentHealth.empty(); }
+    
+    void reserve(size_t count) {
+        forEachColumn([count](auto& column) { column.reserve(count); });
+        denseSlot.reserve(count);
+        slotIndex.reserve(count);
+        slotGeneration.reserve(count);
+    }
+    
+    EntityHandle create(Name name, int health, int damage, int arm) {
+        uint32_t index = (uint32_t)size();
+        currentHealth.push_back(health);
+        maxHealth.push_back(health);
+        baseDamage.push_back(damage);
+        armor.push_back(arm);
+        gearDamage.push_back(0);
+        gearArmor.push_back(0);
+        gearLevel.push_back(GearLevel::NORMAL);
+        souls.push_back(0);
+        worshippers.push_back(0);
+        poisonTurns.push_back(0);
+        restrained.push_back(0);
+        cachedDamage.push_back(0);
+        cachedArmor.push_back(0);
+        gearId.push_back(-1);
+        names.push_back(name);
+        refreshStats(index);
+        
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            slotIndex[slot] = index;
+        } else {
+            slot = (uint32_t)slotIndex.size();
+            slotIndex.push_back(index);
+            slotGeneration.push_back(0);
+        }
+        denseSlot.push_back(slot);
+        hash ^= rowHash(index);
+        return EntityHandle{slot, slotGeneration[slot]};
+    }
+
+    // Append `count` blank rows at once and return the first one's index.
+    // Only the handle bookkeeping is done here; the rows hold nothing
+    // usable until setRow fills them. Bulk builders (encounter generation)
+    // grow the columns once this way, then fill disjoint ranges of rows
+    // from as many threads as they like, and finally hand the XOR of the
+    // filled rows' rowHash to foldHash.
+    uint32_t appendRows(uint32_t count) {
+        uint32_t first = (uint32_t)size();
+        forEachColumn([first, count](auto& column) { column.resize(first + count); });
+        std::fill(gearId.begin() + first, gearId.end(), -1);
+        denseSlot.reserve(first + count);
+        for (uint32_t index = first; index < first + count; index++) {
+            uint32_t slot;
+            if (!freeSlots.empty()) {
+                slot = freeSlots.back();
+                freeSlots.pop_back();
+                slotIndex[slot] = index;
+            } else {
+                slot = (uint32_t)slotIndex.size();
+                slotIndex.push_back(index);
+                slotGeneration.push_back(0);
+            }
+            denseSlot.push_back(slot);
+        }
+        return first;
+    }
+
+    // Fill a row from appendRows: the same state create() followed by
+    // equip() would leave, except for the state hash. Touches nothing
+    // outside the row, so different rows may be filled concurrently.
+    void setRow(uint32_t index, Name name, int health, int damage, int arm, int id) {
+        const Gear* gear = id < 0 ? nullptr : armory[id].get();
+        int bonus = gear ? gear->healthBonus : 0;
+        currentHealth[index] = health + bonus;
+        maxHealth[index] = health + bonus;
+        baseDamage[index] = damage;
+        armor[index] = arm;
+        gearDamage[index] = gear ? gear->damageBonus : 0;
+        gearArmor[index] = gear ? gear->armorBonus : 0;
+        gearLevel[index] = gear ? gear->level : GearLevel::NORMAL;
+        souls[index] = 0;
+        worshippers[index] = 0;
+        poisonTurns[index] = 0;
+        restrained[index] = 0;
+        gearId[index] = id;
+        names[index] = name;
+        refreshStats(index);
+    }
+
+    bool contains(EntityHandle handle) const {
+        return handle.slot < slotIndex.size() &&
+               slotGeneration[handle.slot] == handle.generation &&
+               slotIndex[handle.slot] != UINT32_MAX;
+    }
+    
+    // Dense index of a live handle; check contains() first if unsure.
+    uint32_t indexOf(EntityHandle handle) const {
+        return slotIndex[handle.slot];
+    }
+    
+    EntityHandle handleAt(uint32_t index) const {
+        uint32_t slot = denseSlot[index];
+        return EntityHandle{slot, slotGeneration[slot]};
+    }
+    
+    // Swap-remove: the last row moves into index, so anything holding dense
+    // indices past this point must re-resolve them through handles.
+    void removeAt(uint32_t index) {
+        hash ^= rowHash(index);
+        uint32_t last = (uint32_t)size() - 1;
+        uint32_t slot = denseSlot[index];
+        if (index != last) {
+            forEachColumn([index, last](auto& column) { column[index] = std::move(column[last]); });
+            denseSlot[index] = denseSlot[last];
+            slotIndex[denseSlot[index]] = index;
+        }
+        forEachColumn([](auto& column) { column.pop_back(); });
+        denseSlot.pop_back();
+        
+        slotIndex[slot] = UINT32_MAX;
+        slotGeneration[slot]++;
+        freeSlots.push_back(slot);
+    }
+    
+    void remove(EntityHandle handle) {
+        if (contains(handle)) {
+            removeAt(indexOf(handle));
+        }
+    }
+    
+    int addGear(std::shared_ptr<const Gear> gear) {
+        armory.push_back(std::move(gear));
+        return (int)armory.size() - 1;
+    }
+    
+    const Gear* gearAt(uint32_t index) const {
+        return gearId[index] < 0 ? nullptr : armory[gearId[index]].get();
+    }
+    
+    // Equip a piece of armory gear (-1 for none). Whatever was equipped
+    // first gives its health bonus back, never dropping health below 1, so
+    // a swap adjusts the stats in place instead of rebuilding them.
+    void equip(uint32_t index, int id) {
+        hash ^= rowHash(index);
+        if (const Gear* old = gearAt(index)) {
+            maxHealth[index] -= old->healthBonus;
+            currentHealth[index] = std::max(1, currentHealth[index] - old->healthBonus);
+        }
+        gearId[index] = id;
+        const Gear* gear = gearAt(index);
+        gearDamage[index] = gear ? gear->damageBonus : 0;
+        gearArmor[index] = gear ? gear->armorBonus : 0;
+        gearLevel[index] = gear ? gear->level : GearLevel::NORMAL;
+        if (gear) {
+            maxHealth[index] += gear->healthBonus;
+            currentHealth[index] += gear->healthBonus;
+        }
+        hash ^= rowHash(index);
+        refreshStats(index);
+    }
+    
+    void setHealth(uint32_t index, int health) {
+        rehash(index, 0, currentHealth[index], health);
+        currentHealth[index] = health;
+        refreshStats(index);
+    }
+    
+    // After a batch wrote the health column directly (applyHits): row i
+    // lost dealt[i]. Brings the hash and every row's derived stats up to date.
+    void healthLowered(const int* dealt) {
+        for (uint32_t i = 0; i < size(); i++) {
+            rehash(i, 0, currentHealth[i] + dealt[i], currentHealth[i]);
+            refreshStats(i);
+        }
+    }
+    
+    void addSouls(uint32_t index, int count) {
+        rehash(index, 7, souls[index], souls[index] + count);
+        souls[index] += count;
+        refreshStats(index);
+    }
+    
+    void addWorshippers(uint32_t index, int count) {
+        rehash(index, 8, worshippers[index], worshippers[index] + count);
+        worshippers[index] += count;
+        refreshStats(index);
+    }
+    
+    void setPoisonTurns(uint32_t index, int turns) {
+        rehash(index, 9, poisonTurns[index], turns);
+        poisonTurns[index] = turns;
+    }
+    
+    void setRestrained(uint32_t index, uint8_t turns) {
+        rehash(index, 10, restrained[index], turns);
+        restrained[index] = turns;
+    }
+    
+    // Zobrist-style digest of the rows' combat state: the XOR of one
+    // 64-bit key per (slot, raw array, value) for every state column, so
+    // each setter updates it with a couple of XORs instead of a rescan.
+    // Stores in the same state hash the same (transposition lookups);
+    // it leaves out names and the dice. Gear is hashed by what it does,
+    // not by its armory index, which differs between stores (a rollout's
+    // copy, a loaded snapshot) holding the same gear.
+    uint64_t stateHash() const { return hash; }
+    
+    // Row index's share of stateHash
+    uint64_t rowHash(uint32_t index) const {
+        uint32_t slot = denseSlot[index];
+        const Gear* gear = gearAt(index);
+        return hashKey(slot, 0, currentHealth[index]) ^ hashKey(slot, 1, maxHealth[index]) ^
+               hashKey(slot, 2, baseDamage[index]) ^ hashKey(slot, 3, armor[index]) ^
+               hashKey(slot, 4, gearDamage[index]) ^ hashKey(slot, 5, gearArmor[index]) ^
+               hashKey(slot, 6, (int)gearLevel[index]) ^
+               hashKey(slot, 7, souls[index]) ^ hashKey(slot, 8, worshippers[index]) ^
+               hashKey(slot, 9, poisonTurns[index]) ^ hashKey(slot, 10, restrained[index]) ^
+               hashKey(slot, 11, gear ? gear->abilities.raw() : -1) ^
+               hashKey(slot, 16, gear ? gear->healthBonus : 0);
+    }
+    
+    // stateHash from scratch
+    uint64_t computeHash() const {
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < size(); i++) {
+            total ^= rowHash(i);
+        }
+        return total;
+    }
+    
+    // Rows a bulk builder filled (see appendRows)
+    void foldHash(uint64_t rows) { hash ^= rows; }
+    
+    // Recompute one row's derived stats from its raw columns, by the
+    // thread's balance table.
+    void refreshStats(uint32_t i) {
+        const Balance& balance = *gameBalance;
+        int damage = baseDamage[i] + gearDamage[i];
+        int totalArmor = armor[i] + gearArmor[i];
+        int health = currentHealth[i];
+        int healthMax = maxHealth[i];
+        
+        // DEMON level bonus: less health = more damage
+        if (gearLevel[i] == GearLevel::DEMON) {
+            if (balance.demonRageBelow.fractionBelow(health, healthMax)) {
+                damage = balance.demonRageMultiplier.scale(damage);  // 1.5x below half health by default
+            }
+            if (balance.demonFuryBelow.fractionBelow(health, healthMax)) {
+                damage = balance.demonFuryMultiplier.scale(damage);  // Another 2x below a quarter by default
+            }
+            // Soul bonus
+            damage += souls[i] * balance.soulDamage;
+        }
+        
+        // GOD level bonus: based on worshippers, and higher health = higher armor
+        if (gearLevel[i] == GearLevel::GOD) {
+            damage += worshippers[i] * balance.worshipperDamage;
+            if (balance.godGuardAbove.fractionAbove(health, healthMax)) {
+                totalArmor = balance.godGuardMultiplier.scale(totalArmor);
+            }
+        }
+        cachedDamage[i] = damage;
+        cachedArmor[i] = totalArmor;
+    }
+    
+    // Every row and the state hash, after raw columns were written
+    // wholesale (snapshot load).
+    void refreshStats() {
+        cachedDamage.resize(size());
+        cachedArmor.resize(size());
+        for (uint32_t i = 0; i < size(); i++) {
+            refreshStats(i);
+        }
+        hash = computeHash();
+    }
+    
+    void clear() {
+        hash = 0;
+        forEachColumn([](auto& column) { column.clear(); });
+        denseSlot.clear();
+        slotIndex.clear();
+        slotGeneration.clear();
+        freeSlots.clear();
+        armory.clear();
+    }
+    
+    // Every trivially copyable array, tagged with a stable id, including
+    // the handle bookkeeping. Snapshots save and restore stores through this,
+    // so a new column only needs adding here (with a new id) to persist.
+    template <typename F>
+    void forEachRawArray(F f) { visitRawArrays(*this, f); }
+    template <typename F>
+    void forEachRawArray(F f) const { visitRawArrays(*this, f); }
+
+    // Same rows in the same state: every raw array matches. Names, the
+    // armory's contents and the dice are not compared.
+    bool sameRows(const EntityStore& other) const {
+        return currentHealth == other.currentHealth && maxHealth == other.maxHealth &&
+               baseDamage == other.baseDamage && armor == other.armor && gearDamage == other.gearDamage &&
+               gearArmor == other.gearArmor && gearLevel == other.gearLevel && souls == other.souls &&
+               worshippers == other.worshippers && poisonTurns == other.poisonTurns &&
+               restrained == other.restrained && gearId == other.gearId && denseSlot == other.denseSlot &&
+               slotIndex == other.slotIndex && slotGeneration == other.slotGeneration &&
+               freeSlots == other.freeSlots;
+    }
+
+    // Handles resolve: every row's slot points back at the row, every slot
+    // at a live row or nowhere, and only empty slots are free. Loading
+    // checks this before trusting slot arrays from a file.
+    bool slotsConsistent() const {
+        size_t rows = size(), slots = slotIndex.size();
+        if (denseSlot.size() != rows || slotGeneration.size() != slots) return false;
+        for (size_t i = 0; i < rows; i++) {
+            if (denseSlot[i] >= slots || slotIndex[denseSlot[i]] != i) return false;
+        }
+        for (size_t slot = 0; slot < slots; slot++) {
+            uint32_t index = slotIndex[slot];
+            if (index != UINT32_MAX && (index >= rows || denseSlot[index] != slot)) return false;
+        }
+        for (uint32_t slot : freeSlots) {
+            if (slot >= slots || slotIndex[slot] != UINT32_MAX) return false;
+        }
+        return true;
+    }
+
+private:
+    Column<uint32_t> denseSlot;       // dense index -> slot
+    Column<uint32_t> slotIndex;       // slot -> dense index, UINT32_MAX when free
+    Column<uint32_t> slotGeneration;  // bumped every time a slot is freed
+    Column<uint32_t> freeSlots;
+    uint64_t hash = 0;  // stateHash
+    
+    static uint64_t hashKey(uint32_t slot, uint32_t array, int value) {
+        return mix64(((uint64_t)slot << 37 | (uint64_t)array << 32 | (uint32_t)value) + 0x9e3779b97f4a7c15ull);
+    }
+    
+    void rehash(uint32_t index, uint32_t array, int before, int after) {
+        uint32_t slot = denseSlot[index];
+        hash ^= hashKey(slot, array, before) ^ hashKey(slot, array, after);
+    }
+    
+    template <typename Store, typename F>
+    static void visitRawArrays(Store& s, F f) {
+        f(0, s.currentHealth);
+        f(1, s.maxHealth);
+        f(2, s.baseDamage);
+        f(3, s.armor);
+        f(4, s.gearDamage);
+        f(5, s.gearArmor);
+        f(6, s.gearLevel);
+        f(7, s.souls);
+        f(8, s.worshippers);
+        f(9, s.poisonTurns);
+        f(10, s.restrained);
+        f(11, s.gearId);
+        f(12, s.denseSlot);
+        f(13, s.slotIndex);
+        f(14, s.slotGeneration);
+        f(15, s.freeSlots);
+    }
+    
+    template <typename F>
+    void forEachColumn(F f) {
+        f(currentHealth);
+        f(maxHealth);
+        f(baseDamage);
+        f(armor);
+        f(gearDamage);
+        f(gearArmor);
+        f(gearLevel);
+        f(souls);
+        f(worshippers);
+        f(poisonTurns);
+        f(restrained);
+        f(cachedDamage);
+        f(cachedArmor);
+        f(gearId);
+        f(names);
+    }
+};
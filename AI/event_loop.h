@@ -0,0 +1,351 @@
+#pragma once
+
+#include <cerrno>
+#include <coroutine>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#define EVENT_LOOP_POSIX 1
+#endif
+
+// Lazily started coroutine that produces a T. co_await it from another
+// Task to run it; the awaiting coroutine resumes when it finishes. The
+// outermost Task is driven by EventLoop::run().
+template <typename T = void>
+class Task;
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    // Hand control straight back to whoever awaited us (symmetric
+    // transfer, so long chains of awaits don't grow the stack).
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> done) noexcept {
+            std::coroutine_handle<> next = done.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T result) { value = std::move(result); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() const noexcept {}
+};
+
+template <typename T>
+class Task {
+public:
+    using promise_type = TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle h) : handle(h) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool done() const { return !handle || handle.done(); }
+
+    // Run until the first suspension (or the end); for EventLoop::run().
+    void start() { handle.resume(); }
+
+    bool await_ready() const noexcept { return done(); }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+
+    T await_resume() {
+        if (handle.promise().error) std::rethrow_exception(handle.promise().error);
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*handle.promise().value);
+        }
+    }
+
+private:
+    Handle handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Line-based input that never blocks the game. Reads are poll()ed, and
+// while no key is pending the loop runs background jobs (autosave, enemy
+// planning) in small slices, so they use the time the player spends
+// thinking. Coroutines co_await readLine() and are resumed once a whole
+// line has arrived.
+//
+// When the input is a terminal it is put in raw mode for the loop's
+// lifetime: keys arrive one by one, and the loop does its own echo,
+// backspace, Ctrl-C and Ctrl-D on an empty line (end of input). Piped
+// input is read as is. Elsewhere than POSIX, reads fall back to blocking
+// std::getline, with pending jobs run first.
+//
+// A loop built on FED_INPUT reads nothing itself: its owner (a server
+// session) hands it bytes with feed(), and run() returns as soon as the
+// task first waits for input instead of driving it to the end. Such a
+// loop has no idle time of its own, so jobs posted to it are dropped when
+// its task finishes without having run.
+class EventLoop {
+public:
+    // A background job runs one slice per call and returns true while it
+    // has more to do.
+    using Job = std::function<bool()>;
+
+#ifdef EVENT_LOOP_POSIX
+    static constexpr int FED_INPUT = -1;
+
+    explicit EventLoop(int inputFd = STDIN_FILENO) : fd(inputFd) {
+        if (fd >= 0 && isatty(fd) && tcgetattr(fd, &saved) == 0) {
+            termios raw = saved;
+            raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+            raw.c_cc[VMIN] = 1;
+            raw.c_cc[VTIME] = 0;
+            rawMode = tcsetattr(fd, TCSANOW, &raw) == 0;
+        }
+    }
+
+    ~EventLoop() {
+        restoreTerminal();
+    }
+#else
+    EventLoop() = default;
+#endif
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void post(Job job) { jobs.push_back(std::move(job)); }
+
+    size_t pendingJobs() const { return jobs.size(); }
+
+    struct LineAwaiter {
+        EventLoop& loop;
+
+        bool await_ready() const { return loop.lineReady(); }
+        void await_suspend(std::coroutine_handle<> reader) { loop.reader = reader; }
+        std::string await_resume() { return loop.takeLine(); }
+    };
+
+    // Next line of input, without its newline; "" once input has ended.
+    LineAwaiter readLine() { return LineAwaiter{*this}; }
+
+    // The same for code outside a coroutine: waits here, jobs still run.
+    std::string getLine() {
+        while (!lineReady()) {
+            pump();
+        }
+        return takeLine();
+    }
+
+    // Drive a coroutine to completion. Jobs belong to the task being run:
+    // any still queued when it finishes are dropped.
+    void run(Task<void> task) {
+#ifdef EVENT_LOOP_POSIX
+        if (fd == FED_INPUT) {
+            fedTask.emplace(std::move(task));
+            fedTask->start();
+            continueFed();
+            return;
+        }
+#endif
+        task.start();
+        while (!task.done()) {
+            if (reader && lineReady()) {
+                std::exchange(reader, {}).resume();
+            } else {
+                pump();
+            }
+        }
+        jobs.clear();
+        task.await_resume();  // Rethrows whatever ended it
+    }
+
+#ifdef EVENT_LOOP_POSIX
+    // Input for a FED_INPUT loop. The task runs on until it needs a line
+    // that hasn't arrived; whatever it threw is rethrown here.
+    void feed(std::string_view bytes) {
+        for (char c : bytes) {
+            if (c == '\n') {
+                lines.push_back(std::move(typed));
+                typed.clear();
+            } else if (c != '\r' && typed.size() < MAX_FED_LINE) {
+                typed += c;
+            }
+        }
+        continueFed();
+    }
+
+    // No more input will be fed: the task reads "" from here on.
+    void finishInput() {
+        endInput();
+        continueFed();
+    }
+
+    // Whether the task handed to run() has finished.
+    bool finished() const { return fedTask && fedTask->done(); }
+#endif
+
+private:
+    std::deque<Job> jobs;
+    std::deque<std::string> lines;
+    std::string typed;  // Current partial line
+    std::coroutine_handle<> reader;
+    bool ended = false;
+
+    bool lineReady() const { return !lines.empty() || ended; }
+
+    std::string takeLine() {
+        if (lines.empty()) return "";
+        std::string line = std::move(lines.front());
+        lines.pop_front();
+        return line;
+    }
+
+    void runJob() {
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        if (job()) jobs.push_back(std::move(job));
+    }
+
+#ifdef EVENT_LOOP_POSIX
+    static constexpr size_t MAX_FED_LINE = 1 << 12;  // Longer fed lines are cut short
+
+    int fd;
+    termios saved{};
+    bool rawMode = false;
+    std::optional<Task<void>> fedTask;
+
+    void continueFed() {
+        while (reader && lineReady()) {
+            std::exchange(reader, {}).resume();
+        }
+        if (finished()) {
+            jobs.clear();
+            fedTask->await_resume();
+        }
+    }
+
+    void restoreTerminal() {
+        if (rawMode) {
+            tcsetattr(fd, TCSANOW, &saved);
+            rawMode = false;
+        }
+    }
+
+    // Take in whatever input is ready, or run one job slice if there is
+    // none; with no jobs queued, sleep until input arrives.
+    void pump() {
+        pollfd request{fd, POLLIN, 0};
+        int ready = ::poll(&request, 1, jobs.empty() ? -1 : 0);
+        if (ready > 0) {
+            readInput();
+        } else if (ready == 0) {
+            runJob();
+        }
+    }
+
+    void readInput() {
+        char buffer[256];
+        ssize_t count = ::read(fd, buffer, sizeof(buffer));
+        if (count <= 0) {
+            if (count < 0 && errno == EINTR) return;
+            endInput();
+            return;
+        }
+        std::string echo;
+        for (ssize_t i = 0; i < count; i++) {
+            char c = buffer[i];
+            if (c == '\n') {
+                lines.push_back(std::move(typed));
+                typed.clear();
+                echo += "\r\n";
+            } else if (c == '\r') {
+                continue;  // Raw terminals translate Enter to '\n' already
+            } else if (!rawMode) {
+                typed += c;
+            } else if (c == 0x7f || c == '\b') {
+                if (!typed.empty()) {
+                    typed.pop_back();
+                    echo += "\b \b";
+                }
+            } else if (c == 0x03) {
+                // Ctrl-C: put the terminal back and die the usual way
+                std::fflush(stdout);
+                restoreTerminal();
+                std::signal(SIGINT, SIG_DFL);
+                std::raise(SIGINT);
+            } else if (c == 0x04) {
+                if (typed.empty()) endInput();
+            } else if ((unsigned char)c >= ' ') {
+                typed += c;
+                echo += c;
+            }
+        }
+        if (rawMode && !echo.empty()) {
+            std::fwrite(echo.data(), 1, echo.size(), stdout);
+            std::fflush(stdout);
+        }
+    }
+
+    void endInput() {
+        if (!typed.empty()) {
+            lines.push_back(std::move(typed));
+            typed.clear();
+        }
+        ended = true;
+    }
+#else
+    void pump() {
+        while (!jobs.empty()) {
+            runJob();
+        }
+        std::string line;
+        if (std::getline(std::cin, line)) {
+            lines.push_back(std::move(line));
+        } else {
+            ended = true;
+        }
+    }
+#endif
+};
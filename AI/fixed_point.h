@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Integer-only stat and damage math, so every build on every machine
+// plays the same battle. Two flavours:
+//
+//   Ratio<N, D>       a constant fraction fixed at compile time: the rules'
+//                     own numbers (0.7x multi-attack, the 30% execution line)
+//   FixedPoint<Bits>  a runtime value in 1/2^Bits steps: tunable balance
+//                     multipliers and thresholds
+//
+// Scaling truncates toward zero, as the float-to-int casts it replaces
+// did; threshold tests cross-multiply, so no fraction is ever rounded.
+
+template <int64_t N, int64_t D>
+struct Ratio {
+    static_assert(D > 0, "positive denominator");
+
+    static constexpr int64_t num = N;
+    static constexpr int64_t den = D;
+
+    // value * N / D
+    static constexpr int scale(int value) { return (int)((int64_t)value * N / D); }
+
+    // part / whole < N / D, for whole > 0
+    static constexpr bool fractionBelow(int part, int whole) { return (int64_t)part * D < (int64_t)whole * N; }
+};
+
+template <int Bits>
+class FixedPoint {
+public:
+    static_assert(Bits > 0 && Bits < 31, "room for the integer part");
+
+    static constexpr int32_t ONE = int32_t(1) << Bits;
+
+    constexpr FixedPoint() = default;
+
+    // Nearest step to a decimal (balance defaults, tuning grids)
+    static constexpr FixedPoint fromDouble(double value) {
+        return fromRaw((int32_t)(value < 0 ? value * ONE - 0.5 : value * ONE + 0.5));
+    }
+
+    static constexpr FixedPoint fromRaw(int32_t raw) {
+        FixedPoint fixed;
+        fixed.value = raw;
+        return fixed;
+    }
+
+    constexpr int32_t raw() const { return value; }
+    constexpr double toDouble() const { return (double)value / ONE; }
+
+    // value * this, truncated toward zero
+    constexpr int scale(int amount) const { return (int)((int64_t)amount * value / ONE); }
+
+    // part / whole < this, and part / whole > this, for whole > 0
+    constexpr bool fractionBelow(int part, int whole) const { return (int64_t)part * ONE < (int64_t)whole * value; }
+    constexpr bool fractionAbove(int part, int whole) const { return (int64_t)part * ONE > (int64_t)whole * value; }
+
+    constexpr bool operator==(const FixedPoint&) const = default;
+
+private:
+    int32_t value = 0;
+};
+
+// Balance multipliers and health fractions: 16 fraction bits resolve any
+// tuning step anyone would try, and multipliers up to 32767x still fit.
+using StatFactor = FixedPoint<16>;
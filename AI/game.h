@@ -0,0 +1,1020 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "abilities.h"
+#include "arena.h"
+#include "character.h"
+#include "encounter.h"
+#include "entity_store.h"
+#include "event_loop.h"
+#include "gear.h"
+#include "gear_catalog.h"
+#include "inventory.h"
+#include "output.h"
+#include "rng.h"
+#include "scripting.h"
+#include "snapshot.h"
+#include "status_effects.h"
+#include "trace.h"
+
+class Game;
+
+// What the player does with a turn. The target is a zero-based enemy index.
+// Game validates both fields, so a policy may hand back anything and an
+// unusable pick just wastes the turn.
+enum class ActionType {
+    ATTACK,
+    ABILITY,
+    HEAL,
+    EQUIP,
+    SKIP
+};
+
+struct PlayerAction {
+    ActionType type = ActionType::SKIP;
+    AbilityId ability = AbilityId::COUNT;
+    int target = 0;
+    ItemHandle item;  // For EQUIP
+};
+
+// Decides the player's moves in headless games (simulations, search
+// rollouts). The interactive game reads them from the keyboard instead,
+// through ConsolePlayer.
+class PlayerPolicy {
+public:
+    virtual ~PlayerPolicy() = default;
+    virtual PlayerAction chooseAction(const Game& game) = 0;
+};
+
+// What an enemy does with its turn. SPECIAL is its gear's signature move
+// (poison, restraint, a heavier hit); without gear it is a plain attack.
+enum class EnemyAction : uint8_t {
+    ATTACK,
+    SPECIAL,
+    HEAL
+};
+
+constexpr int ENEMY_ACTION_COUNT = 3;
+
+// Decides enemy moves. Without one, enemies roll the original dice.
+class EnemyPolicy {
+public:
+    virtual ~EnemyPolicy() = default;
+    virtual EnemyAction chooseAction(const Game& game, uint32_t enemy) = 0;
+    
+    // Think ahead while the player is choosing a move. Called again and
+    // again between key presses; each call should take a few milliseconds
+    // and return false once there is nothing left worth doing.
+    virtual bool ponder(const Game& game) { (void)game; return false; }
+};
+
+// Show a menu and question, then wait for one line of input from the
+// player. The event loop keeps running background jobs meanwhile.
+inline Task<std::string> promptLine(EventLoop& input, std::vector<Line> menu, std::string question) {
+    if (gameOut) gameOut->prompt(menu, question);
+    co_return co_await input.readLine();
+}
+
+// Same, for a numbered menu. Anything that isn't a number reads as 0.
+inline Task<int> promptChoice(EventLoop& input, std::vector<Line> menu) {
+    std::string answer = co_await promptLine(input, std::move(menu), "Choice: ");
+    co_return std::atoi(answer.c_str());
+}
+
+// Outcome of one battle, as reported back to run() callers.
+struct BattleResult {
+    bool playerWon = false;
+    bool timedOut = false;
+    int turns = 0;
+};
+
+// Game class to manage the gameplay
+class Game {
+private:
+    BattleArena arena;    // Backs the stores' columns; freed with the game
+    EntityStore party{&arena};    // The player's side
+    EntityStore enemies{&arena};
+    EntityHandle playerHandle;
+    Inventory inventory{&arena};  // The player's dimensional storage
+    StatusEffects effects;  // Poison, restraint and the like, on either side
+    uint64_t seed = 0;
+    Rng rng;  // Enemy decisions
+    int turn = 1;
+    PlayerPolicy* policy = nullptr;  // Headless games only
+    EventLoop* input = nullptr;      // Interactive games only
+    bool pondering = false;          // Enemy AI may think on the player's time
+    int maxTurns = 0;  // 0 = play until someone wins
+    SnapshotWriter* autosave = nullptr;
+    ScriptEngine* scripts = nullptr;  // Scripted abilities and enemy AI, if any
+    EnemyPolicy* enemyPolicy = nullptr;  // nullptr = the dice
+    
+public:
+    // Interactive game: prompts for everything through the event loop and
+    // plays to the end. With a resume path it picks up from that snapshot
+    // instead of asking for a name and gear; with an autosave it checkpoints
+    // every turn, writing while the player chooses a move.
+    Game(EventLoop& eventLoop, uint64_t battleSeed, SnapshotWriter* autosaveTo = nullptr,
+         const std::string& resumePath = "", ScriptEngine* scriptEngine = nullptr, EnemyPolicy* enemyAi = nullptr);
+    
+    // Headless game: the policy drives the player and nothing blocks on
+    // input. Call run() to play the battle out.
+    Game(PlayerPolicy& playerPolicy, int gearChoice, uint64_t battleSeed, int turnLimit = 0,
+         std::string playerName = "Simulant")
+        : Game(gearChoice, battleSeed, turnLimit, std::move(playerName)) {
+        policy = &playerPolicy;
+    }
+    
+    // Stepped headless game: the caller supplies each move through
+    // toDecision() and decide() (the bot protocol).
+    Game(int gearChoice, uint64_t battleSeed, int turnLimit, std::string playerName) : maxTurns(turnLimit) {
+        seedStreams(battleSeed);
+        playerHandle = party.create(Name::owned(playerName), 100, 20, 5);
+        player().equipGear(makeStartingGear(gearChoice));
+        stockEquippedGear();
+        createEnemies();
+    }
+    
+    // Empty headless game, to be filled by copyBattleFrom (search rollouts).
+    explicit Game(PlayerPolicy& playerPolicy) : policy(&playerPolicy) {}
+    
+    Character player() { return Character(party, party.indexOf(playerHandle)); }
+    
+    const EntityStore& getParty() const { return party; }
+    uint32_t getPlayerIndex() const { return party.indexOf(playerHandle); }
+    const EntityStore& getEnemies() const { return enemies; }
+    const Inventory& getInventory() const { return inventory; }
+    int getTurn() const { return turn; }
+    uint64_t getSeed() const { return seed; }
+    
+    // Every random decision in a battle comes from one seed: the same seed
+    // and the same player actions replay a fight exactly.
+    void seedStreams(uint64_t battleSeed) {
+        seed = battleSeed;
+        party.side = SIDE_PARTY;
+        enemies.side = SIDE_ENEMIES;
+        rng = Rng(seed, 0);
+        party.rng = Rng(seed, 1);
+        enemies.rng = Rng(seed, 2);
+    }
+    
+    BattleState captureState() const {
+        BattleState state;
+        state.seed = seed;
+        state.turn = turn;
+        state.maxTurns = maxTurns;
+        state.rng = rng;
+        state.player = playerHandle;
+        state.inventory = inventory.gearIds();
+        return state;
+    }
+    
+    bool saveSnapshot(SnapshotWriter& writer) const {
+        return writer.save(party, enemies, captureState());
+    }
+    
+    bool loadSnapshot(const std::string& path, std::string& error) {
+        BattleState state;
+        if (!::loadSnapshot(path, party, enemies, state, error)) return false;
+        party.side = SIDE_PARTY;
+        enemies.side = SIDE_ENEMIES;
+        seed = state.seed;
+        turn = state.turn;
+        maxTurns = state.maxTurns;
+        rng = state.rng;
+        playerHandle = state.player;
+        
+        inventory.clear();
+        int equippedId = party.gearId[getPlayerIndex()];
+        for (uint32_t id : state.inventory) {
+            ItemHandle item = inventory.add(id, *party.armory[id]);
+            if ((int)id == equippedId) inventory.setEquipped(item);
+        }
+        if (state.inventory.empty()) stockEquippedGear();  // Older snapshots
+        effects.restore(party, enemies, turn);
+        return true;
+    }
+    
+    // Checkpoint at the start of every turn (nullptr to stop).
+    void setAutosave(SnapshotWriter* writer) { autosave = writer; }
+    
+    // Let gear scripts override abilities and enemy AI (nullptr for none).
+    void setScripts(ScriptEngine* engine) { scripts = engine; }
+    
+    // Let a policy drive every enemy instead of the dice and scripts.
+    void setEnemyPolicy(EnemyPolicy* enemyAi) { enemyPolicy = enemyAi; }
+    
+    // Take over another game's battle, with fresh random streams so a
+    // rollout samples its own dice instead of replaying the real ones.
+    // Stores are copy-assigned, which reuses this game's capacity.
+    void copyBattleFrom(const Game& other, uint64_t rolloutSeed) {
+        party = other.party;
+        enemies = other.enemies;
+        playerHandle = other.playerHandle;
+        effects = other.effects;
+        turn = other.turn;
+        inventory.clear();  // Rollouts never equip; loot would only pile up
+        seedStreams(rolloutSeed);
+    }
+    
+    // Exact copy of another game's battle, dice included: the same moves
+    // play out the same way in both (speculative search).
+    void copyBattleFrom(const Game& other) {
+        party = other.party;
+        enemies = other.enemies;
+        playerHandle = other.playerHandle;
+        inventory = other.inventory;
+        effects = other.effects;
+        seed = other.seed;
+        rng = other.rng;
+        turn = other.turn;
+        maxTurns = other.maxTurns;
+    }
+    
+    // Whether two games stand at the same point of the same battle as far
+    // as the combat rules can tell (names, loot and dice positions aside).
+    bool sameBattle(const Game& other) const {
+        return seed == other.seed && turn == other.turn && playerHandle == other.playerHandle &&
+               party.sameRows(other.party) && enemies.sameRows(other.enemies);
+    }
+    
+    // Digest of what sameBattle compares, seed and turn aside: equal
+    // battles hash equal, whichever game or turn they turned up in.
+    uint64_t stateHash() const {
+        return party.stateHash() ^ mix64(enemies.stateHash() + playerHandle.slot + 1);
+    }
+    
+    // Finish the current enemy phase from `firstEnemy`, then play at most
+    // `turns` more turns. Search rollouts call this on a copied battle.
+    void playOn(uint32_t firstEnemy, int turns) {
+        enemyTurns(firstEnemy);
+        turn++;
+        maxTurns = turn + turns - 1;
+        if (turns > 0) {
+            gameLoop();
+        }
+    }
+    
+    BattleResult run() {
+        gameLoop();
+        BattleResult result;
+        result.playerWon = player().isAlive() && enemies.empty();
+        result.timedOut = player().isAlive() && !enemies.empty();
+        result.turns = turn;
+        return result;
+    }
+    
+    Task<> initializeGame() {
+        // Create player
+        std::string playerName = co_await promptLine(*input, {}, "Enter your character's name: ");
+        playerHandle = party.create(Name::owned(playerName), 100, 20, 5);
+        
+        // Choose starting gear
+        co_await chooseStartingGear();
+        
+        // Create enemies
+        createEnemies();
+    }
+    
+    static std::shared_ptr<Gear> makeStartingGear(int choice) {
+        switch(choice) {
+            case 1:
+                return makeGear("Bloodthirsty Blade", GearType::SWORD, GearLevel::DEMON);
+            case 2:
+                return makeGear("Divine Lance", GearType::SPEAR, GearLevel::GOD);
+            case 3:
+            default:
+                return makeGear("Hunter's Bow", GearType::ARROW, GearLevel::NORMAL);
+        }
+    }
+    
+    Task<> chooseStartingGear() {
+        std::vector<Line> menu = {
+            makeLine("Choose your starting gear:"),
+            makeLine("1. Demon Sword - Power through destruction"),
+            makeLine("2. God Spear - Divine might and protection"),
+            makeLine("3. Normal Arrow - Balanced approach"),
+        };
+        int choice = co_await promptChoice(*input, std::move(menu));
+        
+        auto gear = makeStartingGear(choice);
+        gear->displayInfo();
+        player().equipGear(std::move(gear));
+        stockEquippedGear();
+    }
+    
+    // Put the player's current gear into storage as the equipped item.
+    void stockEquippedGear() {
+        int id = party.gearId[getPlayerIndex()];
+        if (id >= 0) {
+            inventory.setEquipped(inventory.add((uint32_t)id, *party.armory[id]));
+        }
+    }
+    
+    void createEnemies() {
+        // Create a mix of enemies
+        EntityHandle goblin = enemies.create("Goblin", 50, 10, 2);
+        auto goblinGear = makeGear("Rusty Dagger", GearType::SWORD, GearLevel::NORMAL);
+        Character(enemies, enemies.indexOf(goblin)).equipGear(std::move(goblinGear));
+        
+        EntityHandle knight = enemies.create("Demon Knight", 80, 15, 8);
+        auto demonGear = makeGear("Hell Sword", GearType::SWORD, GearLevel::DEMON);
+        Character(enemies, enemies.indexOf(knight)).equipGear(std::move(demonGear));
+        
+        EntityHandle angel = enemies.create("Angel Guardian", 120, 12, 15);
+        auto angelGear = makeGear("Celestial Spear", GearType::SPEAR, GearLevel::GOD);
+        Character(enemies, enemies.indexOf(angel)).equipGear(std::move(angelGear));
+    }
+
+    // Replace the enemies with a wave of `count`, cycling through the same
+    // three kinds. Each kind's gear is made once and shared by every row
+    // wearing it.
+    void createWave(uint32_t count) {
+        enemies.clear();
+        effects.clear(turn);
+        enemies.reserve(count);
+        int goblinGear = enemies.addGear(makeGear("Rusty Dagger", GearType::SWORD, GearLevel::NORMAL));
+        int demonGear = enemies.addGear(makeGear("Hell Sword", GearType::SWORD, GearLevel::DEMON));
+        int angelGear = enemies.addGear(makeGear("Celestial Spear", GearType::SPEAR, GearLevel::GOD));
+        for (uint32_t i = 0; i < count; i++) {
+            EntityHandle enemy;
+            int gear;
+            switch(i % 3) {
+                case 0: enemy = enemies.create("Goblin", 50, 10, 2); gear = goblinGear; break;
+                case 1: enemy = enemies.create("Demon Knight", 80, 15, 8); gear = demonGear; break;
+                default: enemy = enemies.create("Angel Guardian", 120, 12, 15); gear = angelGear; break;
+            }
+            enemies.equip(enemies.indexOf(enemy), gear);
+        }
+    }
+
+    // Replace the enemies with a generated wave (horde mode)
+    void createEncounter(const EncounterSpec& spec) {
+        enemies.clear();
+        effects.clear(turn);
+        generateEncounter(enemies, spec);
+    }
+    
+    // Headless battle loop; the interactive one (playInteractive) takes the
+    // same steps but waits on the keyboard for the player's move.
+    void gameLoop() {
+        TRACE_ZONE("battle");
+        journalBattleStart();
+        while (!battleOver()) {
+            beginTurn();
+            if (playerCanAct()) {
+                TRACE_ZONE("player turn");
+                performAction(policy->chooseAction(*this));
+            }
+            finishTurn();
+        }
+        endBattle();
+    }
+    
+    Task<> playInteractive();
+    
+    // The headless loop a move at a time, for players outside the process.
+    // After journalBattleStart(), toDecision() plays up to the player's next
+    // move; false means the battle has ended instead. decide() plays the
+    // move and the rest of its turn.
+    bool toDecision() {
+        while (!battleOver()) {
+            beginTurn();
+            if (playerCanAct()) return true;
+            finishTurn();
+        }
+        endBattle();
+        return false;
+    }
+    
+    void decide(const PlayerAction& action) {
+        performAction(action);
+        finishTurn();
+    }
+    
+    bool battleOver() const {
+        return party.currentHealth[getPlayerIndex()] <= 0 || enemies.empty() || (maxTurns > 0 && turn > maxTurns);
+    }
+    
+    // Checkpoint, then status effects
+    void beginTurn() {
+        TRACE_TURN();
+        TRACE_ZONE("begin turn");
+        if (autosave) {
+            autosave->stage(party, enemies, captureState());
+            if (input) {
+                // Written while the player thinks, or once they answer
+                input->post([this] { flushAutosave(); return false; });
+            } else {
+                flushAutosave();
+            }
+        }
+        
+        if (combatJournal) {
+            combatJournal->setTurn(turn);
+            record(EventType::TURN_START, {});
+        }
+        say("\n========== TURN ", turn, " ==========");
+        
+        // Process status effects
+        processStatusEffects();
+    }
+    
+    void flushAutosave() {
+        TRACE_ZONE("autosave flush");
+        if (autosave && autosave->hasStaged() && !autosave->flush()) {
+            say("Autosave to ", autosave->getPath(), " failed!");
+        }
+    }
+    
+    // Remove the dead, then the enemies' turns
+    void finishTurn() {
+        removeDeadEnemies();
+        if (enemies.empty()) {
+            return;
+        }
+        enemyTurns();
+        turn++;
+    }
+    
+    void endBattle() {
+        flushAutosave();
+        if (combatJournal) {
+            Character hero = player();
+            if (!hero.isAlive()) record(EventType::DEATH, hero.ref());
+            record(EventType::BATTLE_END, {}, {}, 0, hero.isAlive() && enemies.empty());
+        }
+        say("\n========================================");
+        if (player().isAlive()) {
+            say("     VICTORY! YOU ARE THE CHAMPION!     ");
+        } else {
+            say("       DEFEAT! BETTER LUCK NEXT TIME    ");
+        }
+        say("========================================");
+        say("Battle seed: ", seed, " (replay with --seed ", seed, ")");
+        if (gameOut) gameOut->present();
+    }
+    
+    // Opens a battle in the journal with everyone's current state, so a
+    // replay can start here without the snapshot it may have resumed from.
+    void journalBattleStart() {
+        if (!combatJournal) return;
+        combatJournal->setTurn(turn);
+        record(EventType::BATTLE_START, {}, {}, (int32_t)(uint32_t)seed, (int32_t)(uint32_t)(seed >> 32));
+        for (EntityStore* store : {&party, &enemies}) {
+            for (uint32_t i = 0; i < store->size(); i++) {
+                JournalRef who = Character(*store, i).ref();
+                record(EventType::SPAWN, who, {}, store->maxHealth[i], store->currentHealth[i]);
+                for (const StatusInfo& status : statusTable) {
+                    int turns = status.get(*store, i);
+                    if (turns > 0) record(status.appliedEvent, who, {}, 0, status.period > 0 ? turns : 0);
+                }
+                if (store->souls[i] > 0) record(EventType::SOUL_GAINED, who, {}, 0, store->souls[i]);
+                if (store->worshippers[i] > 0) record(EventType::WORSHIPPER_GAINED, who, {}, 0, store->worshippers[i]);
+            }
+        }
+    }
+    
+    // One status line per combatant, for renderers with a status panel.
+    // Huge waves are cut short; the panel only has room for a few rows.
+    void updateStatusPanel() const {
+        if (!gameOut) return;
+        std::vector<Line> panel;
+        panel.push_back(statusLine(party, getPlayerIndex()));
+        const uint32_t shown = std::min<uint32_t>((uint32_t)enemies.size(), 8);
+        for (uint32_t i = 0; i < shown; i++) {
+            Line line = makeLine(i + 1, ". ");
+            line.append(statusLine(enemies, i));
+            panel.push_back(std::move(line));
+        }
+        if (enemies.size() > shown) {
+            panel.push_back(makeLine("   ... and ", enemies.size() - shown, " more"));
+        }
+        gameOut->setStatus(std::move(panel));
+    }
+    
+    static Line statusLine(const EntityStore& s, uint32_t i) {
+        Line line = makeLine(s.names[i], "  HP ", s.currentHealth[i], "/", s.maxHealth[i],
+                             "  DMG ", totalDamage(s, i), "  ARM ", totalArmor(s, i));
+        if (const Gear* gear = s.gearAt(i)) {
+            line.append(makeLine("  ", gear->levelLabel()));
+        }
+        for (const StatusInfo& status : statusTable) {
+            int turns = status.get(s, i);
+            if (turns <= 0) continue;
+            if (status.period > 0) {
+                line.append(makeColoredLine(status.color, "  ", status.name, " ", turns));
+            } else {
+                line.append(makeColoredLine(status.color, "  ", status.name));
+            }
+        }
+        return line;
+    }
+    
+    // Swap-remove every dead enemy. Walking backwards means the row that
+    // moves into a freed index has already been checked.
+    void removeDeadEnemies() {
+        TRACE_ZONE("remove dead");
+        Character hero = player();
+        for (uint32_t i = (uint32_t)enemies.size(); i-- > 0;) {
+            if (enemies.currentHealth[i] > 0) continue;
+            
+            record(EventType::DEATH, Character(enemies, i).ref());
+            say(enemies.names[i], " has been defeated!");
+            // The dimensional storage device keeps gear from any faction
+            if (const Gear* gear = enemies.gearAt(i)) {
+                int id = party.addGear(enemies.armory[enemies.gearId[i]]);
+                inventory.add((uint32_t)id, *gear);
+                say(gear->name, " goes into the dimensional storage.");
+            }
+            // DEMON gear soul steal
+            if (hero.gearLevel() == GearLevel::DEMON) {
+                hero.addSouls(1);
+                record(EventType::SOUL_GAINED, hero.ref(), {}, 1, hero.souls());
+                say("Soul stolen! Total souls: ", hero.souls());
+            }
+            enemies.removeAt(i);
+        }
+    }
+    
+    // Tick whatever statuses are due this turn: the party's first, then the
+    // enemies', each in row order.
+    void processStatusEffects() {
+        TRACE_ZONE("status effects");
+        for (const StatusTick& due : effects.dueAt(turn, party, enemies)) {
+            EntityStore& store = due.side == SIDE_PARTY ? party : enemies;
+            const StatusInfo& status = statusInfo(due.id);
+            Character bearer(store, due.index);
+            int damage = status.tickDamage * due.stacks;
+            if (damage > 0) bearer.takeDamage(damage);
+            int left = effects.tick(store, due, turn);
+            TRACE_COUNT("status ticks", 1);
+            record(status.tickEvent, bearer.ref(), {}, damage, left);
+            if (left == 0) {
+                say(bearer.name(), status.endText);
+            }
+        }
+    }
+    
+    // Start of the player's turn: false when a status costs them the move.
+    bool playerCanAct() {
+        Character hero = player();
+        hero.displayStatus();
+        
+        if (const StatusInfo* status = effects.skipTurn(party, hero.index)) {
+            record(status->usedEvent, hero.ref());
+            say("You are ", status->adjective, " and cannot act this turn!");
+            return false;
+        }
+        
+        updateStatusPanel();
+        return true;
+    }
+    
+    void performAction(const PlayerAction& action) {
+        TRACE_ZONE("player action");
+        Character hero = player();
+        switch(action.type) {
+            case ActionType::ATTACK:
+                performAttack(action.target);
+                break;
+            case ActionType::ABILITY:
+                useSpecialAbility(action.ability, action.target);
+                break;
+            case ActionType::HEAL:
+                hero.heal(20);
+                break;
+            case ActionType::EQUIP:
+                equipItem(action.item);
+                break;
+            case ActionType::SKIP:
+                break;
+        }
+    }
+    
+    bool isValidTarget(int target) const {
+        return target >= 0 && target < (int)enemies.size();
+    }
+    
+    void performAttack(int targetIndex) {
+        if (!isValidTarget(targetIndex)) return;
+        
+        Character hero = player();
+        Character target(enemies, targetIndex);
+        int damage = hero.getTotalDamage();
+        
+        // DEMON ability: more damage to low health enemies
+        if (hero.gearLevel() == GearLevel::DEMON) {
+            if (ExecutionBelow::fractionBelow(target.currentHealth(), target.maxHealth())) {
+                damage = ExecutionDamage::scale(damage);
+                say("Execution bonus! Attacking weakened enemy!");
+            }
+        }
+        
+        say(hero.name(), " attacks ", target.name(), "!");
+        hero.strike(target, damage);
+    }
+    
+    void useSpecialAbility(AbilityId ability, int targetIndex);
+    
+    // Swap to a stored item; the old gear stays in storage.
+    void equipItem(ItemHandle item) {
+        if (!inventory.contains(item) || inventory.isEquipped(item)) {
+            say("Nothing new to equip!");
+            return;
+        }
+        Character hero = player();
+        inventory.setEquipped(item);
+        party.equip(hero.index, (int)inventory.get(item).gearId);
+        record(EventType::EQUIP, hero.ref(), {}, hero.maxHealth(), hero.currentHealth());
+        const Gear* gear = hero.equippedGear();
+        say(hero.name(), " equips ", gear->name, " (", gear->levelLabel(), ")!");
+    }
+    
+    // Ability handlers, dispatched through abilityHandlers. Untargeted ones
+    // ignore the target.
+    
+    void usePoisonAbility(int target) {
+        if (!isValidTarget(target)) return;
+        
+        effects.apply(enemies, target, StatusId::POISON, 3, turn);
+        record(EventType::POISONED, Character(enemies, target).ref(), player().ref(), 0, 3);
+        say(enemies.names[target], " has been poisoned for 3 turns!");
+    }
+    
+    void useMultiAttack(int) {
+        Character hero = player();
+        say(hero.name(), " attacks all enemies!");
+        int damage = MultiAttackDamage::scale(hero.getTotalDamage());
+        hero.strikeAll(enemies, damage);
+    }
+    
+    void useRestrain(int target) {
+        if (!isValidTarget(target)) return;
+        
+        effects.apply(enemies, target, StatusId::RESTRAIN, 1, turn);
+        record(EventType::RESTRAINED, Character(enemies, target).ref(), player().ref());
+        say(enemies.names[target], " has been restrained for 1 turn!");
+    }
+    
+    void useHolyTakedown(int target) {
+        if (!isValidTarget(target)) return;
+        
+        Character hero = player();
+        int damage = hero.getTotalDamage() + hero.getTotalArmor();
+        say(hero.name(), " performs Holy Takedown!");
+        hero.strike(Character(enemies, target), damage);
+    }
+    
+    void useSoulSteal(int) {
+        Character hero = player();
+        say(hero.name(), " attempts to steal souls!");
+        for (uint32_t i = 0; i < enemies.size(); i++) {
+            if (SoulStealBelow::fractionBelow(enemies.currentHealth[i], enemies.maxHealth[i])) {
+                hero.addSouls(1);
+                record(EventType::SOUL_GAINED, hero.ref(), {}, 1, hero.souls());
+                Character(enemies, i).takeDamage(10);
+                say("Soul partially stolen from ", enemies.names[i], "!");
+            }
+        }
+        say("Total souls: ", hero.souls());
+    }
+    
+    void useDivineProtection(int) {
+        Character hero = player();
+        hero.addWorshippers(1);
+        record(EventType::WORSHIPPER_GAINED, hero.ref(), {}, 1, hero.worshippers());
+        hero.heal(15);
+        say(hero.name(), " gains a worshipper and divine healing!");
+        say("Total worshippers: ", hero.worshippers());
+    }
+    
+    ScriptWorld scriptWorld(uint8_t side, uint32_t index) {
+        ScriptWorld world;
+        world.party = &party;
+        world.enemies = &enemies;
+        world.rng = &rng;
+        world.effects = &effects;
+        world.turn = turn;
+        world.actorSide = side;
+        world.actorIndex = index;
+        return world;
+    }
+    
+    void viewEnemyStatus() const {
+        for (uint32_t i = 0; i < enemies.size(); i++) {
+            displayStatus(enemies, i);
+        }
+    }
+    
+    void displayPlayerStatus() const {
+        displayStatus(party, getPlayerIndex());
+    }
+    
+    void enemyTurns(uint32_t first = 0) {
+        TRACE_ZONE("enemy turns");
+        for (uint32_t i = nextActingEnemy(first); i < enemies.size(); i = nextActingEnemy(i + 1)) {
+            performEnemyAction(i, chooseEnemyAction(i));
+        }
+    }
+    
+    // The first enemy from `i` on that gets to act, or enemies.size() for
+    // none. Enemies a status keeps from acting (restraint) are passed over,
+    // using up a turn of it.
+    uint32_t nextActingEnemy(uint32_t i) {
+        for (; i < enemies.size(); i++) {
+            if (enemies.currentHealth[i] <= 0) continue;
+            
+            if (const StatusInfo* status = effects.skipTurn(enemies, i)) {
+                Character enemy(enemies, i);
+                record(status->usedEvent, enemy.ref());
+                say(enemy.name(), " is ", status->adjective, " and cannot act!");
+                continue;
+            }
+            return i;
+        }
+        return (uint32_t)enemies.size();
+    }
+    
+    EnemyAction chooseEnemyAction(uint32_t i) {
+        TRACE_ZONE("enemy decision");
+        if (enemyPolicy) {
+            return enemyPolicy->chooseAction(*this, i);
+        }
+        
+        Character enemy(enemies, i);
+        if (scripts && enemy.equippedGear()) {
+            ScriptWorld world = scriptWorld(SIDE_ENEMIES, i);
+            switch(scripts->enemyTurn(enemy.gearLevel(), world)) {
+                case ScriptedAction::ATTACK: return EnemyAction::ATTACK;
+                case ScriptedAction::SPECIAL: return EnemyAction::SPECIAL;
+                case ScriptedAction::HEAL: return EnemyAction::HEAL;
+                case ScriptedAction::NONE: break;
+            }
+        }
+        
+        // Simple AI
+        int action = rng.roll(1, 10);
+        if (action <= 6) return EnemyAction::ATTACK;
+        if (action <= 8 && enemy.equippedGear()) return EnemyAction::SPECIAL;
+        return EnemyAction::HEAL;
+    }
+    
+    void performEnemyAction(uint32_t i, EnemyAction action) {
+        Character hero = player();
+        Character enemy(enemies, i);
+        
+        if (action == EnemyAction::HEAL) {
+            enemy.heal(10);
+        } else if (action == EnemyAction::SPECIAL && enemy.gearLevel() == GearLevel::DEMON) {
+            // Poison player
+            if (!hero.isPoisoned() && rng.roll(1, 2) == 1) {
+                effects.apply(party, hero.index, StatusId::POISON, 3, turn);
+                record(EventType::POISONED, hero.ref(), enemy.ref(), 0, 3);
+                say(enemy.name(), " poisons ", hero.name(), "!");
+            } else {
+                say(enemy.name(), " attacks with dark energy!");
+                enemy.strike(hero, DarkEnergyDamage::scale(enemy.getTotalDamage()));
+            }
+        } else if (action == EnemyAction::SPECIAL && enemy.gearLevel() == GearLevel::GOD) {
+            // Restrain player
+            if (!hero.isRestrained() && rng.roll(1, 3) == 1) {
+                effects.apply(party, hero.index, StatusId::RESTRAIN, 1, turn);
+                record(EventType::RESTRAINED, hero.ref(), enemy.ref());
+                say(enemy.name(), " restrains ", hero.name(), "!");
+            } else {
+                say(enemy.name(), " performs a holy strike!");
+                enemy.strike(hero, enemy.getTotalDamage() + HolyStrikeArmor::scale(enemy.getTotalArmor()));
+            }
+        } else {
+            // Regular attack, and the special of normal gear
+            say(enemy.name(), " attacks ", hero.name(), "!");
+            enemy.strike(hero, enemy.getTotalDamage());
+        }
+    }
+};
+
+// Keyboard-driven player: the original menus, read through the event loop.
+// Each menu is a coroutine that suspends until the player answers.
+class ConsolePlayer {
+public:
+    explicit ConsolePlayer(EventLoop& eventLoop) : input(eventLoop) {}
+    
+    Task<PlayerAction> chooseAction(const Game& game) {
+        while (true) {
+            PlayerAction action;
+            std::vector<Line> menu = {
+                makeLine("Choose your action:"),
+                makeLine("1. Attack"),
+                makeLine("2. Use Special Ability"),
+                makeLine("3. Heal (20 HP)"),
+                makeLine("4. View Enemy Status"),
+                makeLine("5. Dimensional Storage"),
+            };
+            switch(co_await promptChoice(input, std::move(menu))) {
+                case 1:
+                    action.type = ActionType::ATTACK;
+                    action.target = co_await chooseTarget(game, "Choose target:", true);
+                    co_return action;
+                case 2:
+                    co_return co_await chooseAbility(game);
+                case 3:
+                    action.type = ActionType::HEAL;
+                    co_return action;
+                case 4:
+                    game.viewEnemyStatus();
+                    game.displayPlayerStatus();  // Let player choose again
+                    break;
+                case 5:
+                    action = co_await chooseItem(game);
+                    if (action.type == ActionType::EQUIP) co_return action;
+                    break;
+                default:
+                    say("Invalid choice! Skipping turn...");
+                    co_return action;
+            }
+        }
+    }
+    
+private:
+    EventLoop& input;
+    
+    Task<int> chooseTarget(const Game& game, const char* prompt, bool showHealth) {
+        const auto& enemies = game.getEnemies();
+        if (enemies.empty()) co_return -1;
+        
+        std::vector<Line> menu = {makeLine(prompt)};
+        for (uint32_t i = 0; i < enemies.size(); i++) {
+            Line line = makeLine(i + 1, ". ", enemies.names[i]);
+            if (showHealth) {
+                line.append(makeLine(" (HP: ", enemies.currentHealth[i], "/", enemies.maxHealth[i], ")"));
+            }
+            menu.push_back(std::move(line));
+        }
+        co_return co_await promptChoice(input, std::move(menu)) - 1;
+    }
+    
+    // Browse storage best first by a stat; picking an item equips it.
+    Task<PlayerAction> chooseItem(const Game& game) {
+        PlayerAction action;
+        const Inventory& inventory = game.getInventory();
+        std::vector<Line> sortMenu = {
+            makeLine("Dimensional storage holds ", inventory.size(), " item(s). Sort by:"),
+            makeLine("1. Damage"),
+            makeLine("2. Armor"),
+            makeLine("3. Health"),
+        };
+        int sort = co_await promptChoice(input, std::move(sortMenu));
+        if (sort < 1 || sort > ITEM_STAT_COUNT) co_return action;
+        
+        const size_t shown = 9;
+        std::vector<ItemHandle> items = inventory.best((ItemStat)(sort - 1), shown);
+        std::vector<Line> menu = {makeLine("Choose gear to equip (0 to go back):")};
+        for (size_t i = 0; i < items.size(); i++) {
+            const InventoryItem& item = inventory.get(items[i]);
+            const Gear& gear = *game.getParty().armory[item.gearId];
+            Line line = makeLine(i + 1, ". ", gear.name, " (");
+            line.append(gear.levelLabel());
+            line.append(makeLine(") DMG +", gear.damageBonus, " ARM +", gear.armorBonus, " HP +", gear.healthBonus));
+            if (inventory.isEquipped(items[i])) line.append(makeColoredLine(Color::GREEN, "  [equipped]"));
+            menu.push_back(std::move(line));
+        }
+        if (inventory.size() > shown) {
+            menu.push_back(makeLine("   ... ", inventory.size() - shown, " more"));
+        }
+        int pick = co_await promptChoice(input, std::move(menu));
+        if (pick >= 1 && pick <= (int)items.size()) {
+            action.type = ActionType::EQUIP;
+            action.item = items[pick - 1];
+        }
+        co_return action;
+    }
+    
+    Task<PlayerAction> chooseAbility(const Game& game) {
+        PlayerAction action;
+        action.type = ActionType::ABILITY;
+        
+        const Gear* gear = game.getParty().gearAt(game.getPlayerIndex());
+        if (!gear || gear->abilities.empty()) {
+            co_return action;  // Game reports that there is nothing to use
+        }
+        
+        std::vector<Line> menu = {makeLine("Choose ability:")};
+        int number = 1;
+        gear->abilities.forEach([&](AbilityId id) {
+            menu.push_back(makeLine(number++, ". ", abilityInfo(id).name));
+        });
+        action.ability = gear->abilities.at(co_await promptChoice(input, std::move(menu)) - 1);
+        
+        switch(action.ability) {
+            case AbilityId::POISON:
+                action.target = co_await chooseTarget(game, "Choose target to poison:", false);
+                break;
+            case AbilityId::RESTRAIN:
+                action.target = co_await chooseTarget(game, "Choose target to restrain:", false);
+                break;
+            case AbilityId::HOLY_TAKEDOWN:
+                action.target = co_await chooseTarget(game, "Choose target for Holy Takedown:", false);
+                break;
+            default:
+                break;
+        }
+        co_return action;
+    }
+};
+
+// Active ability handlers, indexed by AbilityId. Passive abilities have no
+// handler; the rules apply them on their own.
+using AbilityHandler = void (Game::*)(int target);
+
+inline constexpr std::array<AbilityHandler, ABILITY_COUNT> abilityHandlers = {
+    &Game::useSoulSteal,         // SOUL_STEAL
+    &Game::usePoisonAbility,     // POISON
+    &Game::useMultiAttack,       // MULTI_ATTACK
+    nullptr,                     // DEATH_BLOW
+    &Game::useRestrain,          // RESTRAIN
+    nullptr,                     // HOLY_ARMOR
+    &Game::useHolyTakedown,      // HOLY_TAKEDOWN
+    &Game::useDivineProtection,  // DIVINE_PROTECTION
+};
+
+inline void Game::useSpecialAbility(AbilityId ability, int targetIndex) {
+    const Gear* gear = player().equippedGear();
+    if (!gear || gear->abilities.empty()) {
+        say("No special abilities available!");
+        return;
+    }
+    
+    if (!gear->abilities.has(ability)) {
+        say("Invalid choice!");
+        return;
+    }
+    
+    const AbilityInfo& info = abilityInfo(ability);
+    if (info.passive) {
+        say(info.name, " is passive: ", info.description, ".");
+        return;
+    }
+    if (scripts && scripts->hasAbility(gear->level, ability)) {
+        if (info.needsTarget && !isValidTarget(targetIndex)) return;
+        ScriptWorld world = scriptWorld(SIDE_PARTY, getPlayerIndex());
+        scripts->runAbility(gear->level, ability, world, targetIndex);
+        return;
+    }
+    (this->*abilityHandlers[(int)ability])(targetIndex);
+}
+
+inline Game::Game(EventLoop& eventLoop, uint64_t battleSeed, SnapshotWriter* autosaveTo, const std::string& resumePath,
+                  ScriptEngine* scriptEngine, EnemyPolicy* enemyAi)
+    : input(&eventLoop), autosave(autosaveTo), scripts(scriptEngine), enemyPolicy(enemyAi) {
+    seedStreams(battleSeed);
+    
+    say("========================================");
+    say("     TERMINAL COMBAT: GODS VS DEMONS    ");
+    say("========================================");
+    
+    bool resumed = false;
+    if (!resumePath.empty()) {
+        std::string error;
+        resumed = loadSnapshot(resumePath, error);
+        if (resumed) {
+            say("Resumed ", resumePath, " at turn ", turn, ".");
+        } else {
+            say("Could not resume ", resumePath, ": ", error, ". Starting a new game.");
+        }
+    }
+    
+    eventLoop.run([](Game& game, bool resumed) -> Task<> {
+        if (!resumed) co_await game.initializeGame();
+        co_await game.playInteractive();
+    }(*this, resumed));
+}
+
+// The battle loop with the player at the keyboard. The turn suspends while
+// the player chooses; meanwhile the event loop writes the turn's autosave
+// and lets the enemy AI think ahead.
+inline Task<> Game::playInteractive() {
+    ConsolePlayer console(*input);
+    journalBattleStart();
+    while (!battleOver()) {
+        beginTurn();
+        if (playerCanAct()) {
+            if (enemyPolicy) {
+                pondering = true;
+                input->post([this, now = turn] { return pondering && turn == now && enemyPolicy->ponder(*this); });
+            }
+            PlayerAction action = co_await console.chooseAction(*this);
+            pondering = false;
+            flushAutosave();  // In case there was no time to write it
+            performAction(action);
+        }
+        finishTurn();
+    }
+    endBattle();
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <string>
+#include <utility>
+
+#include "abilities.h"
+#include "balance.h"
+#include "names.h"
+#include "output.h"
+
+// Enums for gear types and levels
+enum class GearType {
+    SWORD,
+    SPEAR,
+    ARROW
+};
+
+enum class GearLevel {
+    NORMAL,
+    DEMON,
+    GOD
+};
+
+constexpr int GEAR_TYPE_COUNT = 3;
+constexpr int GEAR_LEVEL_COUNT = 3;
+
+inline AbilitySet levelAbilities(GearLevel level) {
+    switch(level) {
+        case GearLevel::DEMON: return demonAbilities;
+        case GearLevel::GOD: return godAbilities;
+        default: return AbilitySet{};
+    }
+}
+
+// Base Gear class
+class Gear {
+public:
+    Name name;
+    GearType type;
+    GearLevel level;
+    AbilitySet abilities;
+    
+    // Stats modifiers
+    int healthBonus = 0;
+    int armorBonus = 0;
+    int damageBonus = 0;
+    
+    Gear(Name n, GearType t, GearLevel l) : name(n), type(t), level(l) {
+        initializeGear();
+    }
+    
+    // Gear with its stats spelled out (catalog entries); abilities still
+    // come with the level.
+    Gear(Name n, GearType t, GearLevel l, int health, int armor, int damage)
+        : name(n), type(t), level(l), abilities(levelAbilities(l)),
+          healthBonus(health), armorBonus(armor), damageBonus(damage) {}
+    
+    void initializeGear() {
+        const Balance& balance = *gameBalance;
+        
+        // Base stats based on type
+        switch(type) {
+            case GearType::SWORD:
+                damageBonus = balance.swordDamage;
+                armorBonus = balance.swordArmor;
+                healthBonus = balance.swordHealth;
+                break;
+            case GearType::SPEAR:
+                damageBonus = balance.spearDamage;
+                armorBonus = balance.spearArmor;
+                healthBonus = balance.spearHealth;
+                break;
+            case GearType::ARROW:
+                damageBonus = balance.arrowDamage;
+                armorBonus = balance.arrowArmor;
+                healthBonus = balance.arrowHealth;
+                break;
+        }
+        
+        // Level-specific bonuses and abilities
+        switch(level) {
+            case GearLevel::DEMON:
+                abilities = demonAbilities;
+                damageBonus += balance.demonDamage;
+                break;
+            case GearLevel::GOD:
+                abilities = godAbilities;
+                armorBonus += balance.godArmor;
+                healthBonus += balance.godHealth;
+                break;
+            case GearLevel::NORMAL:
+                // No special abilities for normal gear
+                break;
+        }
+    }
+    
+    std::string getTypeString() const {
+        switch(type) {
+            case GearType::SWORD: return "Sword";
+            case GearType::SPEAR: return "Spear";
+            case GearType::ARROW: return "Arrow";
+            default: return "Unknown";
+        }
+    }
+    
+    std::string getLevelString() const {
+        switch(level) {
+            case GearLevel::DEMON: return "DEMON";
+            case GearLevel::GOD: return "GOD";
+            case GearLevel::NORMAL: return "Normal";
+            default: return "Unknown";
+        }
+    }
+    
+    Color getLevelColor() const {
+        switch(level) {
+            case GearLevel::DEMON: return Color::RED;
+            case GearLevel::GOD: return Color::YELLOW;
+            default: return Color::DEFAULT;
+        }
+    }
+    
+    // Level name in its color, ready to drop into say()
+    Line levelLabel() const {
+        return makeLine(Colored{getLevelString(), getLevelColor()});
+    }
+    
+    void displayInfo() const {
+        if (!gameOut) return;
+        say("\n=== ", name, " ===");
+        say("Type: ", getTypeString());
+        say("Level: ", levelLabel());
+        say("Health Bonus: +", healthBonus);
+        say("Armor Bonus: +", armorBonus);
+        say("Damage Bonus: +", damageBonus);
+        if (!abilities.empty()) {
+            Line line = makeLine("Abilities: ");
+            const char* separator = "";
+            abilities.forEach([&](AbilityId id) {
+                line.append(separator);
+                line.append(abilityInfo(id).name);
+                separator = ", ";
+            });
+            say(line);
+        }
+    }
+};
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "gear.h"
+#include "mapped_file.h"
+
+// Gear catalog: every piece of gear the game knows, compiled offline from a
+// text source by gearc into one flat binary file that is used straight out
+// of a read-only mapping.
+//
+// Source, one entry per line ('#' starts a comment):
+//
+//   name | type | level [| health | armor | damage]
+//
+// with type sword/spear/arrow and level normal/demon/god. Entries without
+// stats take them from the balance table when the gear is made, so balance
+// tuning still applies to them.
+//
+// Binary, native little-endian:
+//
+//   CatalogHeader
+//   CatalogRecord[count]   sorted by (type, level), source order within
+//   uint32_t[count]        ids sorted by name
+//   char[stringBytes]      names, each distinct name stored once
+//
+// Sorting by (type, level) makes every type and every (type, level) pair a
+// contiguous id range recorded in the header, so lookups by id, type or
+// level are array indexing, and by name a binary search.
+
+constexpr char CATALOG_MAGIC[8] = {'T', 'G', 'G', 'E', 'A', 'R', '\0', '\0'};
+constexpr uint32_t CATALOG_VERSION = 1;
+constexpr uint32_t CATALOG_ENDIAN_TAG = 0x01020304;
+constexpr uint32_t NO_GEAR = UINT32_MAX;
+
+constexpr uint8_t CATALOG_BALANCED_STATS = 1;  // Stats come from the balance table
+
+constexpr int CATALOG_GROUPS = GEAR_TYPE_COUNT * GEAR_LEVEL_COUNT;
+
+struct CatalogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint64_t fileSize;
+    uint32_t count;
+    uint32_t stringBytes;
+    uint64_t recordsOffset;
+    uint64_t nameIndexOffset;
+    uint64_t stringsOffset;
+    uint32_t groupStart[CATALOG_GROUPS + 1];  // First id of each (type, level) group, then count
+};
+
+struct CatalogRecord {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    int32_t healthBonus;
+    int32_t armorBonus;
+    int32_t damageBonus;
+    uint8_t type;
+    uint8_t level;
+    uint8_t flags;
+    uint8_t reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<CatalogHeader> && sizeof(CatalogHeader) == 96);
+static_assert(sizeof(CatalogRecord) == 24);
+
+inline int catalogGroup(GearType type, GearLevel level) {
+    return (int)type * GEAR_LEVEL_COUNT + (int)level;
+}
+
+// Compile catalog source into a binary image. Fails on the first bad line.
+inline bool compileGearCatalog(std::istream& source, std::vector<char>& image, std::string& error) {
+    struct Entry {
+        std::string name;
+        CatalogRecord record;
+    };
+    auto trim = [](std::string_view text) {
+        while (!text.empty() && std::isspace((unsigned char)text.front())) text.remove_prefix(1);
+        while (!text.empty() && std::isspace((unsigned char)text.back())) text.remove_suffix(1);
+        return text;
+    };
+    auto lower = [](std::string_view text) {
+        std::string out(text);
+        for (char& c : out) c = (char)std::tolower((unsigned char)c);
+        return out;
+    };
+
+    std::vector<Entry> entries;
+    std::string line;
+    for (int number = 1; std::getline(source, line); number++) {
+        std::string_view text = line;
+        text = trim(text.substr(0, text.find('#')));
+        if (text.empty()) continue;
+
+        std::vector<std::string_view> fields;
+        while (true) {
+            size_t bar = text.find('|');
+            fields.push_back(trim(text.substr(0, bar)));
+            if (bar == std::string_view::npos) break;
+            text.remove_prefix(bar + 1);
+        }
+        std::string where = "line " + std::to_string(number) + ": ";
+        if ((fields.size() != 3 && fields.size() != 6) || fields[0].empty()) {
+            error = where + "expected name | type | level [| health | armor | damage]";
+            return false;
+        }
+
+        Entry entry{std::string(fields[0]), CatalogRecord{}};
+        std::string type = lower(fields[1]);
+        std::string level = lower(fields[2]);
+        if (type == "sword") entry.record.type = (uint8_t)GearType::SWORD;
+        else if (type == "spear") entry.record.type = (uint8_t)GearType::SPEAR;
+        else if (type == "arrow") entry.record.type = (uint8_t)GearType::ARROW;
+        else {
+            error = where + "unknown gear type '" + type + "'";
+            return false;
+        }
+        if (level == "normal") entry.record.level = (uint8_t)GearLevel::NORMAL;
+        else if (level == "demon") entry.record.level = (uint8_t)GearLevel::DEMON;
+        else if (level == "god") entry.record.level = (uint8_t)GearLevel::GOD;
+        else {
+            error = where + "unknown gear level '" + level + "'";
+            return false;
+        }
+
+        if (fields.size() == 6) {
+            int32_t* stats[3] = {&entry.record.healthBonus, &entry.record.armorBonus, &entry.record.damageBonus};
+            for (int i = 0; i < 3; i++) {
+                std::string value(fields[3 + i]);
+                char* end = nullptr;
+                errno = 0;
+                long parsed = std::strtol(value.c_str(), &end, 10);
+                if (value.empty() || *end != '\0') {
+                    error = where + "stat '" + value + "' is not a number";
+                    return false;
+                }
+                if (errno == ERANGE || parsed < INT32_MIN || parsed > INT32_MAX) {
+                    error = where + "stat '" + value + "' is out of range";
+                    return false;
+                }
+                *stats[i] = (int32_t)parsed;
+            }
+        } else {
+            entry.record.flags = CATALOG_BALANCED_STATS;
+        }
+        entries.push_back(std::move(entry));
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return catalogGroup((GearType)a.record.type, (GearLevel)a.record.level) <
+               catalogGroup((GearType)b.record.type, (GearLevel)b.record.level);
+    });
+
+    CatalogHeader header{};
+    std::memcpy(header.magic, CATALOG_MAGIC, sizeof(header.magic));
+    header.version = CATALOG_VERSION;
+    header.endianTag = CATALOG_ENDIAN_TAG;
+    header.count = (uint32_t)entries.size();
+
+    // Intern names, and find where each group starts
+    std::string strings;
+    std::unordered_map<std::string_view, uint32_t> interned;
+    std::vector<CatalogRecord> records;
+    records.reserve(entries.size());
+    int group = 0;
+    for (uint32_t id = 0; id < entries.size(); id++) {
+        Entry& entry = entries[id];
+        int g = catalogGroup((GearType)entry.record.type, (GearLevel)entry.record.level);
+        while (group <= g) header.groupStart[group++] = id;
+
+        auto found = interned.find(entry.name);
+        if (found == interned.end()) {
+            found = interned.emplace(entry.name, (uint32_t)strings.size()).first;
+            strings += entry.name;
+        }
+        entry.record.nameOffset = found->second;
+        entry.record.nameLength = (uint32_t)entry.name.size();
+        records.push_back(entry.record);
+    }
+    while (group <= CATALOG_GROUPS) header.groupStart[group++] = header.count;
+
+    std::vector<uint32_t> nameIndex(entries.size());
+    for (uint32_t id = 0; id < nameIndex.size(); id++) nameIndex[id] = id;
+    std::stable_sort(nameIndex.begin(), nameIndex.end(), [&](uint32_t a, uint32_t b) {
+        return entries[a].name < entries[b].name;
+    });
+
+    header.stringBytes = (uint32_t)strings.size();
+    header.recordsOffset = sizeof(CatalogHeader);
+    header.nameIndexOffset = header.recordsOffset + records.size() * sizeof(CatalogRecord);
+    header.stringsOffset = header.nameIndexOffset + nameIndex.size() * sizeof(uint32_t);
+    header.fileSize = header.stringsOffset + strings.size();
+
+    image.assign(header.fileSize, 0);
+    std::memcpy(image.data(), &header, sizeof(header));
+    if (!records.empty()) {
+        std::memcpy(image.data() + header.recordsOffset, records.data(), records.size() * sizeof(CatalogRecord));
+        std::memcpy(image.data() + header.nameIndexOffset, nameIndex.data(), nameIndex.size() * sizeof(uint32_t));
+    }
+    std::memcpy(image.data() + header.stringsOffset, strings.data(), strings.size());
+    return true;
+}
+
+// A compiled catalog, mapped read-only. Opening validates the header and
+// bounds once; after that every lookup reads the mapping directly, with no
+// parsing and no allocation per entry.
+class GearCatalog {
+public:
+    bool open(const std::string& path, std::string& error) {
+        records = nullptr;
+        if (!file.open(path, error)) return false;
+        const CatalogHeader* h = reinterpret_cast<const CatalogHeader*>(file.data());
+        bool valid = file.size() >= sizeof(CatalogHeader) &&
+                     std::memcmp(h->magic, CATALOG_MAGIC, sizeof(h->magic)) == 0 &&
+                     h->version == CATALOG_VERSION && h->endianTag == CATALOG_ENDIAN_TAG &&
+                     validLayout(*h, file.size());
+        if (!valid) {
+            error = path + " is not a version " + std::to_string(CATALOG_VERSION) + " gear catalog";
+            file.close();
+            return false;
+        }
+        header = h;
+        records = reinterpret_cast<const CatalogRecord*>(file.data() + h->recordsOffset);
+        nameIndex = reinterpret_cast<const uint32_t*>(file.data() + h->nameIndexOffset);
+        strings = file.data() + h->stringsOffset;
+        int group = 0;
+        for (uint32_t id = 0; id < h->count; id++) {
+            const CatalogRecord& r = records[id];
+            while (h->groupStart[group + 1] <= id) group++;
+            if ((uint64_t)r.nameOffset + r.nameLength > h->stringBytes || nameIndex[id] >= h->count ||
+                r.type >= GEAR_TYPE_COUNT || r.level >= GEAR_LEVEL_COUNT ||
+                catalogGroup((GearType)r.type, (GearLevel)r.level) != group) {
+                error = path + " has an entry out of bounds";
+                records = nullptr;
+                file.close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isOpen() const { return records != nullptr; }
+    uint32_t size() const { return records ? header->count : 0; }
+
+    const CatalogRecord& record(uint32_t id) const { return records[id]; }
+
+    std::string_view name(uint32_t id) const {
+        return std::string_view(strings + records[id].nameOffset, records[id].nameLength);
+    }
+
+    // [begin, end) ids of one type at one level
+    std::pair<uint32_t, uint32_t> range(GearType type, GearLevel level) const {
+        if (!records) return {0, 0};
+        int g = catalogGroup(type, level);
+        return {header->groupStart[g], header->groupStart[g + 1]};
+    }
+
+    // [begin, end) ids of one type, every level
+    std::pair<uint32_t, uint32_t> range(GearType type) const {
+        if (!records) return {0, 0};
+        return {header->groupStart[catalogGroup(type, GearLevel::NORMAL)],
+                header->groupStart[catalogGroup(type, GearLevel::GOD) + 1]};
+    }
+
+    // Every id at one level, one type's range at a time
+    template <typename F>
+    void forEachAtLevel(GearLevel level, F f) const {
+        for (int t = 0; t < GEAR_TYPE_COUNT; t++) {
+            auto [begin, end] = range((GearType)t, level);
+            for (uint32_t id = begin; id < end; id++) f(id);
+        }
+    }
+
+    // First entry with this name, or NO_GEAR
+    uint32_t find(std::string_view wanted) const {
+        if (!records) return NO_GEAR;
+        const uint32_t* end = nameIndex + header->count;
+        const uint32_t* it = std::lower_bound(nameIndex, end, wanted, [this](uint32_t id, std::string_view key) {
+            return name(id) < key;
+        });
+        return it != end && name(*it) == wanted ? *it : NO_GEAR;
+    }
+
+    std::shared_ptr<Gear> makeGear(uint32_t id) const {
+        const CatalogRecord& r = records[id];
+        if (r.flags & CATALOG_BALANCED_STATS) {
+            return std::make_shared<Gear>(name(id), (GearType)r.type, (GearLevel)r.level);
+        }
+        return std::make_shared<Gear>(name(id), (GearType)r.type, (GearLevel)r.level,
+                                      r.healthBonus, r.armorBonus, r.damageBonus);
+    }
+
+private:
+    MappedFile file;
+    const CatalogHeader* header = nullptr;
+
+    // Sections in order and inside the file (no sum can wrap), and group
+    // starts that only go up, from 0 to the entry count
+    static bool validLayout(const CatalogHeader& h, uint64_t size) {
+        auto fits = [size](uint64_t offset, uint64_t count, uint64_t elementSize) {
+            return offset <= size && count <= (size - offset) / elementSize;
+        };
+        if (h.fileSize != size || !fits(h.recordsOffset, h.count, sizeof(CatalogRecord)) ||
+            !fits(h.nameIndexOffset, h.count, sizeof(uint32_t)) || !fits(h.stringsOffset, h.stringBytes, 1) ||
+            h.recordsOffset + (uint64_t)h.count * sizeof(CatalogRecord) > h.nameIndexOffset ||
+            h.nameIndexOffset + (uint64_t)h.count * sizeof(uint32_t) > h.stringsOffset ||
+            h.recordsOffset % alignof(CatalogRecord) != 0 || h.nameIndexOffset % alignof(uint32_t) != 0 ||
+            h.groupStart[0] != 0) {
+            return false;
+        }
+        for (int g = 0; g < CATALOG_GROUPS; g++) {
+            if (h.groupStart[g] > h.groupStart[g + 1]) return false;
+        }
+        return h.groupStart[CATALOG_GROUPS] == h.count;
+    }
+
+    const CatalogRecord* records = nullptr;
+    const uint32_t* nameIndex = nullptr;
+    const char* strings = nullptr;
+};
+
+// The catalog loaded at startup, or nullptr. Read-only once set, so every
+// thread shares it.
+inline const GearCatalog* gearCatalog = nullptr;
+
+// Named gear from the catalog when it has an entry, otherwise built in.
+// Shared from the start (one allocation), since armories share gear.
+inline std::shared_ptr<Gear> makeGear(std::string_view name, GearType type, GearLevel level) {
+    if (gearCatalog) {
+        uint32_t id = gearCatalog->find(name);
+        if (id != NO_GEAR) return gearCatalog->makeGear(id);
+    }
+    return std::make_shared<Gear>(name, type, level);
+}
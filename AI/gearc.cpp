@@ -0,0 +1,56 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gear_catalog.h"
+
+using namespace std;
+
+// Compiles a gear catalog source into the binary the game maps at startup.
+//
+//   gearc SOURCE OUTPUT     compile
+//   gearc --dump CATALOG    list a compiled catalog, grouped by type and level
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cout << "Usage: " << argv[0] << " SOURCE OUTPUT | --dump CATALOG" << endl;
+        return 1;
+    }
+    
+    if (string(argv[1]) == "--dump") {
+        GearCatalog catalog;
+        string error;
+        if (!catalog.open(argv[2], error)) {
+            cout << error << endl;
+            return 1;
+        }
+        for (uint32_t id = 0; id < catalog.size(); id++) {
+            auto gear = catalog.makeGear(id);
+            cout << id << "\t" << gear->name << "\t" << gear->getTypeString() << "\t" << gear->getLevelString()
+                 << "\t+" << gear->healthBonus << " HP, +" << gear->armorBonus << " ARM, +" << gear->damageBonus << " DMG"
+                 << (catalog.record(id).flags & CATALOG_BALANCED_STATS ? " (balance)" : "") << endl;
+        }
+        return 0;
+    }
+    
+    ifstream source(argv[1]);
+    if (!source) {
+        cout << "Cannot read " << argv[1] << endl;
+        return 1;
+    }
+    vector<char> image;
+    string error;
+    if (!compileGearCatalog(source, image, error)) {
+        cout << argv[1] << ": " << error << endl;
+        return 1;
+    }
+    ofstream out(argv[2], ios::binary);
+    if (!out.write(image.data(), image.size())) {
+        cout << "Cannot write " << argv[2] << endl;
+        return 1;
+    }
+    const CatalogHeader* header = reinterpret_cast<const CatalogHeader*>(image.data());
+    cout << header->count << " gear, " << header->stringBytes << " bytes of names, " << image.size() << " bytes" << endl;
+    return 0;
+}
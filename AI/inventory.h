@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "gear.h"
+
+// Stats the inventory keeps sorted indexes on.
+enum class ItemStat : uint8_t {
+    DAMAGE,
+    ARMOR,
+    HEALTH
+};
+
+constexpr int ITEM_STAT_COUNT = 3;
+
+// Stable reference to a stored item, like EntityHandle for combatants.
+struct ItemHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const ItemHandle& other) const {
+        return slot == other.slot && generation == other.generation;
+    }
+};
+
+// One stored item: which gear it is, plus copies of everything the indexes
+// sort and filter on so queries never touch the Gear itself.
+struct InventoryItem {
+    uint32_t gearId = 0;  // Armory id in the game, catalog id elsewhere
+    GearType type = GearType::SWORD;
+    GearLevel level = GearLevel::NORMAL;
+    int stats[ITEM_STAT_COUNT] = {};
+    uint32_t generation = 0;
+    uint32_t typePosition = 0;   // Where this slot sits in its type bucket
+    uint32_t levelPosition = 0;  // ... and in its level bucket
+    bool live = false;
+
+    int stat(ItemStat which) const { return stats[(int)which]; }
+};
+
+// The dimensional storage device: a pooled store of gear with secondary
+// indexes. Items live in one slot array with a free list, so adding and
+// dropping items reuses memory instead of allocating per item. Type and
+// level buckets are unordered slot lists with back-pointers (O(1) add and
+// remove); each stat has a slot list kept sorted best first (binary search
+// plus a move of 4-byte slots), so "strongest first", "all GOD gear" and
+// "best spear" stay instant with thousands of items. Equipping only moves
+// the equipped marker. Like EntityStore, it allocates from the resource it
+// was made with (a Game's BattleArena, or the heap).
+class Inventory {
+public:
+    using Bucket = std::pmr::vector<uint32_t>;
+
+    explicit Inventory(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : slots(memory), freeSlots(memory), byType{Bucket(memory), Bucket(memory), Bucket(memory)},
+          byLevel{Bucket(memory), Bucket(memory), Bucket(memory)}, byStat{Bucket(memory), Bucket(memory), Bucket(memory)} {
+        static_assert(GEAR_TYPE_COUNT == 3 && GEAR_LEVEL_COUNT == 3 && ITEM_STAT_COUNT == 3,
+                      "one Bucket(memory) per entry above");
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void reserve(size_t items) {
+        slots.reserve(items);
+        for (auto& index : byStat) index.reserve(items);
+    }
+
+    ItemHandle add(uint32_t gearId, const Gear& gear) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = (uint32_t)slots.size();
+            slots.emplace_back();
+        }
+        InventoryItem& item = slots[slot];
+        item.gearId = gearId;
+        item.type = gear.type;
+        item.level = gear.level;
+        item.stats[(int)ItemStat::DAMAGE] = gear.damageBonus;
+        item.stats[(int)ItemStat::ARMOR] = gear.armorBonus;
+        item.stats[(int)ItemStat::HEALTH] = gear.healthBonus;
+        item.live = true;
+
+        auto& typeBucket = byType[(int)item.type];
+        item.typePosition = (uint32_t)typeBucket.size();
+        typeBucket.push_back(slot);
+        auto& levelBucket = byLevel[(int)item.level];
+        item.levelPosition = (uint32_t)levelBucket.size();
+        levelBucket.push_back(slot);
+        for (int s = 0; s < ITEM_STAT_COUNT; s++) {
+            auto& index = byStat[s];
+            index.insert(std::lower_bound(index.begin(), index.end(), slot, statOrder((ItemStat)s)), slot);
+        }
+        count++;
+        return ItemHandle{slot, item.generation};
+    }
+
+    bool contains(ItemHandle handle) const {
+        return handle.slot < slots.size() && slots[handle.slot].live &&
+               slots[handle.slot].generation == handle.generation;
+    }
+
+    const InventoryItem& get(ItemHandle handle) const { return slots[handle.slot]; }
+
+    ItemHandle handleAt(uint32_t slot) const { return ItemHandle{slot, slots[slot].generation}; }
+
+    // Drop an item. The equipped item can't be dropped.
+    bool remove(ItemHandle handle) {
+        if (!contains(handle) || handle == equippedItem) return false;
+        uint32_t slot = handle.slot;
+        InventoryItem& item = slots[slot];
+        unbucket(byType[(int)item.type], item.typePosition, &InventoryItem::typePosition);
+        unbucket(byLevel[(int)item.level], item.levelPosition, &InventoryItem::levelPosition);
+        for (int s = 0; s < ITEM_STAT_COUNT; s++) {
+            auto& index = byStat[s];
+            index.erase(std::lower_bound(index.begin(), index.end(), slot, statOrder((ItemStat)s)));
+        }
+        item.live = false;
+        item.generation++;
+        freeSlots.push_back(slot);
+        count--;
+        return true;
+    }
+
+    // Mark an item as the one being worn; the caller equips its gear.
+    bool setEquipped(ItemHandle handle) {
+        if (!contains(handle)) return false;
+        equippedItem = handle;
+        return true;
+    }
+
+    ItemHandle equipped() const { return equippedItem; }
+    bool isEquipped(ItemHandle handle) const { return contains(handle) && handle == equippedItem; }
+
+    // Slots of every item of a type or level, in no particular order
+    const Bucket& ofType(GearType type) const { return byType[(int)type]; }
+    const Bucket& ofLevel(GearLevel level) const { return byLevel[(int)level]; }
+
+    // Slots of every item, best first by a stat
+    const Bucket& sortedBy(ItemStat stat) const { return byStat[(int)stat]; }
+
+    // Up to `limit` items best first by a stat, optionally only one type
+    // and/or level (pass nullptr to skip a filter).
+    std::vector<ItemHandle> best(ItemStat stat, size_t limit, const GearType* type = nullptr,
+                                 const GearLevel* level = nullptr) const {
+        std::vector<ItemHandle> result;
+        for (uint32_t slot : byStat[(int)stat]) {
+            if (result.size() >= limit) break;
+            const InventoryItem& item = slots[slot];
+            if ((type && item.type != *type) || (level && item.level != *level)) continue;
+            result.push_back(handleAt(slot));
+        }
+        return result;
+    }
+
+    // Every live item's gear id, in slot order (what snapshots store)
+    std::vector<uint32_t> gearIds() const {
+        std::vector<uint32_t> ids;
+        ids.reserve(count);
+        for (const InventoryItem& item : slots) {
+            if (item.live) ids.push_back(item.gearId);
+        }
+        return ids;
+    }
+
+    void clear() {
+        slots.clear();
+        freeSlots.clear();
+        for (auto& bucket : byType) bucket.clear();
+        for (auto& bucket : byLevel) bucket.clear();
+        for (auto& index : byStat) index.clear();
+        equippedItem = ItemHandle{};
+        count = 0;
+    }
+
+private:
+    std::pmr::vector<InventoryItem> slots;
+    Bucket freeSlots;
+    Bucket byType[GEAR_TYPE_COUNT];
+    Bucket byLevel[GEAR_LEVEL_COUNT];
+    Bucket byStat[ITEM_STAT_COUNT];
+    ItemHandle equippedItem;
+    size_t count = 0;
+
+    // Higher stat first, ties by slot, so every item has one exact position
+    struct StatOrder {
+        const std::pmr::vector<InventoryItem>& slots;
+        ItemStat stat;
+        
+        bool operator()(uint32_t a, uint32_t b) const {
+            int x = slots[a].stat(stat), y = slots[b].stat(stat);
+            return x != y ? x > y : a < b;
+        }
+    };
+
+    StatOrder statOrder(ItemStat stat) const { return StatOrder{slots, stat}; }
+
+    void unbucket(Bucket& bucket, uint32_t position, uint32_t InventoryItem::* back) {
+        uint32_t moved = bucket.back();
+        bucket[position] = moved;
+        slots[moved].*back = position;
+        bucket.pop_back();
+    }
+};
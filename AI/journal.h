@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Everything that changes combat state, as one typed record each.
+enum class EventType : uint8_t {
+    BATTLE_START,       // amount/value: low/high 32 bits of the battle seed
+    SPAWN,              // amount: max health, value: current health
+    TURN_START,
+    ATTACK,             // amount: damage before armor
+    DAMAGE,             // amount: damage taken, value: health after
+    DIVINE_PROTECTION,  // Hit blocked by GOD gear
+    DEATH_BLOW,         // source: the dying DEMON, target: its killer
+    POISON_TICK,        // value: poison turns left
+    POISONED,           // value: poison turns
+    RESTRAINED,
+    RESTRAINT_USED,     // Restrained combatant lost its turn
+    HEAL,               // amount: healed, value: health after
+    DEATH,
+    SOUL_GAINED,        // value: souls after
+    WORSHIPPER_GAINED,  // value: worshippers after
+    BATTLE_END,         // value: 1 if the player won
+    EQUIP,              // Gear swapped; amount: max health after, value: health after
+    COUNT
+};
+
+constexpr uint8_t SIDE_PARTY = 0;
+constexpr uint8_t SIDE_ENEMIES = 1;
+constexpr uint32_t NO_ENTITY = UINT32_MAX;
+
+// Entities are identified by side and handle slot, which survive the
+// swap-remove that shuffles dense indices.
+struct CombatEvent {
+    uint32_t turn;
+    EventType type;
+    uint8_t targetSide;
+    uint8_t sourceSide;
+    uint8_t reserved;
+    uint32_t target;
+    uint32_t source;
+    int32_t amount;
+    int32_t value;
+};
+
+static_assert(sizeof(CombatEvent) == 24 && std::is_trivially_copyable_v<CombatEvent>);
+
+// Journal file: this header, then CombatEvents back to back.
+constexpr char JOURNAL_MAGIC[8] = {'T', 'G', 'J', 'R', 'N', 'L', '\0', '\0'};
+constexpr uint32_t JOURNAL_VERSION = 1;
+
+struct JournalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t eventSize;
+};
+
+// Append-only event journal. The game thread copies each event into a
+// ring buffer and moves on; a background thread drains the ring to disk
+// every few milliseconds, or sooner once it is half full. The producer
+// only ever touches the ring and its own counter, so an event costs a
+// 24-byte store and a release add. If the disk falls a full ring behind,
+// the producer waits rather than dropping events. Writes that fail (a
+// full disk) are counted, and close() reports them.
+class Journal {
+public:
+    static constexpr size_t CAPACITY = 1 << 16;  // Events; power of two
+
+    Journal() : ring(new CombatEvent[CAPACITY]) {}
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+        JournalHeader header{};
+        std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+        header.version = JOURNAL_VERSION;
+        header.eventSize = sizeof(CombatEvent);
+        if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+            std::fclose(file);
+            file = nullptr;
+            return false;
+        }
+
+        writeErrors = 0;
+        stopping = false;
+        writer = std::thread([this] { writerLoop(); });
+        return true;
+    }
+
+    // Drains everything still in the ring and closes the file. False if
+    // any write since open() failed, so the file is missing events.
+    bool close() {
+        if (!file) return true;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        writer.join();
+        if (std::fclose(file) != 0) writeErrors++;
+        file = nullptr;
+        return writeErrors == 0;
+    }
+
+    void append(const CombatEvent& event) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - cachedTail >= CAPACITY) {
+            waitForSpace(h);
+        }
+        ring[h & (CAPACITY - 1)] = event;
+        head.store(h + 1, std::memory_order_release);
+        if (((h + 1) & (CAPACITY / 2 - 1)) == 0) {
+            wake();
+        }
+    }
+
+    // Turn stamped on every following event.
+    void setTurn(uint32_t value) { turn = value; }
+    uint32_t getTurn() const { return turn; }
+
+    uint64_t getEventCount() const { return head.load(std::memory_order_relaxed); }
+    uint64_t getStallCount() const { return stalls; }
+    uint64_t getWriteErrors() const { return writeErrors.load(std::memory_order_relaxed); }
+
+private:
+    std::unique_ptr<CombatEvent[]> ring;
+    std::atomic<uint64_t> head{0};  // Written by the game thread only
+    std::atomic<uint64_t> tail{0};  // Written by the writer thread only
+    uint64_t cachedTail = 0;
+    uint64_t stalls = 0;
+    uint32_t turn = 0;
+    std::atomic<uint64_t> writeErrors{0};  // Failed writes and flushes
+
+    std::FILE* file = nullptr;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+    bool wakeRequested = false;
+
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wakeRequested = true;
+        }
+        wakeup.notify_one();
+    }
+
+    void waitForSpace(uint64_t h) {
+        cachedTail = tail.load(std::memory_order_acquire);
+        while (h - cachedTail >= CAPACITY) {
+            stalls++;
+            wake();
+            std::this_thread::yield();
+            cachedTail = tail.load(std::memory_order_acquire);
+        }
+    }
+
+    void writerLoop() {
+        while (true) {
+            bool done;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait_for(lock, std::chrono::milliseconds(5), [this] { return stopping || wakeRequested; });
+                wakeRequested = false;
+                done = stopping;
+            }
+            drain();
+            if (done) break;
+        }
+    }
+
+    void drain() {
+        uint64_t h = head.load(std::memory_order_acquire);
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t == h) return;
+        while (t < h) {
+            size_t start = t & (CAPACITY - 1);
+            size_t count = std::min<uint64_t>(h - t, CAPACITY - start);
+            if (std::fwrite(&ring[start], sizeof(CombatEvent), count, file) != count) writeErrors++;
+            t += count;
+        }
+        tail.store(t, std::memory_order_release);
+        if (std::fflush(file) != 0) writeErrors++;
+    }
+};
+
+// The current thread's journal, or nullptr when journaling is off.
+inline thread_local Journal* combatJournal = nullptr;
+
+// Who an event is about: a side and a handle slot.
+struct JournalRef {
+    uint8_t side = 0;
+    uint32_t slot = NO_ENTITY;
+};
+
+inline void record(EventType type, JournalRef target, JournalRef source = {}, int amount = 0, int value = 0) {
+    Journal* journal = combatJournal;
+    if (!journal) return;
+    journal->append(CombatEvent{journal->getTurn(), type, target.side, source.side, 0,
+                                target.slot, source.slot, amount, value});
+}
+
+// Read side: maps a journal file and serves events straight from the
+// mapping. Battles are located by their BATTLE_START events, turns inside
+// a battle by binary search (turns never go backwards within a battle).
+class JournalReader {
+public:
+    bool open(const std::string& path, std::string& error) {
+        if (!file.open(path, error)) return false;
+        if (file.size() < sizeof(JournalHeader)) {
+            error = path + " is too small to be a journal";
+            return false;
+        }
+        const auto* header = reinterpret_cast<const JournalHeader*>(file.data());
+        if (std::memcmp(header->magic, JOURNAL_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != JOURNAL_VERSION || header->eventSize != sizeof(CombatEvent)) {
+            error = path + " is not a version " + std::to_string(JOURNAL_VERSION) + " journal";
+            return false;
+        }
+        events = reinterpret_cast<const CombatEvent*>(file.data() + sizeof(JournalHeader));
+        count = (file.size() - sizeof(JournalHeader)) / sizeof(CombatEvent);  // Ignores a torn tail
+
+        battleStarts.clear();
+        for (size_t i = 0; i < count; i++) {
+            if (events[i].type == EventType::BATTLE_START) battleStarts.push_back(i);
+        }
+        return true;
+    }
+
+    const CombatEvent* data() const { return events; }
+    size_t size() const { return count; }
+    size_t battleCount() const { return battleStarts.size(); }
+
+    // [begin, end) event range of a battle
+    std::pair<size_t, size_t> battle(size_t index) const {
+        size_t begin = battleStarts[index];
+        size_t end = index + 1 < battleStarts.size() ? battleStarts[index + 1] : count;
+        return {begin, end};
+    }
+
+    // First event of the battle stamped with a turn greater than `turn`
+    size_t endOfTurn(std::pair<size_t, size_t> range, uint32_t turn) const {
+        const CombatEvent* found = std::upper_bound(events + range.first, events + range.second, turn,
+            [](uint32_t t, const CombatEvent& e) { return t < e.turn; });
+        return found - events;
+    }
+
+private:
+    MappedFile file;
+    const CombatEvent* events = nullptr;
+    size_t count = 0;
+    std::vector<size_t> battleStarts;
+};
+
+// Combatant state rebuilt from events alone.
+struct ReplayEntity {
+    uint8_t side = 0;
+    uint32_t slot = 0;
+    int maxHealth = 0;
+    int health = 0;
+    int poisonTurns = 0;
+    int souls = 0;
+    int worshippers = 0;
+    bool restrained = false;
+    bool alive = true;
+};
+
+// Apply events [begin, end) on top of `entities`. Every event carries the
+// resulting value, so this never re-runs a combat rule.
+inline void applyEvents(const CombatEvent* events, size_t begin, size_t end, std::vector<ReplayEntity>& entities) {
+    // (side, slot) -> index in `entities`, UINT32_MAX when none; slots are
+    // handle slots, so they stay small. Anything larger is a damaged journal.
+    constexpr uint32_t SLOT_LIMIT = 1 << 20;
+    std::vector<uint32_t> slotIndex[2];
+    auto indexOf = [&](uint8_t side, uint32_t slot) -> uint32_t& {
+        std::vector<uint32_t>& index = slotIndex[side];
+        if (slot >= index.size()) index.resize(slot + 1, UINT32_MAX);
+        return index[slot];
+    };
+    auto valid = [](uint8_t side, uint32_t slot) { return side <= SIDE_ENEMIES && slot < SLOT_LIMIT; };
+    for (size_t i = 0; i < entities.size(); i++) {
+        if (valid(entities[i].side, entities[i].slot)) indexOf(entities[i].side, entities[i].slot) = (uint32_t)i;
+    }
+    auto find = [&](uint8_t side, uint32_t slot) -> ReplayEntity* {
+        if (!valid(side, slot) || slot >= slotIndex[side].size()) return nullptr;
+        uint32_t index = slotIndex[side][slot];
+        return index == UINT32_MAX ? nullptr : &entities[index];
+    };
+    for (size_t i = begin; i < end; i++) {
+        const CombatEvent& e = events[i];
+        if (e.type == EventType::SPAWN) {
+            if (!valid(e.targetSide, e.target)) continue;
+            ReplayEntity* entity = find(e.targetSide, e.target);
+            if (!entity) {
+                indexOf(e.targetSide, e.target) = (uint32_t)entities.size();
+                entities.push_back(ReplayEntity{});
+                entity = &entities.back();
+            }
+            *entity = ReplayEntity{};
+            entity->side = e.targetSide;
+            entity->slot = e.target;
+            entity->maxHealth = e.amount;
+            entity->health = e.value;
+            continue;
+        }
+        ReplayEntity* entity = find(e.targetSide, e.target);
+        if (!entity) continue;
+        switch(e.type) {
+            case EventType::DAMAGE:
+            case EventType::HEAL: entity->health = e.value; break;
+            case EventType::POISON_TICK:
+            case EventType::POISONED: entity->poisonTurns = e.value; break;
+            case EventType::RESTRAINED: entity->restrained = true; break;
+            case EventType::RESTRAINT_USED: entity->restrained = false; break;
+            case EventType::DEATH: entity->alive = false; break;
+            case EventType::SOUL_GAINED: entity->souls = e.value; break;
+            case EventType::WORSHIPPER_GAINED: entity->worshippers = e.value; break;
+            case EventType::EQUIP:
+                entity->maxHealth = e.amount;
+                entity->health = e.value;
+                break;
+            default: break;
+        }
+    }
+}
+
+inline const char* eventName(EventType type) {
+    static const char* const names[] = {
+        "battle-start", "spawn", "turn-start", "attack", "damage", "divine-protection", "death-blow",
+        "poison-tick", "poisoned", "restrained", "restraint-used", "heal", "death", "soul-gained",
+        "worshipper-gained", "battle-end", "equip",
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)EventType::COUNT);
+    return (size_t)type < (size_t)EventType::COUNT ? names[(size_t)type] : "unknown";
+}
@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "server.h"
+
+using namespace std;
+
+// Load generator for the game server (game --serve). Holds N sessions
+// open at once, each a bot that names itself and then answers "1" to
+// every prompt (first gear, attack, first target), and measures turn
+// latency: from sending an answer to receiving the whole next prompt.
+//
+//   loadgen --connect tcp:4000 [--sessions 10000] [--seconds 10]
+//           [--think MS] [--threads T] [--ramp N]
+//
+// Finished games are replaced by new sessions, so the count stays at N.
+// Latency is only recorded once all N are connected, and --think makes
+// the bots pause like players would; with 0 they answer at once and the
+// run measures the server flat out.
+
+#ifdef SERVER_EPOLL
+
+using Clock = chrono::steady_clock;
+
+struct LoadOptions {
+    string address;
+    uint32_t sessions = 10000;
+    double seconds = 10.0;
+    double thinkMs = 0.0;
+    unsigned threads = 1;
+    uint32_t ramp = 256;  // Connections still waiting for their first prompt, at most
+};
+
+// Shared by the client threads
+struct LoadState {
+    atomic<uint32_t> established{0};  // Session slots that have been connected and prompted
+    atomic<bool> measuring{false};
+    atomic<bool> finished{false};
+};
+
+struct LoadReport {
+    vector<uint32_t> latencyUs;  // One per answered prompt, while measuring
+    uint64_t games = 0;          // Sessions the server ended, while measuring
+    uint64_t errors = 0;         // Failed connects and dropped connections
+};
+
+// One thread's share of the sessions, on its own epoll instance.
+class LoadClient {
+public:
+    LoadClient(const LoadOptions& options, const SocketAddress& address, uint32_t sessions, LoadState& state)
+        : options(options), address(address), state(state), connections(sessions) {}
+
+    LoadReport run() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            report.errors++;
+            return report;
+        }
+        vector<epoll_event> events(256);
+        for (uint32_t i = 0; i < connections.size(); i++) {
+            idle.push_back(i);
+        }
+        auto think = chrono::duration_cast<Clock::duration>(chrono::duration<double, milli>(options.thinkMs));
+        while (!state.finished.load(memory_order_relaxed)) {
+            // One attempt per idle slot per pass at most: a slot that fails
+            // goes to the back of the queue and waits for the next pass.
+            // Running out of descriptors or a full accept queue ends the
+            // pass and holds off connecting for RETRY_DELAY.
+            Clock::time_point now = Clock::now();
+            for (size_t attempts = now >= retryAt ? idle.size() : 0; attempts > 0 && connecting < options.ramp;
+                 attempts--) {
+                uint32_t slot = idle.front();
+                idle.pop_front();
+                if (!open(slot)) {
+                    retryAt = now + RETRY_DELAY;
+                    break;
+                }
+            }
+            now = Clock::now();
+            while (!thinking.empty() && thinking.front().due <= now) {
+                Pending pending = thinking.front();
+                thinking.pop_front();
+                Connection& c = connections[pending.slot];
+                if (c.fd >= 0 && c.generation == pending.generation) answer(pending.slot);
+            }
+            int timeout = 10;
+            if (!thinking.empty()) {
+                auto wait = chrono::duration_cast<chrono::milliseconds>(thinking.front().due - now).count();
+                timeout = (int)std::clamp<long long>(wait, 0, 10);
+            }
+            int count = epoll_wait(epollFd, events.data(), (int)events.size(), timeout);
+            for (int i = 0; i < count; i++) {
+                uint32_t slot = events[i].data.u32;
+                Connection& c = connections[slot];
+                if (c.fd < 0) continue;
+                if (!c.connected) {
+                    int error = 0;
+                    socklen_t length = sizeof(error);
+                    getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                    if (error) {
+                        fail(slot);
+                        continue;
+                    }
+                    c.connected = true;
+                    watch(slot, EPOLLIN, EPOLL_CTL_MOD);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) receive(slot, think);
+            }
+        }
+        for (uint32_t slot = 0; slot < connections.size(); slot++) {
+            if (connections[slot].fd >= 0) ::close(connections[slot].fd);
+        }
+        ::close(epollFd);
+        return report;
+    }
+
+private:
+    struct Connection {
+        int fd = -1;
+        uint32_t generation = 0;
+        bool connected = false;
+        bool up = false;         // This slot has had a session prompted, ever
+        bool prompted = false;   // Seen the first prompt
+        bool answered = false;   // Waiting for the reply to an answer
+        bool askedName = false;  // The last prompt wants a name, not a number
+        Clock::time_point sentAt;
+        string tail;  // The last bytes received, to spot a prompt
+    };
+
+    struct Pending {
+        Clock::time_point due;
+        uint32_t slot;
+        uint32_t generation;
+    };
+
+    static constexpr auto RETRY_DELAY = chrono::milliseconds(10);
+
+    const LoadOptions& options;
+    const SocketAddress& address;
+    LoadState& state;
+    vector<Connection> connections;
+    deque<uint32_t> idle;        // Slots to (re)connect
+    deque<Pending> thinking;     // Answers held back by --think, in due order
+    uint32_t connecting = 0;     // Open but not yet prompted
+    Clock::time_point retryAt;   // No connecting before this
+    int epollFd = -1;
+    LoadReport report;
+
+    void watch(uint32_t slot, uint32_t events, int op) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u32 = slot;
+        epoll_ctl(epollFd, op, connections[slot].fd, &event);
+    }
+
+    // False if no more connections should be tried this pass
+    bool open(uint32_t slot) {
+        Connection& c = connections[slot];
+        c.fd = ::socket(address.tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (c.fd < 0) {
+            report.errors++;
+            idle.push_back(slot);
+            return false;
+        }
+        c.generation++;
+        c.prompted = c.answered = false;
+        c.tail.clear();
+        if (address.tcp) {
+            int on = 1;
+            setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        connecting++;
+        if (::connect(c.fd, address.get(), address.length) == 0) {
+            c.connected = true;
+            watch(slot, EPOLLIN, EPOLL_CTL_ADD);
+        } else if (errno == EINPROGRESS) {
+            c.connected = false;
+            watch(slot, EPOLLOUT, EPOLL_CTL_ADD);
+        } else if (errno == EAGAIN) {
+            close(slot);  // A full accept queue (unix sockets); try again later
+            return false;
+        } else {
+            fail(slot);
+        }
+        return true;
+    }
+
+    void close(uint32_t slot) {
+        Connection& c = connections[slot];
+        ::close(c.fd);
+        c.fd = -1;
+        if (!c.prompted) connecting--;
+        idle.push_back(slot);
+    }
+
+    void fail(uint32_t slot) {
+        report.errors++;
+        close(slot);
+    }
+
+    void receive(uint32_t slot, Clock::duration think) {
+        Connection& c = connections[slot];
+        char buffer[16384];
+        while (true) {
+            ssize_t count = ::recv(c.fd, buffer, sizeof(buffer), 0);
+            if (count > 0) {
+                c.tail.append(buffer, (size_t)count);
+                if (c.tail.size() > 64) c.tail.erase(0, c.tail.size() - 64);
+                continue;
+            }
+            if (count < 0 && errno == EINTR) continue;
+            if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            // The server hung up: game over, or the connection broke
+            if (count == 0 && c.prompted) {
+                if (state.measuring.load(memory_order_relaxed)) report.games++;
+                close(slot);
+            } else {
+                fail(slot);
+            }
+            return;
+        }
+        c.askedName = endsWith(c.tail, "name: ");
+        if (!c.askedName && !endsWith(c.tail, "Choice: ")) return;
+        c.tail.clear();
+        if (!c.prompted) {
+            c.prompted = true;
+            connecting--;
+        }
+        if (!c.up) {
+            c.up = true;
+            uint32_t ready = state.established.fetch_add(1, memory_order_relaxed) + 1;
+            if (ready == options.sessions) state.measuring.store(true, memory_order_release);
+        }
+        if (c.answered) {
+            c.answered = false;
+            if (state.measuring.load(memory_order_relaxed)) {
+                auto us = chrono::duration_cast<chrono::microseconds>(Clock::now() - c.sentAt).count();
+                report.latencyUs.push_back((uint32_t)min<long long>(us, UINT32_MAX));
+            }
+        }
+        if (think.count() > 0) {
+            thinking.push_back(Pending{Clock::now() + think, slot, c.generation});
+        } else {
+            answer(slot);
+        }
+    }
+
+    // A name when asked for one, otherwise "1"
+    void answer(uint32_t slot) {
+        Connection& c = connections[slot];
+        const char* reply = c.askedName ? "Bot\n" : "1\n";
+        size_t length = strlen(reply);
+        c.sentAt = Clock::now();
+        c.answered = true;
+        if (::send(c.fd, reply, length, MSG_NOSIGNAL) != (ssize_t)length) fail(slot);
+    }
+
+    static bool endsWith(const string& text, const char* suffix) {
+        size_t length = strlen(suffix);
+        return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+    }
+};
+
+static double percentile(const vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5));
+    return sorted[index] / 1000.0;
+}
+
+static int runLoad(const LoadOptions& options) {
+    SocketAddress address;
+    string error;
+    if (!address.parse(options.address, error)) {
+        cout << "Cannot connect: " << error << endl;
+        return 1;
+    }
+    raiseDescriptorLimit();
+
+    // One blocking probe, so a missing server is one clear error
+    int probe = ::socket(address.tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0 || ::connect(probe, address.get(), address.length) < 0) {
+        cout << "Cannot connect to " << options.address << ": " << strerror(errno) << endl;
+        if (probe >= 0) ::close(probe);
+        return 1;
+    }
+    ::close(probe);
+
+    LoadState state;
+    unsigned threads = max(1u, min(options.threads, options.sessions));
+    vector<LoadReport> reports(threads);
+    vector<thread> pool;
+    auto started = Clock::now();
+    for (unsigned i = 0; i < threads; i++) {
+        uint32_t share = options.sessions / threads + (i < options.sessions % threads ? 1 : 0);
+        pool.emplace_back([&, i, share] {
+            LoadClient client(options, address, share, state);
+            reports[i] = client.run();
+        });
+    }
+
+    // Ramp up, then measure for --seconds
+    bool established = false;
+    Clock::time_point measureStart;
+    while (true) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+        auto now = Clock::now();
+        if (!established && state.measuring.load(memory_order_acquire)) {
+            established = true;
+            measureStart = now;
+            cerr << "All " << options.sessions << " sessions up after "
+                 << chrono::duration<double>(now - started).count() << " s" << endl;
+        }
+        if (established && now - measureStart >= chrono::duration<double>(options.seconds)) break;
+        if (!established && now - started >= chrono::seconds(60)) break;
+    }
+    double measured = established ? chrono::duration<double>(Clock::now() - measureStart).count() : 0.0;
+    state.finished.store(true);
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    LoadReport total;
+    for (LoadReport& r : reports) {
+        total.latencyUs.insert(total.latencyUs.end(), r.latencyUs.begin(), r.latencyUs.end());
+        total.games += r.games;
+        total.errors += r.errors;
+    }
+    if (!established) {
+        cout << "Only " << state.established.load() << " of " << options.sessions
+             << " sessions came up within 60 s (" << total.errors << " connection errors)" << endl;
+        return 1;
+    }
+    sort(total.latencyUs.begin(), total.latencyUs.end());
+    cout << fixed << setprecision(2);
+    cout << "Sessions:     " << options.sessions << " concurrent on " << threads << " client thread(s), think "
+         << options.thinkMs << " ms\n";
+    cout << "Turns:        " << total.latencyUs.size() << " in " << measured << " s ("
+         << total.latencyUs.size() / measured << " turns/sec), " << total.games << " games finished\n";
+    cout << "Latency:      p50 " << percentile(total.latencyUs, 0.50) << " ms, p99 " << percentile(total.latencyUs, 0.99)
+         << " ms, max " << percentile(total.latencyUs, 1.0) << " ms\n";
+    cout << "Errors:       " << total.errors << endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--connect" && hasValue) {
+            options.address = argv[++i];
+        } else if (arg == "--sessions" && hasValue) {
+            options.sessions = max(1ul, strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--seconds" && hasValue) {
+            options.seconds = atof(argv[++i]);
+        } else if (arg == "--think" && hasValue) {
+            options.thinkMs = atof(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--ramp" && hasValue) {
+            options.ramp = max(1ul, strtoul(argv[++i], nullptr, 10));
+        } else {
+            options.address.clear();
+            break;
+        }
+    }
+    if (options.address.empty()) {
+        cerr << "Usage: " << argv[0] << " --connect unix:PATH|tcp:PORT [--sessions N] [--seconds S]"
+             << " [--think MS] [--threads T] [--ramp N]" << endl;
+        return 1;
+    }
+    return runLoad(options);
+}
+
+#else
+
+int main() {
+    cerr << "loadgen needs epoll (Linux)" << endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,361 @@
+#pragma once
+
+// PvP matches between processes: each player runs a RollbackSession
+// (pvp.h) and a LockstepPeer trades their inputs with everyone else's
+// over UDP on the loopback interface.
+//
+//   LockstepConfig config;
+//   config.players = 2;
+//   config.self = 0;
+//   config.ports = {7001, 7002};
+//   LockstepPeer peer(config);
+//   if (!peer.open(error)) ...
+//   peer.run();  // Until the match is over and everyone has our inputs
+//
+// Every packet repeats this player's inputs from the first one the
+// recipient has not acknowledged, so a lost packet costs nothing but the
+// wait for the next. Each also carries the hash of the sender's latest
+// confirmed frame, which the recipient checks against its own (desyncs).
+//
+// For testing, the link can hold each packet back (delay, jitter) or drop
+// it (loss) before it reaches the socket. Players here are bots
+// (botInput), so a match between peers must end exactly as the same
+// match played offline.
+//
+// POSIX sockets only; LOCKSTEP_UDP is defined where it builds.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "pvp.h"
+#include "rng.h"
+#include "trace.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define LOCKSTEP_UDP 1
+#endif
+
+#ifdef LOCKSTEP_UDP
+
+struct LockstepConfig {
+    int players = 2;
+    int self = 0;
+    std::vector<uint16_t> ports;  // Per player, on 127.0.0.1; our own may be 0 (any free port)
+    uint64_t seed = 1;            // The match's and the bots'
+    int frames = 600;             // Longest the match may run
+    int frameMs = 16;             // Frame clock; 0 = as fast as inputs allow
+    int maxPrediction = 8;        // Frames to run ahead of the slowest player
+    int delayMs = 0;              // Injected one-way latency
+    int jitterMs = 0;             // Plus up to this much more, per packet
+    int lossPercent = 0;          // Packets dropped on the way out
+    int timeoutMs = 5000;         // Give up after this long without progress
+};
+
+// A UDP socket that can hold packets back or drop them on the way out.
+class UdpLink {
+public:
+    UdpLink() = default;
+    UdpLink(const UdpLink&) = delete;
+    UdpLink& operator=(const UdpLink&) = delete;
+
+    ~UdpLink() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool open(uint16_t port, std::string& error) {
+        fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            error = std::string("socket: ") + std::strerror(errno);
+            return false;
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        sockaddr_in address = loopback(port);
+        if (::bind(fd, (const sockaddr*)&address, sizeof(address)) < 0) {
+            error = "bind to port " + std::to_string(port) + ": " + std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // The port actually bound (open(0) picks one)
+    uint16_t localPort() const {
+        sockaddr_in address{};
+        socklen_t length = sizeof(address);
+        ::getsockname(fd, (sockaddr*)&address, &length);
+        return ntohs(address.sin_port);
+    }
+
+    int descriptor() const { return fd; }
+
+    void impair(int delay, int jitter, int lossPercent, uint64_t seed) {
+        delayMs = std::max(0, delay);
+        jitterMs = std::max(0, jitter);
+        loss = std::clamp(lossPercent, 0, 100);
+        rng = Rng(seed, 2);
+    }
+
+    void send(uint16_t port, const void* data, size_t size, int64_t nowMs) {
+        if (loss > 0 && rng.chance(loss)) return;
+        int64_t due = nowMs + delayMs + (jitterMs ? rng.roll(0, jitterMs) : 0);
+        const uint8_t* bytes = (const uint8_t*)data;
+        queue.push_back(Pending{due, port, std::vector<uint8_t>(bytes, bytes + size)});
+        flush(nowMs);
+    }
+
+    // Put every held packet that is due on the wire
+    void flush(int64_t nowMs) {
+        size_t kept = 0;
+        for (size_t i = 0; i < queue.size(); i++) {
+            if (queue[i].due <= nowMs) {
+                sockaddr_in address = loopback(queue[i].port);
+                ::sendto(fd, queue[i].bytes.data(), queue[i].bytes.size(), 0, (const sockaddr*)&address,
+                         sizeof(address));
+            } else {
+                if (kept != i) queue[kept] = std::move(queue[i]);
+                kept++;
+            }
+        }
+        queue.resize(kept);
+    }
+
+    // Next packet, if any; its size, or -1 for none
+    int receive(void* buffer, size_t size) {
+        while (true) {
+            ssize_t got = ::recv(fd, buffer, size, 0);
+            if (got >= 0) return (int)got;
+            if (errno != EINTR) return -1;
+        }
+    }
+
+private:
+    struct Pending {
+        int64_t due;
+        uint16_t port;
+        std::vector<uint8_t> bytes;
+    };
+
+    int fd = -1;
+    int delayMs = 0;
+    int jitterMs = 0;
+    int loss = 0;
+    Rng rng;
+    std::vector<Pending> queue;
+
+    static sockaddr_in loopback(uint16_t port) {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return address;
+    }
+};
+
+// One player's end of a match, as described at the top of the file.
+// Drive it with run(), or call poll() from a loop of your own (tests run
+// every player of a match from one thread that way).
+class LockstepPeer {
+public:
+    static constexpr int MAX_INPUTS = 64;  // Per packet
+    static constexpr int LINGER_MS = 1000;  // After the end, for late acks
+
+    explicit LockstepPeer(const LockstepConfig& lockstep)
+        : config(lockstep),
+          session(PvpMatch(lockstep.players, lockstep.seed, lockstep.frames), lockstep.self, lockstep.maxPrediction) {
+        config.players = session.state().players();
+        config.ports.resize(config.players, 0);
+        acked.assign(config.players, -1);
+        checks.assign(config.players, Check{});
+    }
+
+    bool open(std::string& error) {
+        if (config.self < 0 || config.self >= config.players) {
+            error = "player " + std::to_string(config.self) + " is not in a match of " + std::to_string(config.players);
+            return false;
+        }
+        if (!link.open(config.ports[config.self], error)) return false;
+        config.ports[config.self] = link.localPort();
+        link.impair(config.delayMs, config.jitterMs, config.lossPercent, deriveSeed(config.seed, config.self));
+        return true;
+    }
+
+    uint16_t localPort() const { return config.ports[config.self]; }
+    void setPort(int player, uint16_t port) { config.ports[player] = port; }
+    int descriptor() const { return link.descriptor(); }
+
+    const RollbackSession& getSession() const { return session; }
+
+    // Read what has arrived, play what the frame clock and the inputs
+    // allow, and send. Never blocks.
+    void poll(int64_t nowMs) {
+        TRACE_ZONE("lockstep poll");
+        if (startMs < 0) {
+            startMs = nowMs;
+            progressMs = nowMs;
+        }
+        receive();
+
+        int64_t due = config.frameMs > 0 ? (nowMs - startMs) / config.frameMs : INT32_MAX;
+        bool sent = false;
+        while (!session.state().over() && session.getFrame() <= due) {
+            if (session.nextLocalFrame() == session.getFrame()) {
+                int frame = session.nextLocalFrame();
+                session.addLocalInput(botInput(config.seed, config.self, config.players, frame));
+                sendAll(nowMs);
+                sent = true;
+            }
+            if (!session.canAdvance()) {
+                if (session.atPredictionLimit() && stalledAt != session.getFrame()) {
+                    stalledAt = session.getFrame();
+                    session.countStall();
+                }
+                break;
+            }
+            session.advance();
+            progressMs = nowMs;
+        }
+        session.settle();
+        checkHashes();
+        if (session.finished() && endMs < 0) endMs = nowMs;
+
+        if (!sent && nowMs - lastSendMs >= std::max(1, config.frameMs / 2)) sendAll(nowMs);
+        link.flush(nowMs);
+    }
+
+    // The match is over here and every other player has all our inputs
+    // (or has stopped acknowledging them)
+    bool done(int64_t nowMs) const {
+        if (!session.finished()) return false;
+        bool everyone = true;
+        for (int p = 0; p < config.players; p++) {
+            if (p != config.self && acked[p] < session.getFinalFrame()) everyone = false;
+        }
+        return everyone || nowMs - endMs >= LINGER_MS;
+    }
+
+    // No frame confirmed for timeoutMs
+    bool timedOut(int64_t nowMs) const { return !session.finished() && nowMs - progressMs >= config.timeoutMs; }
+
+    // Play the match out. False if the other players went quiet.
+    bool run() {
+        while (true) {
+            int64_t now = clockMs();
+            poll(now);
+            if (done(now)) return true;
+            if (timedOut(now)) return false;
+            pollfd ready{link.descriptor(), POLLIN, 0};
+            ::poll(&ready, 1, 1);
+        }
+    }
+
+    static int64_t clockMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    // Byte order is the host's: both ends are on the same machine.
+    struct Header {
+        uint32_t magic;
+        uint8_t sender;
+        uint8_t count;       // Inputs following the header
+        uint16_t players;
+        int32_t firstFrame;  // Of the first input
+        int32_t ack;         // Latest frame of the recipient's inputs the sender has, with all before it
+        int32_t checkFrame;  // Latest frame the sender has confirmed, -1 for none
+        uint64_t checkHash;  // The state after it
+    };
+    static constexpr uint32_t MAGIC = 0x50765031;  // "PvP1"
+
+    struct Check {
+        int frame = -1;
+        uint64_t hash = 0;
+    };
+
+    LockstepConfig config;
+    RollbackSession session;
+    UdpLink link;
+    std::vector<int> acked;     // Per player: our latest input they have, with all before it
+    std::vector<Check> checks;  // Per player: their latest confirmed hash, not yet compared
+    int64_t startMs = -1;
+    int64_t progressMs = 0;
+    int64_t lastSendMs = -1;
+    int64_t endMs = -1;
+    int stalledAt = -1;
+
+    void receive() {
+        uint8_t buffer[sizeof(Header) + MAX_INPUTS * sizeof(uint16_t)];
+        int size;
+        while ((size = link.receive(buffer, sizeof(buffer))) >= 0) {
+            Header header;
+            if (size < (int)sizeof(Header)) continue;
+            std::memcpy(&header, buffer, sizeof(Header));
+            int sender = header.sender;
+            if (header.magic != MAGIC || header.players != config.players || sender >= config.players ||
+                sender == config.self || header.count > MAX_INPUTS ||
+                size < (int)(sizeof(Header) + header.count * sizeof(uint16_t))) {
+                continue;
+            }
+            for (int i = 0; i < header.count; i++) {
+                uint16_t bits;
+                std::memcpy(&bits, buffer + sizeof(Header) + i * sizeof(uint16_t), sizeof(bits));
+                session.addRemoteInput(sender, header.firstFrame + i, PvpInput::unpack(bits));
+            }
+            acked[sender] = std::max(acked[sender], (int)header.ack);
+            if (header.checkFrame > checks[sender].frame) checks[sender] = Check{header.checkFrame, header.checkHash};
+        }
+    }
+
+    // Compare each player's latest hash once we have confirmed that frame too
+    void checkHashes() {
+        for (Check& check : checks) {
+            if (check.frame >= 0 && check.frame <= session.hashedFrame()) {
+                session.checkRemoteHash(check.frame, check.hash);
+                check.frame = -1;
+            }
+        }
+    }
+
+    void sendAll(int64_t nowMs) {
+        lastSendMs = nowMs;
+        for (int p = 0; p < config.players; p++) {
+            if (p != config.self && config.ports[p] != 0) sendTo(p, nowMs);
+        }
+    }
+
+    void sendTo(int player, int64_t nowMs) {
+        uint8_t buffer[sizeof(Header) + MAX_INPUTS * sizeof(uint16_t)];
+        Header header{};
+        header.magic = MAGIC;
+        header.sender = (uint8_t)config.self;
+        header.players = (uint16_t)config.players;
+        header.firstFrame = acked[player] + 1;
+        header.ack = session.confirmedThrough(player);
+        header.checkFrame = session.hashedFrame();
+        uint64_t hash = 0;
+        if (!session.confirmedHash(header.checkFrame, hash)) header.checkFrame = -1;
+        header.checkHash = hash;
+        int count = 0;
+        PvpInput input;
+        while (count < MAX_INPUTS && session.inputAt(config.self, header.firstFrame + count, input)) {
+            uint16_t bits = input.pack();
+            std::memcpy(buffer + sizeof(Header) + count * sizeof(uint16_t), &bits, sizeof(bits));
+            count++;
+        }
+        header.count = (uint8_t)count;
+        std::memcpy(buffer, &header, sizeof(Header));
+        link.send(config.ports[player], buffer, sizeof(Header) + count * sizeof(uint16_t), nowMs);
+    }
+};
+
+#endif  // LOCKSTEP_UDP
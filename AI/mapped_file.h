@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_POSIX 1
+#endif
+
+// A whole file as read-only memory. On POSIX the file is memory-mapped, so
+// opening costs no reads and pages come in as they are touched; elsewhere
+// it falls back to reading the file into a buffer.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    ~MappedFile() {
+        close();
+    }
+    
+    bool open(const std::string& path, std::string& error) {
+        close();
+#ifdef MAPPED_FILE_POSIX
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "cannot open " + path;
+            return false;
+        }
+        struct stat info{};
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            error = "cannot stat " + path;
+            return false;
+        }
+        length = (size_t)info.st_size;
+        if (length > 0) {
+            void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                error = "cannot map " + path;
+                length = 0;
+                return false;
+            }
+            mapped = data;
+            base = static_cast<const char*>(data);
+        }
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            error = "cannot open " + path;
+            return false;
+        }
+        copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        base = copy.data();
+        length = copy.size();
+#endif
+        return true;
+    }
+    
+    void close() {
+#ifdef MAPPED_FILE_POSIX
+        if (mapped) munmap(mapped, length);
+#endif
+        mapped = nullptr;
+        base = nullptr;
+        length = 0;
+        copy.clear();
+    }
+    
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+    
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+    void* mapped = nullptr;
+    std::vector<char> copy;
+};
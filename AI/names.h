@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+// Interned strings for the names of combatants and gear. Every distinct
+// name is stored once, for the rest of the program, so a Name is just a
+// view of that copy: rows, gear and store copies (search rollouts) pass
+// names around without allocating or copying characters.
+//
+// Nothing is ever freed, so only intern a closed set of names: enemy kinds
+// and gear from the code or a catalog. Text from outside (a player's name,
+// a snapshot) goes through Name::owned instead.
+//
+// Interning goes through a per-thread cache first, so simulation threads
+// making the same enemies battle after battle don't contend on the lock.
+class NameTable {
+public:
+    static NameTable& instance() {
+        static NameTable table;
+        return table;
+    }
+
+    std::string_view intern(std::string_view text) {
+        thread_local std::unordered_map<std::string_view, std::string_view> cache;
+        auto cached = cache.find(text);
+        if (cached != cache.end()) return cached->second;
+
+        std::string_view stored;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = index.find(text);
+            if (found == index.end()) {
+                found = index.insert(strings.emplace_back(text)).first;
+            }
+            stored = *found;
+        }
+        cache.emplace(stored, stored);
+        return stored;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return strings.size();
+    }
+
+private:
+    std::mutex mutex;
+    std::deque<std::string> strings;  // Never moves an element, so views stay valid
+    std::unordered_set<std::string_view> index;
+};
+
+// A name from the NameTable, or an owned copy of free-form text. Converts
+// to std::string_view wherever text is wanted. Constructing one interns the
+// text, so make Names once and copy them, rather than building them from
+// strings in a hot loop. An owned name is shared by its copies and freed
+// with the last of them.
+class Name {
+public:
+    Name() = default;
+    Name(std::string_view text) : text(NameTable::instance().intern(text)) {}
+    Name(const char* text) : Name(std::string_view(text)) {}
+    Name(const std::string& text) : Name(std::string_view(text)) {}
+
+    static Name owned(std::string_view text) {
+        Name name;
+        name.storage = std::make_shared<const std::string>(text);
+        name.text = *name.storage;
+        return name;
+    }
+
+    operator std::string_view() const { return text; }
+    std::string_view view() const { return text; }
+    std::string str() const { return std::string(text); }
+    const char* data() const { return text.data(); }
+    size_t size() const { return text.size(); }
+    bool empty() const { return text.empty(); }
+
+    bool operator==(const Name& other) const { return text == other.text; }
+
+private:
+    std::string_view text;
+    std::shared_ptr<const std::string> storage;  // Only for owned names
+};
+
+inline std::ostream& operator<<(std::ostream& out, const Name& name) {
+    return out << name.view();
+}
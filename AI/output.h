@@ -0,0 +1,106 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "trace.h"
+
+// Colors game text can ask for. Renderers turn these into whatever the
+// terminal needs; nothing else in the game writes escape codes.
+enum class Color : uint8_t {
+    DEFAULT,
+    RED,
+    GREEN,
+    YELLOW,
+    MAGENTA
+};
+
+// A run of text in one color, for use inside say().
+struct Colored {
+    std::string_view text;
+    Color color;
+};
+
+// One line of game text with a color per character.
+struct Line {
+    std::string text;
+    std::vector<Color> colors;
+    
+    void append(std::string_view s, Color color = Color::DEFAULT) {
+        text += s;
+        colors.insert(colors.end(), s.size(), color);
+    }
+    
+    void append(const Line& other) {
+        text += other.text;
+        colors.insert(colors.end(), other.colors.begin(), other.colors.end());
+    }
+};
+
+// Where game text goes. Game code only appends lines and asks questions;
+// when and how that reaches the terminal is up to the renderer.
+class Renderer {
+public:
+    virtual ~Renderer() = default;
+    
+    // Append to the combat log. A '\n' inside the text starts a new line.
+    virtual void write(const Line& line) = 0;
+    
+    // Replace the persistent status panel, for renderers that have one.
+    virtual void setStatus(std::vector<Line> panel) { (void)panel; }
+    
+    // Show a menu and a question, and make sure all of it is on screen
+    // before the caller blocks reading the answer.
+    virtual void prompt(const std::vector<Line>& menu, std::string_view question) = 0;
+    
+    // End of a frame: push everything pending to the terminal.
+    virtual void present() = 0;
+};
+
+// The current thread's renderer. nullptr is the null sink: say() returns
+// before formatting anything, so headless simulation pays nothing for text.
+inline thread_local Renderer* gameOut = nullptr;
+
+inline void appendArg(Line& line, std::string_view text) { line.append(text); }
+inline void appendArg(Line& line, const Colored& colored) { line.append(colored.text, colored.color); }
+inline void appendArg(Line& line, const Line& other) { line.append(other); }
+inline void appendArg(Line& line, char c) { line.append(std::string_view(&c, 1)); }
+
+template <typename T>
+    requires std::is_integral_v<T>
+void appendArg(Line& line, T value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    line.append(std::string_view(buffer, result.ptr - buffer));
+}
+
+// Build one line of game text from its pieces and hand it to the renderer,
+// or do nothing at all when the thread is quiet.
+template <typename... Args>
+void say(const Args&... args) {
+    if (!gameOut) return;
+    TRACE_ZONE("output");
+    Line line;
+    (appendArg(line, args), ...);
+    gameOut->write(line);
+}
+
+// Same, but builds the line without writing it (menus, status panels).
+template <typename... Args>
+Line makeLine(const Args&... args) {
+    Line line;
+    (appendArg(line, args), ...);
+    return line;
+}
+
+// A whole line in one color.
+template <typename... Args>
+Line makeColoredLine(Color color, const Args&... args) {
+    Line line = makeLine(args...);
+    line.colors.assign(line.text.size(), color);
+    return line;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "abilities.h"
+#include "game.h"
+#include "rng.h"
+
+// Picks uniformly among attack, heal and every ability, at a random enemy.
+class RandomPolicy : public PlayerPolicy {
+public:
+    explicit RandomPolicy(uint64_t seed) : rng(seed, 3) {}
+    
+    PlayerAction chooseAction(const Game& game) override {
+        PlayerAction action;
+        const Gear* gear = game.getParty().gearAt(game.getPlayerIndex());
+        int abilityCount = gear ? gear->abilities.size() : 0;
+        int pick = rng.roll(0, 1 + abilityCount);
+        
+        if (pick == 0) {
+            action.type = ActionType::ATTACK;
+        } else if (pick == 1) {
+            action.type = ActionType::HEAL;
+        } else {
+            action.type = ActionType::ABILITY;
+            action.ability = gear->abilities.at(pick - 2);
+        }
+        int enemyCount = (int)game.getEnemies().size();
+        action.target = rng.roll(0, std::max(0, enemyCount - 1));
+        return action;
+    }
+    
+private:
+    Rng rng;
+};
+
+// Plays the way a sensible human would: heal when low, use the gear's
+// strongest ability when it pays off, otherwise hit the weakest enemy.
+class GreedyPolicy : public PlayerPolicy {
+public:
+    PlayerAction chooseAction(const Game& game) override {
+        const EntityStore& party = game.getParty();
+        const EntityStore& enemies = game.getEnemies();
+        uint32_t self = game.getPlayerIndex();
+        PlayerAction action;
+        
+        if (party.currentHealth[self] * 100 < party.maxHealth[self] * 35) {
+            action.type = ActionType::HEAL;
+            return action;
+        }
+        
+        int weakest = 0;
+        for (uint32_t i = 1; i < enemies.size(); i++) {
+            if (enemies.currentHealth[i] < enemies.currentHealth[weakest]) {
+                weakest = (int)i;
+            }
+        }
+        action.target = weakest;
+        action.type = ActionType::ATTACK;
+        
+        const Gear* gear = party.gearAt(self);
+        if (!gear) return action;
+        
+        if (enemies.size() >= 2 && gear->abilities.has(AbilityId::MULTI_ATTACK)) {
+            useAbility(AbilityId::MULTI_ATTACK, action);
+        } else if (gear->abilities.has(AbilityId::HOLY_TAKEDOWN)) {
+            useAbility(AbilityId::HOLY_TAKEDOWN, action);
+        }
+        return action;
+    }
+    
+private:
+    static void useAbility(AbilityId id, PlayerAction& action) {
+        action.type = ActionType::ABILITY;
+        action.ability = id;
+    }
+};
+
+inline std::unique_ptr<PlayerPolicy> makePolicy(const std::string& name, uint64_t seed) {
+    if (name == "random") {
+        return std::make_unique<RandomPolicy>(seed);
+    }
+    return std::make_unique<GreedyPolicy>();
+}
@@ -0,0 +1,168 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lockstep.h"
+
+using namespace std;
+
+// A PvP match between bots in lockstep with rollback, over UDP on the
+// loopback interface, with latency and loss injected on every link.
+//
+//   pvp [--players N] [--frames F] [--frame-ms MS] [--prediction P]
+//       [--delay MS] [--jitter MS] [--loss PCT] [--seed S]
+//   pvp --self K --ports P0,P1,... [same options]
+//
+// Without --self, every player runs in this process on ports of its own
+// choosing, polled in turn from one thread. With --self, this process is
+// player K only and the others are separate processes (start one per
+// player, all with the same options but --self). Either way each player
+// reports its rollbacks and what re-simulating cost it, and the run fails
+// on a desync or if a player's result differs from the same match played
+// offline.
+
+#ifdef LOCKSTEP_UDP
+
+struct PvpOptions {
+    LockstepConfig config;
+    bool local = true;
+};
+
+static void report(const LockstepPeer& peer, const PvpMatch& expected) {
+    const RollbackSession& session = peer.getSession();
+    cout << "Player " << session.self() + 1 << ":\n";
+    session.stats().print(cout);
+    cout << "Result:       ";
+    if (!session.finished()) {
+        cout << "unfinished\n";
+        return;
+    }
+    cout << (session.getWinner() < 0 ? string("draw") : "Player " + to_string(session.getWinner() + 1) + " wins")
+         << " after " << session.getFinalFrame() + 1 << " frames, hash " << hex << session.getFinalHash() << dec
+         << (session.getFinalHash() == expected.stateHash() ? " (matches offline)" : " (OFFLINE DIFFERS)") << "\n";
+}
+
+static bool agrees(const LockstepPeer& peer, const PvpMatch& expected) {
+    const RollbackSession& session = peer.getSession();
+    return session.finished() && session.stats().desyncs == 0 && session.getFinalHash() == expected.stateHash();
+}
+
+static int runLocal(const PvpOptions& options) {
+    vector<unique_ptr<LockstepPeer>> peers;
+    for (int p = 0; p < options.config.players; p++) {
+        LockstepConfig config = options.config;
+        config.self = p;
+        config.ports.assign(config.players, 0);
+        peers.push_back(make_unique<LockstepPeer>(config));
+        string error;
+        if (!peers.back()->open(error)) {
+            cerr << error << endl;
+            return 1;
+        }
+    }
+    for (auto& peer : peers) {
+        for (int p = 0; p < (int)peers.size(); p++) peer->setPort(p, peers[p]->localPort());
+    }
+
+    PvpMatch expected = playBots(options.config.players, options.config.seed, options.config.frames);
+    vector<bool> done(peers.size(), false);
+    size_t remaining = peers.size();
+    bool lost = false;
+    while (remaining > 0 && !lost) {
+        int64_t now = LockstepPeer::clockMs();
+        for (size_t p = 0; p < peers.size(); p++) {
+            if (done[p]) continue;
+            peers[p]->poll(now);
+            if (peers[p]->done(now)) {
+                done[p] = true;
+                remaining--;
+            } else if (peers[p]->timedOut(now)) {
+                lost = true;
+            }
+        }
+        this_thread::sleep_for(chrono::microseconds(200));
+    }
+
+    bool ok = !lost;
+    for (auto& peer : peers) {
+        report(*peer, expected);
+        ok = ok && agrees(*peer, expected);
+    }
+    if (lost) cerr << "Timed out waiting for inputs" << endl;
+    return ok ? 0 : 1;
+}
+
+static int runPeer(const PvpOptions& options) {
+    LockstepPeer peer(options.config);
+    string error;
+    if (!peer.open(error)) {
+        cerr << error << endl;
+        return 1;
+    }
+    bool finished = peer.run();
+    PvpMatch expected = playBots(options.config.players, options.config.seed, options.config.frames);
+    report(peer, expected);
+    if (!finished) cerr << "Timed out waiting for inputs" << endl;
+    return finished && agrees(peer, expected) ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    PvpOptions options;
+    LockstepConfig& config = options.config;
+    bool valid = true;
+    for (int i = 1; i < argc && valid; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--players" && hasValue) {
+            config.players = atoi(argv[++i]);
+        } else if (arg == "--self" && hasValue) {
+            config.self = atoi(argv[++i]);
+            options.local = false;
+        } else if (arg == "--ports" && hasValue) {
+            config.ports.clear();
+            stringstream list(argv[++i]);
+            string port;
+            while (getline(list, port, ',')) config.ports.push_back((uint16_t)strtoul(port.c_str(), nullptr, 10));
+        } else if (arg == "--frames" && hasValue) {
+            config.frames = max(1, atoi(argv[++i]));
+        } else if (arg == "--frame-ms" && hasValue) {
+            config.frameMs = max(0, atoi(argv[++i]));
+        } else if (arg == "--prediction" && hasValue) {
+            config.maxPrediction = max(0, atoi(argv[++i]));
+        } else if (arg == "--delay" && hasValue) {
+            config.delayMs = atoi(argv[++i]);
+        } else if (arg == "--jitter" && hasValue) {
+            config.jitterMs = atoi(argv[++i]);
+        } else if (arg == "--loss" && hasValue) {
+            config.lossPercent = atoi(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            config.seed = strtoull(argv[++i], nullptr, 10);
+        } else {
+            valid = false;
+        }
+    }
+    config.players = clamp(config.players, 2, PvpMatch::MAX_PLAYERS);
+    if (!options.local && (int)config.ports.size() != config.players) valid = false;
+    if (!valid) {
+        cerr << "Usage: " << argv[0] << " [--self K --ports P0,P1,...] [--players N] [--frames F] [--frame-ms MS]"
+             << " [--prediction P] [--delay MS] [--jitter MS] [--loss PCT] [--seed S]" << endl;
+        return 1;
+    }
+    return options.local ? runLocal(options) : runPeer(options);
+}
+
+#else
+
+int main() {
+    cerr << "pvp needs POSIX sockets" << endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,430 @@
+#pragma once
+
+// Player against player: any number of heroes in one free-for-all, each
+// driven by its own client. Every client runs the same PvpMatch and only
+// inputs travel between them (deterministic lockstep), so the match must
+// be a pure function of its seed and the inputs: integer rules, seeded
+// dice, nothing read from the clock or the machine.
+//
+// RollbackSession hides the wait for other players' inputs. It simulates
+// ahead on predicted inputs (each player repeats their last known move),
+// keeps a snapshot of the match at the start of every frame it may still
+// have to revisit, and when a real input turns out to differ from the
+// prediction it restores that frame's snapshot and simulates forward
+// again. A snapshot is a plain copy of the match: one small EntityStore
+// and its status effects.
+//
+// lockstep.h carries sessions over UDP; the session itself never touches
+// a socket, so tests can feed it inputs directly.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "character.h"
+#include "entity_store.h"
+#include "fixed_point.h"
+#include "game.h"
+#include "journal.h"
+#include "output.h"
+#include "rng.h"
+#include "status_effects.h"
+#include "trace.h"
+
+enum class PvpMove : uint8_t {
+    SKIP,
+    ATTACK,
+    SPECIAL,  // DEMON gear poisons, GOD gear restrains, anything else hits harder
+    HEAL
+};
+
+// One player's input for one frame. Two bytes on the wire.
+struct PvpInput {
+    PvpMove move = PvpMove::SKIP;
+    uint8_t target = 0;  // Player number
+
+    uint16_t pack() const { return (uint16_t)((uint16_t)move << 8 | target); }
+    static PvpInput unpack(uint16_t bits) { return PvpInput{(PvpMove)(bits >> 8), (uint8_t)bits}; }
+
+    bool operator==(const PvpInput&) const = default;
+};
+
+// A scripted player: its input for a frame depends only on the seed, the
+// player and the frame, never on what it has seen, so a match between
+// bots replays exactly. Like a player holding a button, it keeps each
+// input for a few frames before choosing another.
+inline PvpInput botInput(uint64_t seed, int player, int players, int frame) {
+    constexpr int HOLD_FRAMES = 6;
+    Rng rng(deriveSeed(seed, (uint64_t)player), (uint64_t)(frame / HOLD_FRAMES));
+    PvpInput input;
+    int roll = rng.roll(1, 20);
+    input.move = roll <= 12 ? PvpMove::ATTACK : roll <= 16 ? PvpMove::SPECIAL : roll <= 19 ? PvpMove::HEAL : PvpMove::SKIP;
+    int other = rng.roll(0, std::max(0, players - 2));
+    input.target = (uint8_t)(other >= player ? other + 1 : other);
+    return input;
+}
+
+// The free-for-all itself. Player p is row p of the store for the whole
+// match; the dead stay (at zero health or below) so numbers never move.
+class PvpMatch {
+public:
+    static constexpr int MAX_PLAYERS = 8;
+    static constexpr int COOLDOWN_FRAMES = 8;  // Between one player's actions
+
+    PvpMatch() = default;
+
+    // Player p starts with the starting gear numbered 1 + p % 3
+    PvpMatch(int players, uint64_t seed, int frameLimit) : limit(frameLimit) {
+        fighters.side = SIDE_PARTY;
+        fighters.rng = Rng(seed, 1);
+        players = std::clamp(players, 2, MAX_PLAYERS);
+        fighters.reserve(players);
+        for (int p = 0; p < players; p++) {
+            fighters.create("Player " + std::to_string(p + 1), 1000, 20, 5);
+            Character(fighters, p).equipGear(Game::makeStartingGear(1 + p % 3));
+        }
+        effects.clear(0);
+    }
+
+    int players() const { return (int)fighters.size(); }
+    int getFrame() const { return frame; }
+    const EntityStore& getFighters() const { return fighters; }
+
+    int alive() const {
+        int count = 0;
+        for (int health : fighters.currentHealth) count += health > 0;
+        return count;
+    }
+
+    bool over() const { return frame >= limit || alive() <= 1; }
+
+    // The last one standing, or -1 for none (yet) or a draw
+    int winner() const {
+        if (alive() != 1) return -1;
+        for (int p = 0; p < players(); p++) {
+            if (fighters.currentHealth[p] > 0) return p;
+        }
+        return -1;
+    }
+
+    // Equal matches hash equal: the rows, the frame and the dice position
+    uint64_t stateHash() const {
+        uint64_t hash = fighters.stateHash() ^ deriveSeed((uint64_t)frame, fighters.rng.getCounter());
+        for (int p = 0; p < players(); p++) {
+            hash = mix64(hash + (uint64_t)readyAt[p]);
+        }
+        return hash;
+    }
+
+    // One frame: statuses tick, then everyone off cooldown acts on their
+    // input, in an order that rotates each frame so nobody always strikes
+    // first. Silent, since a predicted frame may be played again.
+    void step(const PvpInput* inputs) {
+        static const EntityStore nobody;
+        Renderer* out = std::exchange(gameOut, nullptr);
+        Journal* journal = std::exchange(combatJournal, nullptr);
+        for (const StatusTick& due : effects.dueAt(frame, fighters, nobody)) {
+            int damage = statusInfo(due.id).tickDamage * due.stacks;
+            if (damage > 0) Character(fighters, due.index).takeDamage(damage);
+            effects.tick(fighters, due, frame);
+        }
+        int n = players();
+        for (int k = 0; k < n; k++) {
+            int p = (frame + k) % n;
+            act(p, inputs[p]);
+        }
+        frame++;
+        gameOut = out;
+        combatJournal = journal;
+    }
+
+private:
+    EntityStore fighters;
+    StatusEffects effects;
+    int frame = 0;
+    int limit = 0;
+    std::array<int, MAX_PLAYERS> readyAt{};  // Frame each player may next act on
+
+    // Acting, or losing the turn to a status, starts the cooldown
+    void act(int p, const PvpInput& input) {
+        Character self(fighters, (uint32_t)p);
+        if (!self.isAlive() || frame < readyAt[p] || input.move == PvpMove::SKIP) return;
+        readyAt[p] = frame + COOLDOWN_FRAMES;
+        if (effects.skipTurn(fighters, (uint32_t)p)) return;
+        if (input.move == PvpMove::HEAL) {
+            self.heal(10);
+            return;
+        }
+        int t = input.target;
+        if (t >= players() || t == p || fighters.currentHealth[t] <= 0) return;
+        Character target(fighters, (uint32_t)t);
+        if (input.move == PvpMove::ATTACK) {
+            self.strike(target, self.getTotalDamage());
+        } else if (self.gearLevel() == GearLevel::DEMON) {
+            effects.apply(fighters, (uint32_t)t, StatusId::POISON, 3, frame);
+        } else if (self.gearLevel() == GearLevel::GOD) {
+            effects.apply(fighters, (uint32_t)t, StatusId::RESTRAIN, 1, frame);
+        } else {
+            self.strike(target, DarkEnergyDamage::scale(self.getTotalDamage()));
+        }
+    }
+};
+
+// A match between bots played straight through, as one machine would
+// with every input in hand: what any lockstep run of it must end at.
+inline PvpMatch playBots(int players, uint64_t seed, int frameLimit) {
+    PvpMatch match(players, seed, frameLimit);
+    std::array<PvpInput, PvpMatch::MAX_PLAYERS> inputs{};
+    while (!match.over()) {
+        for (int p = 0; p < match.players(); p++) {
+            inputs[p] = botInput(seed, p, match.players(), match.getFrame());
+        }
+        match.step(inputs.data());
+    }
+    return match;
+}
+
+// What rolling back cost, for tuning delay against prediction.
+struct RollbackStats {
+    uint64_t frames = 0;             // Simulated the first time
+    uint64_t rollbacks = 0;
+    uint64_t resimulatedFrames = 0;  // Simulated again after a rollback
+    uint64_t resimulationNs = 0;     // Restoring and re-simulating, all told
+    int deepestRollback = 0;         // Frames
+    uint64_t stalls = 0;             // Waits for inputs at the prediction limit
+    uint64_t desyncs = 0;            // Confirmed frames another client hashed differently
+
+    double rollbackRate() const { return frames ? (double)rollbacks / frames : 0.0; }
+    double resimulationNsPerFrame() const { return frames ? (double)resimulationNs / frames : 0.0; }
+
+    void print(std::ostream& out) const {
+        out << std::fixed << std::setprecision(2);
+        out << "Rollbacks:    " << rollbacks << " in " << frames << " frames (" << rollbackRate() * 100
+            << "%), deepest " << deepestRollback << " frame(s)\n";
+        out << "Re-simulated: " << resimulatedFrames << " frame(s), " << resimulationNsPerFrame() / 1000.0
+            << " us per frame played\n";
+        out << "Stalls:       " << stalls << "\n";
+        out << "Desyncs:      " << desyncs << "\n";
+    }
+};
+
+// One client's view of a match, as described at the top of the file.
+// Frames are simulated in order; `frame` is the next one to simulate.
+class RollbackSession {
+public:
+    static constexpr int WINDOW = 128;  // Frames of inputs, snapshots and hashes kept
+
+    RollbackSession(const PvpMatch& start, int self, int maxPrediction)
+        : match(start), local(self), ahead(std::clamp(maxPrediction, 0, WINDOW / 4)) {
+        confirmed.fill(-1);
+        for (auto& slot : slots) slot.frame = -1;
+    }
+
+    const PvpMatch& state() const { return match; }
+    int getFrame() const { return match.getFrame(); }
+    int self() const { return local; }
+    int nextLocalFrame() const { return confirmed[local] + 1; }
+    const RollbackStats& stats() const { return counters; }
+
+    // Latest frame whose input from `player` is known, along with every
+    // frame before it
+    int confirmedThrough(int player) const { return confirmed[player]; }
+
+    int confirmedFrame() const {
+        int lowest = confirmed[0];
+        for (int p = 1; p < match.players(); p++) lowest = std::min(lowest, confirmed[p]);
+        return lowest;
+    }
+
+    // The input from `player` for `frame`, if still held
+    bool inputAt(int player, int frame, PvpInput& input) const {
+        if (frame < 0) return false;
+        const Slot& slot = slots[frame % WINDOW];
+        if (slot.frame != frame || !(slot.known >> player & 1)) return false;
+        input = slot.inputs[player];
+        return true;
+    }
+
+    // This client's input for nextLocalFrame()
+    void addLocalInput(const PvpInput& input) { addInput(local, nextLocalFrame(), input); }
+
+    // Another client's input, in any order and any number of times
+    void addRemoteInput(int player, int frame, const PvpInput& input) {
+        if (player == local || player < 0 || player >= match.players()) return;
+        addInput(player, frame, input);
+    }
+
+    // Whether the next frame may be simulated: this client's input for it
+    // is in and it is not too far past the last frame everyone confirmed.
+    bool canAdvance() const {
+        return !match.over() && nextLocalFrame() > getFrame() && getFrame() - confirmedFrame() <= ahead;
+    }
+
+    bool atPredictionLimit() const { return !match.over() && getFrame() - confirmedFrame() > ahead; }
+
+    void advance() {
+        settle();
+        if (!canAdvance()) return;
+        simulate();
+        counters.frames++;
+        settle();
+    }
+
+    // Roll back if a late input proved a prediction wrong, then hash the
+    // frames everyone has now confirmed. advance() does this too; call it
+    // when inputs arrive while the session cannot advance.
+    void settle() {
+        if (rollbackFrom < getFrame()) rollBack();
+        rollbackFrom = INT32_MAX;
+        int through = std::min(confirmedFrame(), getFrame() - 1);
+        while (hashed < through) {
+            int f = hashed + 1;
+            const PvpMatch& after = f + 1 == getFrame() ? match : slots[(f + 1) % WINDOW].snapshot;
+            Slot& slot = slots[f % WINDOW];
+            slot.hash = after.stateHash();
+            slot.hashed = true;
+            hashed = f;
+            if (after.over() && finalFrame < 0) {
+                finalFrame = f;
+                finalHash = slot.hash;
+                finalWinner = after.winner();
+            }
+        }
+    }
+
+    // Latest frame whose outcome is confirmed, and its hash (-1 before the first)
+    int hashedFrame() const { return hashed; }
+
+    bool confirmedHash(int frame, uint64_t& hash) const {
+        if (frame < 0 || frame > hashed) return false;
+        const Slot& slot = slots[frame % WINDOW];
+        if (slot.frame != frame || !slot.hashed) return false;
+        hash = slot.hash;
+        return true;
+    }
+
+    // Compare another client's hash of a confirmed frame with ours
+    void checkRemoteHash(int frame, uint64_t hash) {
+        uint64_t mine;
+        if (confirmedHash(frame, mine) && mine != hash && frame > lastDesync) {
+            counters.desyncs++;
+            lastDesync = frame;
+        }
+    }
+
+    void countStall() { counters.stalls++; }
+
+    // Once the confirmed match is over: the frame that ended it, the hash
+    // after it and the winner (-1 for a draw)
+    bool finished() const { return finalFrame >= 0; }
+    int getFinalFrame() const { return finalFrame; }
+    uint64_t getFinalHash() const { return finalHash; }
+    int getWinner() const { return finalWinner; }
+
+private:
+    struct Slot {
+        int frame = -1;
+        uint32_t known = 0;  // Bit per player: inputs[player] is real
+        bool simulated = false;
+        bool hashed = false;
+        std::array<PvpInput, PvpMatch::MAX_PLAYERS> inputs{};
+        std::array<PvpInput, PvpMatch::MAX_PLAYERS> used{};  // What the last simulation of the frame played
+        PvpMatch snapshot;  // At the start of the frame
+        uint64_t hash = 0;  // After the frame, once confirmed
+    };
+
+    PvpMatch match;
+    int local;
+    int ahead;
+    std::array<int, PvpMatch::MAX_PLAYERS> confirmed{};
+    std::array<PvpInput, PvpMatch::MAX_PLAYERS> latest{};  // Input at confirmed[p]
+    std::vector<Slot> slots = std::vector<Slot>(WINDOW);
+    int rollbackFrom = INT32_MAX;
+    int hashed = -1;
+    int lastDesync = -1;
+    int finalFrame = -1;
+    uint64_t finalHash = 0;
+    int finalWinner = -1;
+    RollbackStats counters;
+
+    Slot& slotFor(int frame) {
+        Slot& slot = slots[frame % WINDOW];
+        if (slot.frame != frame) {
+            slot.frame = frame;
+            slot.known = 0;
+            slot.simulated = false;
+            slot.hashed = false;
+        }
+        return slot;
+    }
+
+    // The real input when known, otherwise the prediction
+    PvpInput inputFor(int player, int frame) const {
+        PvpInput input;
+        if (inputAt(player, frame, input)) return input;
+        return latest[player];
+    }
+
+    void addInput(int player, int frame, const PvpInput& input) {
+        if (frame <= confirmed[player] || frame >= confirmedFrame() + WINDOW) return;  // Old news, or too far ahead
+        Slot& slot = slotFor(frame);
+        if (slot.known >> player & 1) return;
+        slot.inputs[player] = input;
+        slot.known |= 1u << player;
+
+        int before = confirmed[player];
+        while (true) {
+            int next = confirmed[player] + 1;
+            const Slot& following = slots[next % WINDOW];
+            if (following.frame != next || !(following.known >> player & 1)) break;
+            confirmed[player] = next;
+            latest[player] = following.inputs[player];
+        }
+
+        // The first simulated frame that played something other than what
+        // it would play now
+        for (int f = std::min(frame, before + 1); f < getFrame(); f++) {
+            const Slot& played = slots[f % WINDOW];
+            if (played.frame == f && played.simulated && !(played.used[player] == inputFor(player, f))) {
+                rollbackFrom = std::min(rollbackFrom, f);
+                break;
+            }
+        }
+    }
+
+    void simulate() {
+        int frame = getFrame();
+        Slot& slot = slotFor(frame);
+        std::array<PvpInput, PvpMatch::MAX_PLAYERS> inputs{};
+        for (int p = 0; p < match.players(); p++) {
+            inputs[p] = inputFor(p, frame);
+        }
+        slot.snapshot = match;
+        slot.used = inputs;
+        slot.simulated = true;
+        match.step(inputs.data());
+    }
+
+    void rollBack() {
+        TRACE_ZONE("rollback");
+        auto start = std::chrono::steady_clock::now();
+        int target = getFrame();
+        int depth = target - rollbackFrom;
+        match = slots[rollbackFrom % WINDOW].snapshot;
+        while (getFrame() < target) {
+            slots[getFrame() % WINDOW].hashed = false;
+            simulate();
+        }
+        counters.rollbacks++;
+        counters.resimulatedFrames += depth;
+        counters.deepestRollback = std::max(counters.deepestRollback, depth);
+        counters.resimulationNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+};
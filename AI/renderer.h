@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include "output.h"
+
+// SGR sequence that switches the terminal to a color.
+inline void appendColorCode(std::string& out, Color color) {
+    switch(color) {
+        case Color::DEFAULT: out += "\033[0m"; break;
+        case Color::RED: out += "\033[31m"; break;
+        case Color::GREEN: out += "\033[32m"; break;
+        case Color::YELLOW: out += "\033[33m"; break;
+        case Color::MAGENTA: out += "\033[35m"; break;
+    }
+}
+
+// A line as plain text with SGR color changes, ending in the default color.
+inline void appendColoredText(std::string& out, const Line& line) {
+    Color current = Color::DEFAULT;
+    for (size_t i = 0; i < line.text.size(); i++) {
+        if (line.colors[i] != current) {
+            current = line.colors[i];
+            appendColorCode(out, current);
+        }
+        out += line.text[i];
+    }
+    if (current != Color::DEFAULT) {
+        appendColorCode(out, Color::DEFAULT);
+    }
+}
+
+inline bool stdoutIsTerminal() {
+#if defined(__unix__) || defined(__APPLE__)
+    return isatty(STDOUT_FILENO);
+#else
+    return false;
+#endif
+}
+
+// Plain scrolling output for pipes, logs and terminals we can't size.
+// Lines collect in one buffer that is written out when the game waits for
+// input or ends a frame, instead of flushing after every line.
+class StreamRenderer : public Renderer {
+public:
+    explicit StreamRenderer(std::FILE* file = stdout) : file(file) {}
+    ~StreamRenderer() override { present(); }
+
+    void write(const Line& line) override {
+        appendColoredText(buffer, line);
+        buffer += '\n';
+        if (buffer.size() > 1 << 16) {
+            present();
+        }
+    }
+
+    void prompt(const std::vector<Line>& menu, std::string_view question) override {
+        for (const Line& line : menu) {
+            write(line);
+        }
+        buffer += question;
+        present();
+    }
+
+    void present() override {
+        if (buffer.empty()) return;
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+        std::fflush(file);
+        buffer.clear();
+    }
+
+private:
+    std::FILE* file;
+    std::string buffer;
+};
+
+// Full-screen renderer. Each frame is drawn into a back buffer of cells
+// (title, status panel, tail of the combat log, menu and prompt), compared
+// with the front buffer that mirrors the terminal, and only the cells that
+// differ are sent, as a single write.
+class TerminalRenderer : public Renderer {
+public:
+    explicit TerminalRenderer(std::FILE* file = stdout) : file(file) {}
+
+    ~TerminalRenderer() override {
+        menu.clear();
+        question.clear();
+        present();
+        // Leave the shell prompt below the last frame
+        std::string tail;
+        moveTo(tail, 0, height - 1);
+        appendColorCode(tail, Color::DEFAULT);
+        tail += '\n';
+        std::fwrite(tail.data(), 1, tail.size(), file);
+        std::fflush(file);
+    }
+
+    void write(const Line& line) override {
+        size_t start = 0;
+        while (true) {
+            size_t end = line.text.find('\n', start);
+            Line part;
+            size_t stop = end == std::string::npos ? line.text.size() : end;
+            part.text.assign(line.text, start, stop - start);
+            part.colors.assign(line.colors.begin() + start, line.colors.begin() + stop);
+            log.push_back(std::move(part));
+            if (end == std::string::npos) break;
+            start = end + 1;
+        }
+        while (log.size() > LOG_LIMIT) {
+            log.pop_front();
+        }
+    }
+
+    void setStatus(std::vector<Line> panel) override {
+        status = std::move(panel);
+    }
+
+    void prompt(const std::vector<Line>& lines, std::string_view text) override {
+        menu = lines;
+        question.assign(text);
+        present();
+
+        // The player's typing and Enter land on the prompt row and the row
+        // below it behind our back; force those rows to be redrawn.
+        for (int y = std::max(0, height - 2); y < height; y++) {
+            std::fill(front.begin() + y * width, front.begin() + (y + 1) * width, Cell{0, Color::DEFAULT});
+        }
+        menu.clear();
+        question.clear();
+    }
+
+    void present() override {
+        resizeToTerminal();
+        drawFrame();
+
+        std::string& out = frame;
+        out.clear();
+        if (fullRedraw) {
+            out += "\033[0m\033[2J";
+            fullRedraw = false;
+        }
+
+        int cursorX = -1, cursorY = -1;
+        Color current = Color::DEFAULT;
+        bool colorKnown = false;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const Cell& cell = back[y * width + x];
+                if (cell == front[y * width + x]) continue;
+
+                // Rewriting a short run of unchanged cells is cheaper than
+                // a cursor move, so only jump for real gaps.
+                int from = x;
+                if (y != cursorY || x < cursorX || x - cursorX > 4) {
+                    moveTo(out, x, y);
+                } else {
+                    from = cursorX;
+                }
+                for (int i = from; i <= x; i++) {
+                    const Cell& c = back[y * width + i];
+                    if (!colorKnown || c.color != current) {
+                        appendColorCode(out, c.color);
+                        current = c.color;
+                        colorKnown = true;
+                    }
+                    out += c.ch;
+                }
+                cursorX = x + 1;
+                cursorY = y;
+            }
+        }
+        if (colorKnown && current != Color::DEFAULT) {
+            appendColorCode(out, Color::DEFAULT);
+        }
+        moveTo(out, std::min((int)question.size(), width - 1), promptRow());
+
+        std::fwrite(out.data(), 1, out.size(), file);
+        std::fflush(file);
+        front.swap(back);
+    }
+
+private:
+    struct Cell {
+        char ch = ' ';
+        Color color = Color::DEFAULT;
+
+        bool operator==(const Cell& other) const {
+            return ch == other.ch && color == other.color;
+        }
+    };
+
+    static constexpr size_t LOG_LIMIT = 512;
+
+    std::FILE* file;
+    int width = 0;
+    int height = 0;
+    bool fullRedraw = true;
+    std::vector<Cell> front;
+    std::vector<Cell> back;
+    std::string frame;
+
+    std::deque<Line> log;
+    std::vector<Line> status;
+    std::vector<Line> menu;
+    std::string question;
+
+    int promptRow() const { return std::max(0, height - 2); }
+
+    static void moveTo(std::string& out, int x, int y) {
+        out += "\033[";
+        out += std::to_string(y + 1);
+        out += ';';
+        out += std::to_string(x + 1);
+        out += 'H';
+    }
+
+    void resizeToTerminal() {
+        int w = 80, h = 24;
+#if defined(__unix__) || defined(__APPLE__)
+        winsize size{};
+        if (ioctl(fileno(file), TIOCGWINSZ, &size) == 0 && size.ws_col > 0 && size.ws_row > 0) {
+            w = size.ws_col;
+            h = size.ws_row;
+        }
+#endif
+        if (w == width && h == height) return;
+        width = w;
+        height = h;
+        front.assign(width * height, Cell{0, Color::DEFAULT});
+        back.assign(width * height, Cell{});
+        fullRedraw = true;
+    }
+
+    void drawLine(int y, const Line& line) {
+        Cell* row = &back[y * width];
+        int count = std::min((int)line.text.size(), width);
+        for (int x = 0; x < count; x++) {
+            unsigned char c = line.text[x];
+            row[x].ch = (c < 32 || c == 127) ? ' ' : (char)c;
+            row[x].color = line.colors[x];
+        }
+    }
+
+    void drawFrame() {
+        std::fill(back.begin(), back.end(), Cell{});
+
+        drawLine(0, makeLine(Colored{"TERMINAL COMBAT: GODS VS DEMONS", Color::YELLOW}));
+        int y = 1;
+        int statusRows = std::min((int)status.size(), std::max(0, height / 3));
+        for (int i = 0; i < statusRows; i++) {
+            drawLine(y++, status[i]);
+        }
+        if (y < height) {
+            drawLine(y++, makeLine(std::string(width, '-')));
+        }
+
+        // Menu and question sit just above the last row, which stays empty
+        // so the player's Enter never scrolls the screen.
+        int bottom = promptRow();
+        int menuTop = std::max(y, bottom - (int)menu.size());
+        for (int i = 0; menuTop + i < bottom && i < (int)menu.size(); i++) {
+            drawLine(menuTop + i, menu[i]);
+        }
+        if (bottom >= y) {
+            drawLine(bottom, makeLine(question));
+        }
+
+        int logRows = menuTop - y;
+        int first = std::max(0, (int)log.size() - logRows);
+        for (int i = first; i < (int)log.size(); i++) {
+            drawLine(y++, log[i]);
+        }
+    }
+};
+
+// Full-screen rendering on a real terminal, plain batched text otherwise.
+inline std::unique_ptr<Renderer> makeRenderer() {
+    if (stdoutIsTerminal()) {
+        return std::make_unique<TerminalRenderer>();
+    }
+    return std::make_unique<StreamRenderer>();
+}
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "journal.h"
+
+using namespace std;
+
+// Rebuilds combat state from a journal written with --journal, straight out
+// of the mapped file and without re-running any combat rules.
+//
+//   replay FILE                      summary of every battle in the journal
+//   replay FILE --turn N [--battle K]  events of turn N and the state after it
+
+static const char* sideName(uint8_t side) {
+    return side == SIDE_PARTY ? "player" : "enemy";
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cout << "Usage: " << argv[0] << " JOURNAL [--turn N] [--battle K]" << endl;
+        return 1;
+    }
+    
+    long turn = -1;
+    size_t battleIndex = 0;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        string arg = argv[i];
+        if (arg == "--turn") {
+            turn = min<long>(atol(argv[i + 1]), UINT32_MAX);
+        } else if (arg == "--battle") {
+            battleIndex = strtoull(argv[i + 1], nullptr, 10);
+        }
+    }
+    
+    JournalReader reader;
+    string error;
+    if (!reader.open(argv[1], error)) {
+        cout << error << endl;
+        return 1;
+    }
+    
+    const CombatEvent* events = reader.data();
+    if (turn < 0) {
+        size_t counts[(size_t)EventType::COUNT] = {};
+        for (size_t i = 0; i < reader.size(); i++) {
+            if ((size_t)events[i].type < (size_t)EventType::COUNT) counts[(size_t)events[i].type]++;
+        }
+        cout << reader.size() << " events, " << reader.battleCount() << " battle(s)" << endl;
+        for (size_t t = 0; t < (size_t)EventType::COUNT; t++) {
+            if (counts[t]) cout << "  " << eventName((EventType)t) << ": " << counts[t] << endl;
+        }
+        return 0;
+    }
+    
+    if (battleIndex >= reader.battleCount()) {
+        cout << "No battle " << battleIndex << " in this journal" << endl;
+        return 1;
+    }
+    auto range = reader.battle(battleIndex);
+    // Turn 0 starts with the battle; there is no turn -1 to search past
+    size_t turnBegin = turn == 0 ? range.first : reader.endOfTurn(range, (uint32_t)turn - 1);
+    size_t turnEnd = reader.endOfTurn(range, (uint32_t)turn);
+    
+    cout << "=== Turn " << turn << " events ===" << endl;
+    for (size_t i = turnBegin; i < turnEnd; i++) {
+        const CombatEvent& e = events[i];
+        cout << eventName(e.type);
+        if (e.target != NO_ENTITY) cout << " " << sideName(e.targetSide) << "#" << e.target;
+        if (e.source != NO_ENTITY) cout << " by " << sideName(e.sourceSide) << "#" << e.source;
+        cout << " amount=" << e.amount << " value=" << e.value << endl;
+    }
+    
+    vector<ReplayEntity> entities;
+    applyEvents(events, range.first, turnEnd, entities);
+    cout << "=== State after turn " << turn << " ===" << endl;
+    for (const ReplayEntity& entity : entities) {
+        cout << sideName(entity.side) << "#" << entity.slot << ": "
+             << (entity.alive ? "" : "dead, ") << "HP " << entity.health << "/" << entity.maxHealth;
+        if (entity.poisonTurns > 0) cout << ", poisoned " << entity.poisonTurns;
+        if (entity.restrained) cout << ", restrained";
+        if (entity.souls > 0) cout << ", souls " << entity.souls;
+        if (entity.worshippers > 0) cout << ", worshippers " << entity.worshippers;
+        cout << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// SplitMix64 finalizer: a strong 64-bit bijective mix.
+constexpr uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Seed for the index-th child of a seed (battle i of a run, entity i of a
+// wave). Depends only on the two numbers, never on which thread asks.
+constexpr uint64_t deriveSeed(uint64_t seed, uint64_t index) {
+    return mix64(seed ^ mix64(index + 0x9e3779b97f4a7c15ull));
+}
+
+// Counter-based random stream. Output n is a pure function of (key, n), so
+// a stream is just two integers: cheap to create per battle or per store,
+// trivially saved and restored, and identical on every platform. All game
+// randomness goes through here; no rand(), no std distributions (their
+// results differ between standard libraries).
+class Rng {
+public:
+    using result_type = uint64_t;
+    
+    explicit Rng(uint64_t seed = 0, uint64_t stream = 0) : key(deriveSeed(seed, stream)) {}
+    
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    
+    result_type operator()() { return next(); }
+    
+    uint64_t next() {
+        return mix64(key + 0x9e3779b97f4a7c15ull * ++counter);
+    }
+    
+    // Uniform integer in [lo, hi] (multiply-shift, bias below 2^-32).
+    int roll(int lo, int hi) {
+        uint64_t range = (uint64_t)((int64_t)hi - lo) + 1;
+        return lo + (int)(((next() >> 32) * range) >> 32);
+    }
+    
+    // True with the given percent probability.
+    bool chance(int percent) {
+        return roll(0, 99) < percent;
+    }
+    
+    // Independent child stream, e.g. one per store or per worker.
+    Rng stream(uint64_t id) const {
+        Rng child;
+        child.key = deriveSeed(key, id);
+        return child;
+    }
+    
+    uint64_t getKey() const { return key; }
+    uint64_t getCounter() const { return counter; }
+    
+    // Resume a stream exactly where it was (saves, replays, rollback).
+    static Rng restore(uint64_t key, uint64_t counter) {
+        Rng rng;
+        rng.key = key;
+        rng.counter = counter;
+        return rng;
+    }
+    
+private:
+    uint64_t key;
+    uint64_t counter = 0;
+};
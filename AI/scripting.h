@@ -0,0 +1,392 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "abilities.h"
+#include "character.h"
+#include "entity_store.h"
+#include "gear.h"
+#include "journal.h"
+#include "output.h"
+#include "rng.h"
+#include "status_effects.h"
+
+// Lua is optional: build with -DTERMINAL_GAME_LUA and link Lua 5.4 to get
+// scripted abilities and enemy AI. Without it ScriptEngine still exists but
+// never loads anything, and the game uses its built-in rules.
+#ifdef TERMINAL_GAME_LUA
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+}
+#endif
+
+// What a script can see and touch during one call: both sides, the
+// battle's RNG (so scripted fights replay like built-in ones), its status
+// effects and turn, and the combatant the script is acting for.
+struct ScriptWorld {
+    EntityStore* party = nullptr;
+    EntityStore* enemies = nullptr;
+    Rng* rng = nullptr;
+    StatusEffects* effects = nullptr;
+    int turn = 0;
+    uint8_t actorSide = SIDE_PARTY;
+    uint32_t actorIndex = 0;
+};
+
+// Enemy decisions a script can return; NONE falls back to the dice.
+enum class ScriptedAction {
+    NONE,
+    ATTACK,
+    SPECIAL,
+    HEAL
+};
+
+inline const char* gearLevelKey(GearLevel level) {
+    switch(level) {
+        case GearLevel::DEMON: return "demon";
+        case GearLevel::GOD: return "god";
+        default: return "normal";
+    }
+}
+
+// One Lua state with every gear level's script loaded into it. Each gear
+// level has one script, lua/<level>.luac (precompiled with luac) or
+// lua/<level>.lua, returning
+//
+//     { abilities = { poison = function(target) ... end, ... },
+//       enemy_turn = function(self) return game.ATTACK end }
+//
+// Scripts go by level rather than gear type because the level alone
+// decides a gear's abilities (levelAbilities); sword, spear and arrow
+// differ only in stats. Ability keys come from abilityTable. On load every
+// function is pinned in the registry and its reference cached per (gear
+// level, ability), so a call is a registry index and a pcall with integer
+// arguments: no lookups by name and no allocation. Use one engine per
+// thread.
+class ScriptEngine {
+public:
+    ScriptEngine() {
+#ifdef TERMINAL_GAME_LUA
+        for (auto& refs : abilityRefs) {
+            for (int& ref : refs) ref = LUA_NOREF;
+        }
+        for (int& ref : enemyRefs) ref = LUA_NOREF;
+#endif
+    }
+
+    ScriptEngine(const ScriptEngine&) = delete;
+    ScriptEngine& operator=(const ScriptEngine&) = delete;
+
+    ~ScriptEngine() {
+#ifdef TERMINAL_GAME_LUA
+        if (L) lua_close(L);
+#endif
+    }
+
+    // Load every gear level's script found in dir. Fails if none is found
+    // or one fails to load.
+    bool load(const std::string& dir, std::string& error) {
+#ifdef TERMINAL_GAME_LUA
+        if (!L) createState();
+        int loaded = 0;
+        for (int level = 0; level < GEAR_LEVEL_COUNT; level++) {
+            std::string base = dir + "/" + gearLevelKey((GearLevel)level);
+            std::string path = base + ".luac";
+            const char* mode = "b";
+            if (!std::ifstream(path)) {
+                path = base + ".lua";
+                mode = "t";
+                if (!std::ifstream(path)) continue;
+            }
+            if (luaL_loadfilex(L, path.c_str(), mode) != LUA_OK || lua_pcall(L, 0, 1, 0) != LUA_OK) {
+                error = lua_tostring(L, -1);
+                lua_pop(L, 1);
+                return false;
+            }
+            if (!lua_istable(L, -1)) {
+                error = path + " must return a table";
+                lua_pop(L, 1);
+                return false;
+            }
+            cacheFunctions(level);
+            lua_pop(L, 1);
+            loaded++;
+        }
+        if (loaded == 0) {
+            error = "no gear scripts in " + dir;
+            return false;
+        }
+        return true;
+#else
+        (void)dir;
+        error = "built without Lua support (define TERMINAL_GAME_LUA)";
+        return false;
+#endif
+    }
+
+    bool hasAbility(GearLevel level, AbilityId id) const {
+#ifdef TERMINAL_GAME_LUA
+        return id < AbilityId::COUNT && abilityRefs[(int)level][(int)id] != LUA_NOREF;
+#else
+        (void)level;
+        (void)id;
+        return false;
+#endif
+    }
+
+    bool hasEnemyAi(GearLevel level) const {
+#ifdef TERMINAL_GAME_LUA
+        return enemyRefs[(int)level] != LUA_NOREF;
+#else
+        (void)level;
+        return false;
+#endif
+    }
+
+    // Run a scripted ability. Returns false if no script defines it, in which
+    // case the built-in ability should run. A script that fails is reported
+    // and still counts as having run, since it may have changed the battle.
+    bool runAbility(GearLevel level, AbilityId id, ScriptWorld& world, int target) {
+#ifdef TERMINAL_GAME_LUA
+        if (!hasAbility(level, id)) return false;
+        current = &world;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, abilityRefs[(int)level][(int)id]);
+        lua_pushinteger(L, target + 1);
+        call(1, 0);
+        current = nullptr;
+        return true;
+#else
+        (void)level;
+        (void)id;
+        (void)world;
+        (void)target;
+        return false;
+#endif
+    }
+
+    ScriptedAction enemyTurn(GearLevel level, ScriptWorld& world) {
+#ifdef TERMINAL_GAME_LUA
+        if (!hasEnemyAi(level)) return ScriptedAction::NONE;
+        current = &world;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, enemyRefs[(int)level]);
+        lua_pushinteger(L, world.actorIndex + 1);
+        ScriptedAction action = ScriptedAction::NONE;
+        if (call(1, 1)) {
+            lua_Integer result = lua_tointeger(L, -1);
+            if (result >= (int)ScriptedAction::ATTACK && result <= (int)ScriptedAction::HEAL) {
+                action = (ScriptedAction)result;
+            }
+            lua_pop(L, 1);
+        }
+        current = nullptr;
+        return action;
+#else
+        (void)level;
+        (void)world;
+        return ScriptedAction::NONE;
+#endif
+    }
+
+private:
+#ifdef TERMINAL_GAME_LUA
+    lua_State* L = nullptr;
+    int abilityRefs[GEAR_LEVEL_COUNT][ABILITY_COUNT];
+    int enemyRefs[GEAR_LEVEL_COUNT];
+    ScriptWorld* current = nullptr;
+
+    bool call(int args, int results) {
+        if (lua_pcall(L, args, results, 0) == LUA_OK) return true;
+        say("Script error: ", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+
+    void cacheFunctions(int level) {
+        lua_getfield(L, -1, "abilities");
+        if (lua_istable(L, -1)) {
+            for (int id = 0; id < ABILITY_COUNT; id++) {
+                lua_getfield(L, -1, abilityTable[id].key);
+                if (lua_isfunction(L, -1)) {
+                    abilityRefs[level][id] = luaL_ref(L, LUA_REGISTRYINDEX);
+                } else {
+                    lua_pop(L, 1);
+                }
+            }
+        }
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "enemy_turn");
+        if (lua_isfunction(L, -1)) {
+            enemyRefs[level] = luaL_ref(L, LUA_REGISTRYINDEX);
+        } else {
+            lua_pop(L, 1);
+        }
+    }
+
+    void createState() {
+        L = luaL_newstate();
+        luaL_openlibs(L);
+        lua_gc(L, LUA_GCGEN, 0, 0);  // Short-lived garbage, if any, dies young
+
+        static const luaL_Reg functions[] = {
+            {"count", luaCount},
+            {"health", luaHealth},
+            {"max_health", luaMaxHealth},
+            {"damage", luaDamage},
+            {"armor", luaArmor},
+            {"poison_turns", luaPoisonTurns},
+            {"is_restrained", luaIsRestrained},
+            {"hit", luaHit},
+            {"heal", luaHeal},
+            {"poison", luaPoison},
+            {"restrain", luaRestrain},
+            {"add_souls", luaAddSouls},
+            {"add_worshippers", luaAddWorshippers},
+            {"roll", luaRoll},
+            {"say", luaSay},
+            {nullptr, nullptr},
+        };
+        lua_newtable(L);
+        lua_pushlightuserdata(L, this);
+        luaL_setfuncs(L, functions, 1);
+
+        struct Constant { const char* name; int value; };
+        static const Constant constants[] = {
+            {"PARTY", SIDE_PARTY}, {"ENEMIES", SIDE_ENEMIES},
+            {"ATTACK", (int)ScriptedAction::ATTACK}, {"SPECIAL", (int)ScriptedAction::SPECIAL},
+            {"HEAL", (int)ScriptedAction::HEAL},
+        };
+        for (const Constant& constant : constants) {
+            lua_pushinteger(L, constant.value);
+            lua_setfield(L, -2, constant.name);
+        }
+        lua_setglobal(L, "game");
+        lua_checkstack(L, 32);
+    }
+
+    // Helpers for the functions scripts call. Sides are game.PARTY or
+    // game.ENEMIES; indices are 1-based as usual in Lua.
+    static ScriptWorld& world(lua_State* L) {
+        auto* engine = static_cast<ScriptEngine*>(lua_touserdata(L, lua_upvalueindex(1)));
+        if (!engine->current) luaL_error(L, "game functions are only available during a script call");
+        return *engine->current;
+    }
+
+    static EntityStore& sideArg(lua_State* L, int arg) {
+        ScriptWorld& w = world(L);
+        lua_Integer side = luaL_checkinteger(L, arg);
+        luaL_argcheck(L, side == SIDE_PARTY || side == SIDE_ENEMIES, arg, "expected game.PARTY or game.ENEMIES");
+        return side == SIDE_PARTY ? *w.party : *w.enemies;
+    }
+
+    static Character entityArg(lua_State* L, int arg) {
+        EntityStore& store = sideArg(L, arg);
+        lua_Integer index = luaL_checkinteger(L, arg + 1);
+        luaL_argcheck(L, index >= 1 && index <= (lua_Integer)store.size(), arg + 1, "no such combatant");
+        return Character(store, (uint32_t)(index - 1));
+    }
+
+    static Character actor(lua_State* L) {
+        ScriptWorld& w = world(L);
+        return Character(w.actorSide == SIDE_PARTY ? *w.party : *w.enemies, w.actorIndex);
+    }
+
+    static int luaCount(lua_State* L) {
+        lua_pushinteger(L, (lua_Integer)sideArg(L, 1).size());
+        return 1;
+    }
+
+    static int luaHealth(lua_State* L) {
+        lua_pushinteger(L, entityArg(L, 1).currentHealth());
+        return 1;
+    }
+
+    static int luaMaxHealth(lua_State* L) {
+        lua_pushinteger(L, entityArg(L, 1).maxHealth());
+        return 1;
+    }
+
+    static int luaDamage(lua_State* L) {
+        lua_pushinteger(L, entityArg(L, 1).getTotalDamage());
+        return 1;
+    }
+
+    static int luaArmor(lua_State* L) {
+        lua_pushinteger(L, entityArg(L, 1).getTotalArmor());
+        return 1;
+    }
+
+    static int luaPoisonTurns(lua_State* L) {
+        lua_pushinteger(L, entityArg(L, 1).poisonTurns());
+        return 1;
+    }
+
+    static int luaIsRestrained(lua_State* L) {
+        lua_pushboolean(L, entityArg(L, 1).isRestrained());
+        return 1;
+    }
+
+    // game.hit(side, index, damage): the actor strikes a combatant
+    static int luaHit(lua_State* L) {
+        Character target = entityArg(L, 1);
+        actor(L).strike(target, (int)luaL_checkinteger(L, 3));
+        return 0;
+    }
+
+    static int luaHeal(lua_State* L) {
+        entityArg(L, 1).heal((int)luaL_checkinteger(L, 3));
+        return 0;
+    }
+
+    static int luaPoison(lua_State* L) {
+        Character target = entityArg(L, 1);
+        int turns = (int)luaL_checkinteger(L, 3);
+        ScriptWorld& w = world(L);
+        w.effects->apply(*target.store, target.index, StatusId::POISON, turns, w.turn);
+        record(EventType::POISONED, target.ref(), actor(L).ref(), 0, turns);
+        return 0;
+    }
+
+    static int luaRestrain(lua_State* L) {
+        Character target = entityArg(L, 1);
+        ScriptWorld& w = world(L);
+        w.effects->apply(*target.store, target.index, StatusId::RESTRAIN, 1, w.turn);
+        record(EventType::RESTRAINED, target.ref(), actor(L).ref());
+        return 0;
+    }
+
+    static int luaAddSouls(lua_State* L) {
+        Character self = actor(L);
+        int count = (int)luaL_checkinteger(L, 1);
+        self.addSouls(count);
+        record(EventType::SOUL_GAINED, self.ref(), {}, count, self.souls());
+        return 0;
+    }
+
+    static int luaAddWorshippers(lua_State* L) {
+        Character self = actor(L);
+        int count = (int)luaL_checkinteger(L, 1);
+        self.addWorshippers(count);
+        record(EventType::WORSHIPPER_GAINED, self.ref(), {}, count, self.worshippers());
+        return 0;
+    }
+
+    static int luaRoll(lua_State* L) {
+        ScriptWorld& w = world(L);
+        lua_Integer lo = luaL_checkinteger(L, 1);
+        lua_Integer hi = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, lo <= hi, 2, "empty range");
+        lua_pushinteger(L, w.rng->roll((int)lo, (int)hi));
+        return 1;
+    }
+
+    static int luaSay(lua_State* L) {
+        say(luaL_checkstring(L, 1));
+        return 0;
+    }
+#endif
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+// Fixed set of threads that all run the same job, the caller taking part
+// as worker 0. Threads are started once and sleep between jobs.
+class SearchThreads {
+public:
+    explicit SearchThreads(unsigned count) {
+        for (unsigned id = 1; id < count; id++) {
+            threads.emplace_back([this, id] { workerLoop(id); });
+        }
+    }
+
+    SearchThreads(const SearchThreads&) = delete;
+    SearchThreads& operator=(const SearchThreads&) = delete;
+
+    ~SearchThreads() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    unsigned size() const { return (unsigned)threads.size() + 1; }
+
+    // Run job(id) on every worker and wait for all of them.
+    void run(const std::function<void(unsigned)>& job) {
+        if (threads.empty()) {
+            job(0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &job;
+            pending = (unsigned)threads.size();
+            generation++;
+        }
+        wakeup.notify_all();
+        job(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return pending == 0; });
+        current = nullptr;
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable finished;
+    const std::function<void(unsigned)>* current = nullptr;
+    uint64_t generation = 0;
+    unsigned pending = 0;
+    bool stopping = false;
+
+    void workerLoop(unsigned id) {
+        TRACE_THREAD_NAME("search worker");
+        uint64_t seen = 0;
+        while (true) {
+            const std::function<void(unsigned)>* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                job = current;
+            }
+            (*job)(id);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) finished.notify_one();
+            }
+        }
+    }
+};
@@ -0,0 +1,558 @@
+#pragma once
+
+// Many players on one machine. Each connection to the listening socket is
+// its own interactive Game, with its own input loop and output buffer.
+// Connections are dealt round-robin to a fixed pool of worker threads, and
+// each worker multiplexes its share with epoll. Between turns a player is
+// a socket and a suspended coroutine, never a thread of their own.
+//
+//   ServerConfig config;
+//   config.address = "unix:/tmp/combat.sock";  // or "tcp:4000" (loopback)
+//   Server server(config);
+//   if (!server.listen(error)) ...
+//   server.run();  // Serves until stop()
+//
+// The wire protocol is the console's: the server sends what a terminal
+// would show, ending each batch at a prompt ("Choice: "); the client
+// answers with one line. Sessions have no autosave, gear scripts or
+// enemy search (whose thread pools are sized for one player per process).
+//
+// Linux only (epoll, eventfd); SERVER_EPOLL is defined where it builds.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "event_loop.h"
+#include "game.h"
+#include "output.h"
+#include "renderer.h"
+#include "rng.h"
+#include "trace.h"
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define SERVER_EPOLL 1
+#endif
+
+#ifdef SERVER_EPOLL
+
+struct ServerConfig {
+    std::string address = "tcp:4000";  // unix:PATH, or tcp:PORT on 127.0.0.1 (0 picks a free port)
+    unsigned workers = 0;  // 0 = one per hardware thread
+    uint64_t seed = 1;     // Session n plays with deriveSeed(seed, n)
+};
+
+// Where to listen or connect: "unix:PATH", or "tcp:PORT" on the loopback
+// interface. Nothing here is reachable from another machine.
+struct SocketAddress {
+    sockaddr_storage storage{};
+    socklen_t length = 0;
+    bool tcp = false;
+    std::string path;  // unix: only
+
+    const sockaddr* get() const { return (const sockaddr*)&storage; }
+
+    bool parse(const std::string& text, std::string& error) {
+        storage = {};
+        if (text.rfind("unix:", 0) == 0) {
+            tcp = false;
+            path = text.substr(5);
+            sockaddr_un* address = (sockaddr_un*)&storage;
+            if (path.empty() || path.size() >= sizeof(address->sun_path)) {
+                error = "bad socket path '" + path + "'";
+                return false;
+            }
+            address->sun_family = AF_UNIX;
+            std::memcpy(address->sun_path, path.c_str(), path.size() + 1);
+            length = sizeof(sockaddr_un);
+            return true;
+        }
+        if (text.rfind("tcp:", 0) == 0) {
+            char* end = nullptr;
+            unsigned long port = std::strtoul(text.c_str() + 4, &end, 10);
+            if (end == text.c_str() + 4 || *end || port > 65535) {
+                error = "bad port in '" + text + "'";
+                return false;
+            }
+            tcp = true;
+            sockaddr_in* address = (sockaddr_in*)&storage;
+            address->sin_family = AF_INET;
+            address->sin_port = htons((uint16_t)port);
+            address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            length = sizeof(sockaddr_in);
+            return true;
+        }
+        error = "address must be unix:PATH or tcp:PORT, not '" + text + "'";
+        return false;
+    }
+};
+
+// Thousands of sessions need thousands of descriptors; the usual soft
+// limit is 1024. Raises it as far as the hard limit allows.
+inline void raiseDescriptorLimit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// A session's output: everything the game says collects in the outbox
+// until its worker sends it, after the game next waits for input.
+class SessionRenderer : public Renderer {
+public:
+    explicit SessionRenderer(std::string& outbox) : outbox(outbox) {}
+
+    void write(const Line& line) override {
+        appendColoredText(outbox, line);
+        outbox += '\n';
+    }
+
+    void prompt(const std::vector<Line>& menu, std::string_view question) override {
+        for (const Line& line : menu) {
+            write(line);
+        }
+        outbox += question;
+    }
+
+    void present() override {}
+
+private:
+    std::string& outbox;
+};
+
+// One connected player and their game.
+class ServerSession {
+public:
+    static constexpr size_t MAX_OUTBOX = 1 << 20;  // Stop reading from clients this far behind
+
+    size_t slot = 0;  // Index in the worker's session list
+    uint32_t interest = 0;  // epoll events currently asked for
+
+    ServerSession(int socket, uint64_t battleSeed) : fd(socket), seed(battleSeed) {}
+
+    ~ServerSession() {
+        // The game's coroutines go before the game they point into
+        input.reset();
+        game.reset();
+        ::close(fd);
+    }
+
+    ServerSession(const ServerSession&) = delete;
+    ServerSession& operator=(const ServerSession&) = delete;
+
+    int socket() const { return fd; }
+
+    // The banner and the first prompt
+    void start() {
+        OutputScope scope(renderer);
+        input.emplace(EventLoop::FED_INPUT);
+        game.emplace(*input, seed);
+        sayGoodbyeIfOver();
+    }
+
+    // Take in what the client has sent, playing the game on as far as it
+    // goes. Stops early once the outbox is MAX_OUTBOX behind; the rest
+    // waits in the socket until wanted() asks for input again. False once
+    // the client has hung up.
+    bool receive() {
+        char buffer[4096];
+        while (outbox.size() - sent < MAX_OUTBOX) {
+            ssize_t count = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (count > 0) {
+                if (input->finished()) continue;  // Game over; ignore the rest
+                OutputScope scope(renderer);
+                TRACE_ZONE("session input");
+                input->feed(std::string_view(buffer, (size_t)count));
+                sayGoodbyeIfOver();
+            } else if (count < 0 && errno == EINTR) {
+                continue;
+            } else {
+                return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            }
+        }
+        return true;
+    }
+
+    // Send as much of the outbox as the socket will take. False if the
+    // connection is broken.
+    bool send() {
+        while (sent < outbox.size()) {
+            ssize_t count = ::send(fd, outbox.data() + sent, outbox.size() - sent, MSG_NOSIGNAL);
+            if (count > 0) {
+                sent += (size_t)count;
+            } else if (count < 0 && errno == EINTR) {
+                continue;
+            } else {
+                return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            }
+        }
+        outbox.clear();
+        sent = 0;
+        return true;
+    }
+
+    bool hasOutput() const { return sent < outbox.size(); }
+
+    // Game over and everything said
+    bool done() const { return input && input->finished() && !hasOutput(); }
+
+    // The epoll events this session wants next
+    uint32_t wanted() const {
+        uint32_t events = 0;
+        if (outbox.size() - sent < MAX_OUTBOX) events |= EPOLLIN;
+        if (hasOutput()) events |= EPOLLOUT;
+        return events;
+    }
+
+private:
+    // Points this thread's game output at the session while its game runs
+    class OutputScope {
+    public:
+        explicit OutputScope(Renderer& renderer) : saved(std::exchange(gameOut, &renderer)) {}
+        ~OutputScope() { gameOut = saved; }
+
+    private:
+        Renderer* saved;
+    };
+
+    int fd;
+    uint64_t seed;
+    std::string outbox;
+    size_t sent = 0;
+    SessionRenderer renderer{outbox};
+    std::optional<EventLoop> input;
+    std::optional<Game> game;
+    bool farewell = false;
+
+    void sayGoodbyeIfOver() {
+        if (input->finished() && !farewell) {
+            outbox += "\nThanks for playing!\n";
+            farewell = true;
+        }
+    }
+};
+
+// One thread's share of the sessions, all on one epoll instance. New
+// connections arrive from the accepting thread through a locked list and
+// an eventfd wake-up; everything else happens on this thread.
+class ServerWorker {
+public:
+    ServerWorker() = default;
+
+    ~ServerWorker() {
+        sessions.clear();
+        for (auto& arrival : arrivals) {
+            ::close(arrival.first);
+        }
+        if (wakeFd >= 0) ::close(wakeFd);
+        if (epollFd >= 0) ::close(epollFd);
+    }
+
+    ServerWorker(const ServerWorker&) = delete;
+    ServerWorker& operator=(const ServerWorker&) = delete;
+
+    bool open(std::string& error) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;  // The wake-up, not a session
+        if (epollFd < 0 || wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0) {
+            error = std::string("cannot set up a worker: ") + std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // From the accepting thread: this worker owns the socket from now on.
+    void adopt(int socket, uint64_t seed) {
+        std::lock_guard<std::mutex> lock(mutex);
+        arrivals.emplace_back(socket, seed);
+        wake();
+    }
+
+    // From any thread: close every session and return from run().
+    void stop() {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        wake();
+    }
+
+    void run() {
+        TRACE_THREAD_NAME("server worker");
+        epoll_event events[256];
+        while (true) {
+            int count = epoll_wait(epollFd, events, 256, -1);
+            if (count < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "Server worker: epoll_wait: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            for (int i = 0; i < count; i++) {
+                ServerSession* session = (ServerSession*)events[i].data.ptr;
+                if (!session) {
+                    if (!takeArrivals()) return;
+                } else {
+                    serve(*session, events[i].events);
+                }
+            }
+        }
+    }
+
+private:
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::vector<std::unique_ptr<ServerSession>> sessions;
+
+    std::mutex mutex;  // Guards the two below
+    std::vector<std::pair<int, uint64_t>> arrivals;
+    bool stopping = false;
+
+    void wake() {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+    }
+
+    // Start a session for each new connection. False once stopped.
+    bool takeArrivals() {
+        uint64_t drained;
+        [[maybe_unused]] ssize_t ignored = ::read(wakeFd, &drained, sizeof(drained));
+        std::vector<std::pair<int, uint64_t>> taken;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return false;
+            taken.swap(arrivals);
+        }
+        for (auto& [socket, seed] : taken) {
+            auto session = std::make_unique<ServerSession>(socket, seed);
+            session->slot = sessions.size();
+            sessions.push_back(std::move(session));
+            ServerSession& added = *sessions.back();
+            if (!advance(added, [](ServerSession& s) { s.start(); return true; })) continue;
+            epoll_event event{};
+            event.events = added.interest = added.wanted();
+            event.data.ptr = &added;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, added.socket(), &event) < 0) {
+                close(added);
+            }
+        }
+        return true;
+    }
+
+    void serve(ServerSession& session, uint32_t events) {
+        bool readable = events & (EPOLLIN | EPOLLHUP | EPOLLERR);
+        if (!advance(session, [readable](ServerSession& s) { return !readable || s.receive(); })) return;
+        uint32_t wanted = session.wanted();
+        if (wanted != session.interest) {
+            epoll_event event{};
+            event.events = session.interest = wanted;
+            event.data.ptr = &session;
+            if (epoll_ctl(epollFd, EPOLL_CTL_MOD, session.socket(), &event) < 0) {
+                // It would never be woken again
+                std::cerr << "Session dropped: epoll_ctl: " << std::strerror(errno) << std::endl;
+                close(session);
+            }
+        }
+    }
+
+    // One step of a session, then whatever it said goes out; the session
+    // is closed if the client left, the game ended, or the game threw.
+    template <typename Step>
+    bool advance(ServerSession& session, Step step) {
+        bool alive;
+        try {
+            alive = step(session);
+        } catch (const std::exception& e) {
+            std::cerr << "Session ended by an error: " << e.what() << std::endl;
+            alive = false;
+        }
+        if (alive) alive = session.send();
+        if (!alive || session.done()) {
+            close(session);
+            return false;
+        }
+        return true;
+    }
+
+    void close(ServerSession& session) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, session.socket(), nullptr);
+        size_t slot = session.slot;
+        if (slot + 1 != sessions.size()) {
+            std::swap(sessions[slot], sessions.back());
+            sessions[slot]->slot = slot;
+        }
+        sessions.pop_back();
+    }
+};
+
+// Accepts connections on the calling thread and deals them out to the
+// workers. stop() may be called from any thread or a signal handler.
+class Server {
+public:
+    explicit Server(ServerConfig serverConfig) : config(std::move(serverConfig)) {}
+
+    ~Server() {
+        if (listenFd >= 0) ::close(listenFd);
+        if (stopFd >= 0) ::close(stopFd);
+        if (!bound.path.empty()) ::unlink(bound.path.c_str());
+    }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    bool listen(std::string& error) {
+        if (!bound.parse(config.address, error)) return false;
+        raiseDescriptorLimit();
+        stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        listenFd = ::socket(bound.tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (stopFd < 0 || listenFd < 0) {
+            error = std::string("cannot create socket: ") + std::strerror(errno);
+            return false;
+        }
+        if (bound.tcp) {
+            int on = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        } else {
+            // A socket file left by a server that died is in the way
+            struct stat info;
+            if (::stat(bound.path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) ::unlink(bound.path.c_str());
+        }
+        if (::bind(listenFd, bound.get(), bound.length) < 0 || ::listen(listenFd, SOMAXCONN) < 0) {
+            error = "cannot listen on " + config.address + ": " + std::strerror(errno);
+            if (!bound.tcp) bound.path.clear();  // Not ours to remove
+            return false;
+        }
+        if (bound.tcp) {
+            sockaddr_in actual{};
+            socklen_t length = sizeof(actual);
+            getsockname(listenFd, (sockaddr*)&actual, &length);
+            config.address = "tcp:" + std::to_string(ntohs(actual.sin_port));
+        }
+        return true;
+    }
+
+    // The address being served, with the port filled in for tcp:0
+    const std::string& address() const { return config.address; }
+
+    unsigned workerCount() const {
+        return config.workers ? config.workers : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    uint64_t sessionsAccepted() const { return accepted.load(std::memory_order_relaxed); }
+
+    // Serve until stop(). False if it could not start.
+    bool run(std::string& error) {
+        int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            error = std::string("epoll_create1: ") + std::strerror(errno);
+            return false;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        bool watching = epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) == 0;
+        event.data.fd = stopFd;
+        if (!watching || epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event) < 0) {
+            error = std::string("cannot watch the listening socket: ") + std::strerror(errno);
+            ::close(epollFd);
+            return false;
+        }
+
+        for (unsigned i = 0; i < workerCount(); i++) {
+            workers.push_back(std::make_unique<ServerWorker>());
+            if (!workers.back()->open(error)) {
+                ::close(epollFd);
+                workers.clear();
+                return false;
+            }
+        }
+        std::vector<std::thread> threads;
+        for (auto& worker : workers) {
+            threads.emplace_back([&worker] { worker->run(); });
+        }
+
+        size_t next = 0;
+        bool stopped = false;
+        while (!stopped) {
+            epoll_event ready[2];
+            int count = epoll_wait(epollFd, ready, 2, -1);
+            for (int i = 0; i < count; i++) {
+                if (ready[i].data.fd == stopFd) {
+                    stopped = true;
+                } else {
+                    acceptAll(next);
+                }
+            }
+        }
+
+        for (auto& worker : workers) {
+            worker->stop();
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        workers.clear();
+        ::close(epollFd);
+        return true;
+    }
+
+    // Async-signal-safe
+    void stop() {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t ignored = ::write(stopFd, &one, sizeof(one));
+    }
+
+private:
+    ServerConfig config;
+    SocketAddress bound;
+    int listenFd = -1;
+    int stopFd = -1;
+    std::vector<std::unique_ptr<ServerWorker>> workers;
+    std::atomic<uint64_t> accepted{0};
+
+    void acceptAll(size_t& next) {
+        while (true) {
+            int socket = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (socket < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno == EMFILE || errno == ENFILE) {
+                    // Out of descriptors: leave the rest queued for a moment
+                    std::cerr << "Server: " << std::strerror(errno) << "; not accepting for now" << std::endl;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+                return;
+            }
+            if (bound.tcp) {
+                int on = 1;  // Each turn is one small write; don't hold it back
+                setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            uint64_t session = accepted.fetch_add(1, std::memory_order_relaxed);
+            workers[next++ % workers.size()]->adopt(socket, deriveSeed(config.seed, session));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "encounter.h"
+#include "enemy_ai.h"
+#include "game.h"
+#include "journal.h"
+#include "output.h"
+#include "policies.h"
+#include "rng.h"
+#include "trace.h"
+
+struct SimulationConfig {
+    uint64_t battles = 100000;
+    unsigned threads = 0;  // 0 = one per hardware thread
+    int gearChoice = 1;    // Same numbering as the starting gear menu
+    std::string policy = "greedy";
+    int maxTurns = 500;    // Battles still running after this count as timeouts
+    uint64_t seed = 1;     // Battle i plays with deriveSeed(seed, i)
+    std::string journalPath;  // Worker n journals to <journalPath>.<n> when set
+    std::string scriptDir;    // Gear scripts; each worker loads its own engine
+    std::string difficulty = "normal";  // Enemy AI tier; searches run on the worker's thread
+    uint32_t horde = 0;       // Fight generated waves this big instead of the standard three
+    uint64_t hordeBudget = 0;  // Wave threat budget; 0 = the generator's default
+    std::array<unsigned, FACTION_COUNT> factions{1, 1, 1};  // Horde faction mix
+    size_t tableMegabytes = 0;  // Transposition table shared by every worker's search; 0 = none
+    std::string savePath;     // Worker n checkpoints its battle every turn to <savePath>.<n> when set
+};
+
+struct SimulationReport {
+    uint64_t battles = 0;
+    uint64_t wins = 0;
+    uint64_t losses = 0;
+    uint64_t timeouts = 0;
+    uint64_t totalTurns = 0;
+    uint64_t checksum = 0;  // Order-independent digest of every outcome
+    int minTurns = 0;
+    int maxTurns = 0;
+    unsigned threads = 0;
+    double seconds = 0.0;
+    TranspositionTable::Stats table;  // All zero without a table
+    uint64_t tableAnswers = 0;        // Enemy decisions the table made without a search
+    uint64_t journalErrors = 0;       // Failed journal writes, over every worker
+    uint64_t checkpointErrors = 0;    // Failed checkpoints, over every worker
+    
+    void add(uint64_t battle, const BattleResult& result) {
+        checksum += mix64(deriveSeed(battle, result.turns) ^ (result.playerWon ? 1 : result.timedOut ? 2 : 3));
+        if (battles == 0 || result.turns < minTurns) minTurns = result.turns;
+        if (battles == 0 || result.turns > maxTurns) maxTurns = result.turns;
+        battles++;
+        totalTurns += result.turns;
+        if (result.playerWon) {
+            wins++;
+        } else if (result.timedOut) {
+            timeouts++;
+        } else {
+            losses++;
+        }
+    }
+    
+    void merge(const SimulationReport& other) {
+        journalErrors += other.journalErrors;
+        checkpointErrors += other.checkpointErrors;
+        if (other.battles == 0) return;
+        if (battles == 0 || other.minTurns < minTurns) minTurns = other.minTurns;
+        if (battles == 0 || other.maxTurns > maxTurns) maxTurns = other.maxTurns;
+        battles += other.battles;
+        wins += other.wins;
+        losses += other.losses;
+        timeouts += other.timeouts;
+        totalTurns += other.totalTurns;
+        checksum += other.checksum;
+        tableAnswers += other.tableAnswers;
+    }
+    
+    double winRate() const { return battles ? (double)wins / battles : 0.0; }
+    double averageTurns() const { return battles ? (double)totalTurns / battles : 0.0; }
+    double battlesPerSecond() const { return seconds > 0 ? battles / seconds : 0.0; }
+    
+    void print(std::ostream& out) const {
+        out << std::fixed << std::setprecision(2);
+        out << "Battles:      " << battles << " on " << threads << " thread(s)\n";
+        out << "Win rate:     " << winRate() * 100 << "% (" << wins << " won, " << losses << " lost, "
+            << timeouts << " timed out)\n";
+        out << "Turns:        avg " << averageTurns() << ", min " << minTurns << ", max " << maxTurns << "\n";
+        out << "Throughput:   " << battlesPerSecond() << " battles/sec (" << seconds << " s)\n";
+        out << "Checksum:     " << std::hex << checksum << std::dec << "\n";
+        if (table.probes) {
+            out << "Table:        " << table.hitRate() * 100 << "% hits (" << table.hits << " of " << table.probes
+                << " probes), " << tableAnswers << " decisions answered outright\n";
+        }
+        if (journalErrors) out << "Journal:      " << journalErrors << " write(s) failed, journals incomplete\n";
+        if (checkpointErrors) out << "Checkpoints:  " << checkpointErrors << " failed\n";
+    }
+};
+
+// Plays config.battles headless battles spread over worker threads. Workers
+// claim battles in chunks from a shared counter and keep their own tallies,
+// so the only shared write per chunk is one atomic add. Battle seeds depend
+// only on the run seed and battle index, so the report (checksum included)
+// is identical for any thread count, unless the workers share a
+// transposition table: then what each search finds there depends on which
+// battles ran before it.
+inline SimulationReport runSimulation(const SimulationConfig& config) {
+    unsigned threads = config.threads ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+    const uint64_t chunk = 1024;
+    std::atomic<uint64_t> next{0};
+    std::vector<SimulationReport> partials(threads);
+    
+    const Balance* balance = gameBalance;  // Workers play by the caller's table
+    std::unique_ptr<TranspositionTable> table;
+    if (config.tableMegabytes) table = std::make_unique<TranspositionTable>(config.tableMegabytes);
+    auto worker = [&](unsigned id) {
+        Renderer* saved = gameOut;
+        const Balance* savedBalance = gameBalance;
+        gameOut = nullptr;  // Headless: no text at all
+        gameBalance = balance;
+        Journal journal;
+        Journal* savedJournal = combatJournal;
+        if (!config.journalPath.empty()) {
+            if (journal.open(config.journalPath + "." + std::to_string(id))) {
+                combatJournal = &journal;
+            } else {
+                partials[id].journalErrors++;
+            }
+        }
+        // A huge wave can take long enough per battle to be worth resuming
+        // (game --load <savePath>.<n>) if the run dies
+        std::unique_ptr<SnapshotWriter> checkpoint;
+        if (!config.savePath.empty()) {
+            checkpoint = std::make_unique<SnapshotWriter>(config.savePath + "." + std::to_string(id));
+        }
+        ScriptEngine scripts;
+        std::string error;
+        bool scripted = !config.scriptDir.empty() && scripts.load(config.scriptDir, error);
+        auto enemyAi = makeEnemyAi(config.difficulty, 1, true);
+        if (enemyAi) enemyAi->setTable(table.get());
+        SimulationReport& local = partials[id];
+        while (true) {
+            uint64_t begin = next.fetch_add(chunk);
+            if (begin >= config.battles) break;
+            uint64_t end = std::min(begin + chunk, config.battles);
+            for (uint64_t i = begin; i < end; i++) {
+                uint64_t seed = deriveSeed(config.seed, i);
+                auto policy = makePolicy(config.policy, seed);
+                Game game(*policy, config.gearChoice, seed, config.maxTurns);
+                if (scripted) game.setScripts(&scripts);
+                game.setEnemyPolicy(enemyAi.get());
+                game.setAutosave(checkpoint.get());
+                if (config.horde) {
+                    EncounterSpec spec;
+                    spec.seed = seed;
+                    spec.count = config.horde;
+                    spec.budget = config.hordeBudget;
+                    spec.mix = config.factions;
+                    spec.threads = 1;  // The workers already fill the machine
+                    game.createEncounter(spec);
+                }
+                local.add(i, game.run());
+            }
+        }
+        if (enemyAi) local.tableAnswers = enemyAi->getTableAnswers();
+        combatJournal = savedJournal;
+        journal.close();
+        local.journalErrors += journal.getWriteErrors();
+        if (checkpoint) local.checkpointErrors = checkpoint->getFailures();
+        gameOut = saved;
+        gameBalance = savedBalance;
+    };
+    
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) {
+        pool.emplace_back([&worker, i] {
+            TRACE_THREAD_NAME("simulation worker");
+            worker(i);
+        });
+    }
+    worker(0);
+    for (auto& t : pool) {
+        t.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    
+    SimulationReport report;
+    for (const auto& partial : partials) {
+        report.merge(partial);
+    }
+    report.threads = threads;
+    if (table) report.table = table->stats();
+    report.seconds = std::chrono::duration<double>(stop - start).count();
+    return report;
+}
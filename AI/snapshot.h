@@ -0,0 +1,545 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define SNAPSHOT_POSIX 1
+#endif
+
+#include "entity_store.h"
+#include "gear.h"
+#include "mapped_file.h"
+#include "rng.h"
+
+// Snapshot file format, version 2. Native little-endian, fixed layout:
+//
+//   SnapshotHeader
+//   SnapshotSection[sectionCount]
+//   section data, each section 64-byte aligned
+//
+// Each section is one flat array: a raw EntityStore column (field ids come
+// from EntityStore::forEachRawArray), the name records, the gear records,
+// a store's string blob or the player's inventory. Loading maps the file and reads arrays straight
+// out of it; nothing is parsed. The header's checksum covers the whole
+// file, so a save torn part way through fails to load instead of mixing
+// two turns.
+
+constexpr char SNAPSHOT_MAGIC[8] = {'T', 'G', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+constexpr uint32_t SNAPSHOT_ENDIAN_TAG = 0x01020304;
+constexpr size_t SNAPSHOT_ALIGN = 64;
+constexpr size_t SNAPSHOT_BLOCK = 4096;  // Granularity of incremental writes
+
+// Section field ids past the raw columns
+constexpr uint16_t SNAPSHOT_NAMES = 32;
+constexpr uint16_t SNAPSHOT_GEAR = 33;
+constexpr uint16_t SNAPSHOT_STRINGS = 34;
+constexpr uint16_t SNAPSHOT_INVENTORY = 35;  // Party only; optional
+
+struct SnapshotStoreRecord {
+    uint64_t rngKey;
+    uint64_t rngCounter;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint64_t fileSize;
+    uint64_t sequence;  // Bumped by every save to the same file
+    uint32_t sectionCount;
+    uint32_t checksum;  // snapshotChecksum() of the file
+    uint64_t seed;
+    int32_t turn;
+    int32_t maxTurns;
+    uint64_t rngKey;
+    uint64_t rngCounter;
+    uint32_t playerSlot;
+    uint32_t playerGeneration;
+    SnapshotStoreRecord stores[2];  // Party, enemies
+};
+
+struct SnapshotSection {
+    uint16_t store;
+    uint16_t field;
+    uint32_t elementSize;
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct SnapshotName {
+    uint32_t offset;  // Into the store's string blob
+    uint32_t length;
+};
+
+struct SnapshotGear {
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    int32_t healthBonus;
+    int32_t armorBonus;
+    int32_t damageBonus;
+    uint8_t type;
+    uint8_t level;
+    uint16_t abilities;
+};
+
+static_assert(std::is_trivially_copyable_v<SnapshotHeader> && sizeof(SnapshotHeader) == 112);
+static_assert(sizeof(SnapshotSection) == 24);
+static_assert(sizeof(SnapshotGear) == 24);
+
+// The second of the two files a SnapshotWriter alternates between
+inline std::string snapshotAltPath(const std::string& path) {
+    return path + ".b";
+}
+
+// Game state that lives outside the two entity stores.
+struct BattleState {
+    uint64_t seed = 0;
+    int turn = 1;
+    int maxTurns = 0;
+    Rng rng;
+    EntityHandle player;
+    std::vector<uint32_t> inventory;  // The player's stored gear, as party armory ids
+};
+
+// Checksum of a snapshot image, taken with the header's checksum as zero
+inline uint32_t snapshotChecksum(const char* image, size_t size) {
+    SnapshotHeader header;
+    std::memcpy(&header, image, sizeof(header));
+    header.checksum = 0;
+    uint64_t hash = mix64(size);
+    auto add = [&hash](const char* bytes, size_t n) {
+        for (size_t i = 0; i < n; i += 8) {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes + i, std::min<size_t>(8, n - i));
+            hash = mix64(hash ^ word) + 0x9e3779b97f4a7c15ull;
+        }
+    };
+    add(reinterpret_cast<const char*>(&header), sizeof(header));
+    add(image + sizeof(header), size - sizeof(header));
+    return (uint32_t)(hash ^ hash >> 32);
+}
+
+namespace snapshot_detail {
+
+inline size_t alignUp(size_t n) {
+    return (n + SNAPSHOT_ALIGN - 1) & ~(SNAPSHOT_ALIGN - 1);
+}
+
+struct Pending {
+    uint16_t store;
+    uint16_t field;
+    uint32_t elementSize;
+    const void* data;
+    uint64_t count;
+};
+
+// Names and gear flattened for one store; owns the bytes until written.
+struct FlatStore {
+    std::vector<SnapshotName> names;
+    std::vector<SnapshotGear> gear;
+    std::string strings;
+
+    explicit FlatStore(const EntityStore& store) {
+        names.reserve(store.size());
+        for (Name name : store.names) {
+            names.push_back(SnapshotName{(uint32_t)strings.size(), (uint32_t)name.size()});
+            strings += name;
+        }
+        gear.reserve(store.armory.size());
+        for (const auto& g : store.armory) {
+            SnapshotGear record{};
+            record.nameOffset = (uint32_t)strings.size();
+            record.nameLength = (uint32_t)g->name.size();
+            record.healthBonus = g->healthBonus;
+            record.armorBonus = g->armorBonus;
+            record.damageBonus = g->damageBonus;
+            record.type = (uint8_t)g->type;
+            record.level = (uint8_t)g->level;
+            record.abilities = g->abilities.raw();
+            strings += g->name;
+            gear.push_back(record);
+        }
+    }
+};
+
+}  // namespace snapshot_detail
+
+// Lay the whole game out as one snapshot image.
+inline void buildSnapshotImage(std::vector<char>& image, const EntityStore& party, const EntityStore& enemies,
+                               const BattleState& state, uint64_t sequence) {
+    using namespace snapshot_detail;
+    const EntityStore* stores[2] = {&party, &enemies};
+    FlatStore flat[2] = {FlatStore(party), FlatStore(enemies)};
+
+    std::vector<Pending> pending;
+    for (uint16_t s = 0; s < 2; s++) {
+        stores[s]->forEachRawArray([&](int field, const auto& column) {
+            using T = typename std::decay_t<decltype(column)>::value_type;
+            static_assert(std::is_trivially_copyable_v<T>);
+            pending.push_back(Pending{s, (uint16_t)field, sizeof(T), column.data(), column.size()});
+        });
+        pending.push_back(Pending{s, SNAPSHOT_NAMES, sizeof(SnapshotName), flat[s].names.data(), flat[s].names.size()});
+        pending.push_back(Pending{s, SNAPSHOT_GEAR, sizeof(SnapshotGear), flat[s].gear.data(), flat[s].gear.size()});
+        pending.push_back(Pending{s, SNAPSHOT_STRINGS, 1, flat[s].strings.data(), flat[s].strings.size()});
+    }
+    pending.push_back(Pending{0, SNAPSHOT_INVENTORY, sizeof(uint32_t), state.inventory.data(), state.inventory.size()});
+
+    size_t offset = alignUp(sizeof(SnapshotHeader) + pending.size() * sizeof(SnapshotSection));
+    std::vector<SnapshotSection> sections;
+    for (const Pending& p : pending) {
+        sections.push_back(SnapshotSection{p.store, p.field, p.elementSize, offset, p.count});
+        offset = alignUp(offset + p.count * p.elementSize);
+    }
+
+    image.assign(offset, 0);
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.endianTag = SNAPSHOT_ENDIAN_TAG;
+    header.fileSize = offset;
+    header.sequence = sequence;
+    header.sectionCount = (uint32_t)sections.size();
+    header.seed = state.seed;
+    header.turn = state.turn;
+    header.maxTurns = state.maxTurns;
+    header.rngKey = state.rng.getKey();
+    header.rngCounter = state.rng.getCounter();
+    header.playerSlot = state.player.slot;
+    header.playerGeneration = state.player.generation;
+    for (int s = 0; s < 2; s++) {
+        header.stores[s] = SnapshotStoreRecord{stores[s]->rng.getKey(), stores[s]->rng.getCounter()};
+    }
+
+    std::memcpy(image.data(), &header, sizeof(header));
+    std::memcpy(image.data() + sizeof(header), sections.data(), sections.size() * sizeof(SnapshotSection));
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (pending[i].count) {
+            std::memcpy(image.data() + sections[i].offset, pending[i].data, pending[i].count * pending[i].elementSize);
+        }
+    }
+    header.checksum = snapshotChecksum(image.data(), image.size());
+    std::memcpy(image.data(), &header, sizeof(header));
+}
+
+// Read-only view of a snapshot file. The file is memory-mapped and section
+// offsets are resolved against the mapping on open, after which arrays are
+// read in place.
+class SnapshotView {
+public:
+    bool open(const std::string& path, std::string& error) {
+        if (!file.open(path, error)) return false;
+        base = file.data();
+        length = file.size();
+        if (length < sizeof(SnapshotHeader)) {
+            error = path + " is too small to be a snapshot";
+            return false;
+        }
+        return validate(error);
+    }
+
+    const SnapshotHeader& header() const { return *reinterpret_cast<const SnapshotHeader*>(base); }
+
+    // The array stored for (store, field), or nullptr if the section is
+    // missing or has the wrong element size.
+    template <typename T>
+    const T* array(uint16_t store, uint16_t field, uint64_t& count) const {
+        for (const SnapshotSection& section : sections) {
+            if (section.store == store && section.field == field && section.elementSize == sizeof(T)) {
+                count = section.count;
+                return reinterpret_cast<const T*>(base + section.offset);
+            }
+        }
+        count = 0;
+        return nullptr;
+    }
+
+private:
+    MappedFile file;
+    const char* base = nullptr;
+    size_t length = 0;
+    std::vector<SnapshotSection> sections;
+
+    bool validate(std::string& error) {
+        const SnapshotHeader& h = header();
+        if (std::memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0) {
+            error = "not a snapshot file";
+            return false;
+        }
+        if (h.version != SNAPSHOT_VERSION || h.endianTag != SNAPSHOT_ENDIAN_TAG) {
+            error = "unsupported snapshot version or byte order";
+            return false;
+        }
+        size_t tableEnd = sizeof(SnapshotHeader) + (size_t)h.sectionCount * sizeof(SnapshotSection);
+        if (h.fileSize != length || tableEnd > length) {
+            error = "snapshot is truncated";
+            return false;
+        }
+        if (h.checksum != snapshotChecksum(base, length)) {
+            error = "snapshot checksum mismatch (torn or corrupt save)";
+            return false;
+        }
+        sections.resize(h.sectionCount);
+        std::memcpy(sections.data(), base + sizeof(SnapshotHeader), h.sectionCount * sizeof(SnapshotSection));
+        for (const SnapshotSection& section : sections) {
+            if (section.offset % SNAPSHOT_ALIGN != 0 || section.offset > length ||
+                section.count > (length - section.offset) / std::max<uint32_t>(1, section.elementSize)) {
+                error = "snapshot section out of bounds";
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Rebuild one store from a snapshot. Columns are bulk-copied out of the
+// mapping; only names and the armory are rebuilt element by element.
+inline bool restoreStore(const SnapshotView& view, uint16_t s, EntityStore& store, std::string& error) {
+    bool ok = true;
+    store.clear();
+    store.forEachRawArray([&](int field, auto& column) {
+        using T = typename std::decay_t<decltype(column)>::value_type;
+        uint64_t count = 0;
+        const T* data = view.template array<T>(s, (uint16_t)field, count);
+        if (!data) {
+            ok = false;
+            return;
+        }
+        column.assign(data, data + count);
+    });
+
+    uint64_t nameCount = 0, gearCount = 0, stringBytes = 0;
+    const SnapshotName* names = view.array<SnapshotName>(s, SNAPSHOT_NAMES, nameCount);
+    const SnapshotGear* gear = view.array<SnapshotGear>(s, SNAPSHOT_GEAR, gearCount);
+    const char* strings = view.array<char>(s, SNAPSHOT_STRINGS, stringBytes);
+    if (!ok || !names || !gear || !strings || nameCount != store.size()) {
+        error = "snapshot is missing store data";
+        return false;
+    }
+
+    auto text = [&](uint32_t offset, uint32_t length) -> std::string_view {
+        if ((uint64_t)offset + length > stringBytes) {
+            ok = false;
+            return {};
+        }
+        return std::string_view(strings + offset, length);
+    };
+    store.names.reserve(nameCount);
+    for (uint64_t i = 0; i < nameCount; i++) {
+        store.names.push_back(Name::owned(text(names[i].offset, names[i].length)));
+    }
+    for (uint64_t i = 0; i < gearCount; i++) {
+        const SnapshotGear& g = gear[i];
+        auto restored = std::make_shared<Gear>(Name::owned(text(g.nameOffset, g.nameLength)), (GearType)g.type, (GearLevel)g.level);
+        restored->healthBonus = g.healthBonus;
+        restored->armorBonus = g.armorBonus;
+        restored->damageBonus = g.damageBonus;
+        restored->abilities = AbilitySet::fromRaw(g.abilities);
+        store.armory.push_back(std::move(restored));
+    }
+
+    const SnapshotStoreRecord& record = view.header().stores[s];
+    store.rng = Rng::restore(record.rngKey, record.rngCounter);
+
+    size_t rows = store.size();
+    bool consistent = true;
+    store.forEachRawArray([&](int field, const auto& column) {
+        if (field <= 12 && column.size() != rows) consistent = false;  // Dense columns
+    });
+    for (int id : store.gearId) {
+        if (id >= (int)store.armory.size()) consistent = false;
+    }
+    if (!store.slotsConsistent()) consistent = false;
+    if (!ok || !consistent) {
+        error = "snapshot store data is inconsistent";
+        return false;
+    }
+    store.refreshStats();
+    return true;
+}
+
+// Load one snapshot file's contents into the given stores and state.
+// Nothing is touched unless the whole file loads cleanly.
+inline bool loadSnapshotView(const SnapshotView& view, EntityStore& party, EntityStore& enemies, BattleState& state,
+                             std::string& error) {
+    EntityStore loaded[2];
+    for (uint16_t s = 0; s < 2; s++) {
+        if (!restoreStore(view, s, loaded[s], error)) return false;
+    }
+
+    const SnapshotHeader& h = view.header();
+    BattleState restored;
+    restored.seed = h.seed;
+    restored.turn = h.turn;
+    restored.maxTurns = h.maxTurns;
+    restored.rng = Rng::restore(h.rngKey, h.rngCounter);
+    restored.player = EntityHandle{h.playerSlot, h.playerGeneration};
+    if (!loaded[0].contains(restored.player)) {
+        error = "snapshot has no player";
+        return false;
+    }
+    uint64_t itemCount = 0;
+    if (const uint32_t* items = view.array<uint32_t>(0, SNAPSHOT_INVENTORY, itemCount)) {
+        restored.inventory.assign(items, items + itemCount);
+    }
+    for (uint32_t id : restored.inventory) {
+        if (id >= loaded[0].armory.size()) {
+            error = "snapshot inventory refers to missing gear";
+            return false;
+        }
+    }
+
+    party = std::move(loaded[0]);
+    enemies = std::move(loaded[1]);
+    state = std::move(restored);
+    return true;
+}
+
+// Load the newest checkpoint a SnapshotWriter left at `path`: of the two
+// files it alternates between, the one with the higher sequence that
+// loads cleanly (the other, if the newest was torn by a crash).
+inline bool loadSnapshot(const std::string& path, EntityStore& party, EntityStore& enemies, BattleState& state,
+                         std::string& error) {
+    SnapshotView views[2];
+    std::string errors[2];
+    bool opened[2] = {views[0].open(path, errors[0]), views[1].open(snapshotAltPath(path), errors[1])};
+    int newest = opened[1] && (!opened[0] || views[1].header().sequence > views[0].header().sequence);
+    for (int v : {newest, newest ^ 1}) {
+        if (opened[v] && loadSnapshotView(views[v], party, enemies, state, errors[v])) return true;
+    }
+    error = errors[opened[newest] ? newest : 0];
+    return false;
+}
+
+// Writes snapshots of one game, alternating between two files: the path
+// given and snapshotAltPath() of it. Each file's first save writes it whole
+// under a temporary name and renames it into place. Later saves with the
+// same layout (same entity counts) compare against what that file last
+// held and rewrite only the 4 KiB blocks that changed, header block last.
+// A typical turn touches a few health columns, so checkpointing a huge
+// battle costs a few pages, and a save cut short by a crash only ever
+// tears one file: the other still holds the previous checkpoint, and
+// loadSnapshot takes the newest file that checks out.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(std::string file) {
+        slots[0].path = file;
+        slots[1].path = snapshotAltPath(file);
+    }
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    ~SnapshotWriter() {
+#ifdef SNAPSHOT_POSIX
+        for (Slot& slot : slots) {
+            if (slot.fd >= 0) ::close(slot.fd);
+        }
+#endif
+    }
+
+    bool save(const EntityStore& party, const EntityStore& enemies, const BattleState& state) {
+        stage(party, enemies, state);
+        return flush();
+    }
+
+    // save() in two halves: capture the battle now (memory only), write it
+    // out later. Staging again before a flush replaces the staged image.
+    void stage(const EntityStore& party, const EntityStore& enemies, const BattleState& state) {
+        buildSnapshotImage(image, party, enemies, state, ++sequence);
+        staged = true;
+    }
+
+    bool flush() {
+        if (!staged) return true;
+        staged = false;
+        Slot& slot = slots[next];
+        bool ok = (slot.written.size() == image.size() && writeChangedBlocks(slot)) || writeWholeFile(slot);
+        if (ok) {
+            if (!started) {
+                // Whatever the other file holds is from an earlier run, older than this
+                std::remove(slots[next ^ 1].path.c_str());
+                started = true;
+            }
+            slot.written.swap(image);
+            next ^= 1;
+        } else {
+            slot.written.clear();  // The file no longer matches it; the next save rewrites the whole file
+            failures++;
+        }
+        return ok;
+    }
+
+    bool hasStaged() const { return staged; }
+
+    const std::string& getPath() const { return slots[0].path; }
+    uint64_t getBytesWritten() const { return bytesWritten; }  // By the last save
+    uint64_t getFailures() const { return failures; }          // Saves that failed, ever
+
+private:
+    struct Slot {
+        std::string path;
+        std::vector<char> written;  // What the file holds; empty when unknown
+        int fd = -1;
+    };
+
+    Slot slots[2];
+    int next = 0;          // The slot the next save goes to
+    bool started = false;  // A save has succeeded
+    std::vector<char> image;
+    uint64_t sequence = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t failures = 0;
+    bool staged = false;
+
+    bool writeChangedBlocks(Slot& slot) {
+#ifdef SNAPSHOT_POSIX
+        if (slot.fd < 0) return false;
+        bytesWritten = 0;
+        for (size_t offset = SNAPSHOT_BLOCK; offset < image.size(); offset += SNAPSHOT_BLOCK) {
+            size_t size = std::min(SNAPSHOT_BLOCK, image.size() - offset);
+            if (std::memcmp(image.data() + offset, slot.written.data() + offset, size) == 0) continue;
+            if (!writeAt(slot, offset, size)) return false;
+        }
+        return writeAt(slot, 0, std::min(SNAPSHOT_BLOCK, image.size()));
+#else
+        (void)slot;
+        return false;
+#endif
+    }
+
+    bool writeWholeFile(Slot& slot) {
+        std::string temp = slot.path + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out.write(image.data(), image.size());
+            if (!out) return false;
+        }
+        if (std::rename(temp.c_str(), slot.path.c_str()) != 0) return false;
+        bytesWritten = image.size();
+#ifdef SNAPSHOT_POSIX
+        if (slot.fd >= 0) ::close(slot.fd);
+        slot.fd = ::open(slot.path.c_str(), O_WRONLY);
+#endif
+        return true;
+    }
+
+#ifdef SNAPSHOT_POSIX
+    bool writeAt(Slot& slot, size_t offset, size_t size) {
+        if (pwrite(slot.fd, image.data() + offset, size, (off_t)offset) != (ssize_t)size) return false;
+        bytesWritten += size;
+        return true;
+    }
+#endif
+};
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "entity_store.h"
+#include "journal.h"
+#include "output.h"
+
+// Every status effect in the game.
+enum class StatusId : uint8_t {
+    POISON,
+    RESTRAIN,
+    COUNT
+};
+
+constexpr int STATUS_COUNT = (int)StatusId::COUNT;
+
+// What applying a status to someone who already has it does.
+enum class Stacking : uint8_t {
+    REPLACE,  // The new duration replaces what is left
+    LONGEST,  // Whichever lasts longer
+    EXTEND,   // The new duration is added to what is left
+    STACK,    // One more stack, up to maxStacks, and the new duration; ticks hit once per stack
+};
+
+// A status effect as data. A periodic status (period > 0) ticks at the
+// start of a turn every `period` turns and lasts that many ticks; one that
+// skips turns lasts that many of its bearer's turns instead. Either way the
+// turns left are mirrored into a store column (get/set), which is what the
+// rules, scripts, status panels and snapshots read.
+struct StatusInfo {
+    const char* name;       // Status panels: "Poisoned"
+    const char* adjective;  // Messages: "restrained"
+    const char* key;        // Scripts
+    Color color;
+    Stacking stacking;
+    int maxStacks;
+    int period;             // Turns between ticks, 0 for none
+    int tickDamage;         // Per stack and tick
+    bool skipsTurn;         // Each of the bearer's turns is lost, using up one
+    EventType appliedEvent;
+    EventType tickEvent;    // Periodic statuses
+    EventType usedEvent;    // Turn-skipping statuses
+    const char* endText;    // After the bearer's name when the last tick wears it off
+    int (*get)(const EntityStore&, uint32_t);
+    void (*set)(EntityStore&, uint32_t, int);
+};
+
+inline constexpr std::array<StatusInfo, STATUS_COUNT> statusTable = {{
+    {"Poisoned", "poisoned", "poison", Color::GREEN, Stacking::REPLACE, 1, 1, 5, false,
+     EventType::POISONED, EventType::POISON_TICK, EventType::COUNT, " is no longer poisoned!",
+     [](const EntityStore& s, uint32_t i) { return s.poisonTurns[i]; },
+     [](EntityStore& s, uint32_t i, int turns) { s.setPoisonTurns(i, turns); }},
+    {"Restrained", "restrained", "restrain", Color::MAGENTA, Stacking::REPLACE, 1, 0, 0, true,
+     EventType::RESTRAINED, EventType::COUNT, EventType::RESTRAINT_USED, "",
+     [](const EntityStore& s, uint32_t i) { return (int)s.restrained[i]; },
+     [](EntityStore& s, uint32_t i, int turns) { s.setRestrained(i, (uint8_t)std::min(turns, 255)); }},
+}};
+
+constexpr const StatusInfo& statusInfo(StatusId id) {
+    return statusTable[(int)id];
+}
+
+// Hierarchical timing wheel keyed by turn: 64 one-turn slots, 64 slots of
+// 64 turns, 64 slots of 4096 turns, and an overflow list past that.
+// Scheduling is O(1), and advancing a turn touches only the timers due
+// then, plus now and again one coarse slot cascading into finer ones.
+// Timers are never cancelled; their owner ignores the ones it no longer
+// wants when they come due.
+class TurnWheel {
+public:
+    struct Timer {
+        uint32_t item;
+        uint32_t tag;  // Owner's check that the timer is still wanted
+        int turn;
+    };
+
+    TurnWheel() { reset(0); }
+
+    // Empty the wheel; the next turn to come due is `turn`.
+    void reset(int turn) {
+        nodes.clear();
+        freeNodes.clear();
+        for (auto& level : heads) level.fill(NONE);
+        overflow = NONE;
+        next = turn;
+    }
+
+    // A timer for a turn already passed comes due on the next advance.
+    void schedule(const Timer& timer) {
+        uint32_t node;
+        if (!freeNodes.empty()) {
+            node = freeNodes.back();
+            freeNodes.pop_back();
+            nodes[node].timer = timer;
+        } else {
+            node = (uint32_t)nodes.size();
+            nodes.push_back(Node{timer, NONE});
+        }
+        link(node);
+    }
+
+    // Append every timer due up to and including `turn` to `due`.
+    void advance(int turn, std::vector<Timer>& due) {
+        for (; next <= turn; next++) {
+            int t = next;
+            if ((t & (SPAN[2] - 1)) == 0) relink(std::exchange(overflow, NONE));
+            if ((t & (SPAN[1] - 1)) == 0) relink(std::exchange(heads[2][(t >> (2 * BITS)) & MASK], NONE));
+            if ((t & (SPAN[0] - 1)) == 0) relink(std::exchange(heads[1][(t >> BITS) & MASK], NONE));
+            for (uint32_t node = std::exchange(heads[0][t & MASK], NONE); node != NONE;) {
+                uint32_t following = nodes[node].next;
+                due.push_back(nodes[node].timer);
+                freeNodes.push_back(node);
+                node = following;
+            }
+        }
+    }
+
+private:
+    static constexpr int BITS = 6;
+    static constexpr int SLOTS = 1 << BITS;
+    static constexpr int MASK = SLOTS - 1;
+    static constexpr int LEVELS = 3;
+    static constexpr int SPAN[LEVELS] = {SLOTS, SLOTS * SLOTS, SLOTS * SLOTS * SLOTS};  // Turns each level covers
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Node {
+        Timer timer;
+        uint32_t next;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    std::array<std::array<uint32_t, SLOTS>, LEVELS> heads;
+    uint32_t overflow = NONE;
+    int next = 0;
+
+    // File a node by how far off it is: within a level's span, it goes in
+    // that level's slot for its turn.
+    void link(uint32_t node) {
+        int turn = std::max(nodes[node].timer.turn, next);
+        int delta = turn - next;
+        uint32_t* head = &overflow;
+        for (int level = 0; level < LEVELS; level++) {
+            if (delta < SPAN[level]) {
+                head = &heads[level][(turn >> (level * BITS)) & MASK];
+                break;
+            }
+        }
+        nodes[node].next = *head;
+        *head = node;
+    }
+
+    void relink(uint32_t node) {
+        while (node != NONE) {
+            uint32_t following = nodes[node].next;
+            link(node);
+            node = following;
+        }
+    }
+};
+
+// A periodic status due to tick, as handed out by StatusEffects::dueAt.
+struct StatusTick {
+    uint8_t side;
+    uint32_t index;  // Dense row in that side's store
+    StatusId id;
+    int stacks;
+    uint32_t instance;
+};
+
+// Every status on every combatant of a battle, with the rules for
+// applying, ticking and using them up. Only active statuses are stored,
+// so a turn's ticks cost one wheel slot plus the statuses actually due,
+// not a pass over every combatant. Statuses follow their bearer by
+// EntityHandle; ones whose bearer has left the store are dropped when
+// next touched. Stores are passed in rather than held, so a copy of a
+// battle (search rollouts) copies this as plain data.
+class StatusEffects {
+public:
+    // Give a row a status for `duration` (ticks, or turns to skip) during
+    // `turn`, by the status's stacking rule. Returns the duration now left.
+    int apply(EntityStore& store, uint32_t index, StatusId id, int duration, int turn) {
+        const StatusInfo& info = statusInfo(id);
+        uint32_t k = find(store, index, id);
+        if (k == NONE) {
+            if (duration <= 0) return 0;
+            k = create(store, index, id);
+            instances[k].remaining = duration;
+            if (info.period > 0) schedule(k, turn + info.period);
+        } else {
+            Instance& status = instances[k];
+            switch(info.stacking) {
+                case Stacking::REPLACE: status.remaining = duration; break;
+                case Stacking::LONGEST: status.remaining = std::max(status.remaining, duration); break;
+                case Stacking::EXTEND: status.remaining += duration; break;
+                case Stacking::STACK:
+                    status.stacks = std::min(status.stacks + 1, info.maxStacks);
+                    status.remaining = duration;
+                    break;
+            }
+        }
+        int remaining = instances[k].remaining;
+        info.set(store, index, std::max(0, remaining));
+        if (remaining <= 0) release(k);
+        return std::max(0, remaining);
+    }
+
+    void remove(EntityStore& store, uint32_t index, StatusId id) {
+        uint32_t k = find(store, index, id);
+        if (k != NONE) release(k);
+        statusInfo(id).set(store, index, 0);
+    }
+
+    // Whether a status costs this row its turn. If one does, one of its
+    // turns is used up and it is returned; otherwise nullptr.
+    const StatusInfo* skipTurn(EntityStore& store, uint32_t index) {
+        for (int s = 0; s < STATUS_COUNT; s++) {
+            const StatusInfo& info = statusTable[s];
+            if (!info.skipsTurn || info.get(store, index) <= 0) continue;
+            uint32_t k = find(store, index, (StatusId)s);
+            int left = info.get(store, index) - 1;
+            if (k != NONE) {
+                left = --instances[k].remaining;
+                if (left <= 0) release(k);
+            }
+            info.set(store, index, std::max(0, left));
+            return &info;
+        }
+        return nullptr;
+    }
+
+    // Periodic statuses due at the start of `turn`, ordered by side, row
+    // and status so the order never depends on when each was applied.
+    // Call tick() for each; the list is valid until the next call.
+    const std::vector<StatusTick>& dueAt(int turn, const EntityStore& party, const EntityStore& enemies) {
+        dueTimers.clear();
+        ticks.clear();
+        wheel.advance(turn, dueTimers);
+        const EntityStore* stores[] = {&party, &enemies};
+        for (const TurnWheel::Timer& timer : dueTimers) {
+            Instance& status = instances[timer.item];
+            if (!status.live || status.generation != timer.tag) continue;
+            const EntityStore& store = *stores[status.side];
+            if (!store.contains(status.bearer)) {
+                release(timer.item);  // Bearer is gone
+                continue;
+            }
+            ticks.push_back(StatusTick{status.side, store.indexOf(status.bearer), status.id, status.stacks, timer.item});
+        }
+        std::sort(ticks.begin(), ticks.end(), [](const StatusTick& a, const StatusTick& b) {
+            if (a.side != b.side) return a.side < b.side;
+            if (a.index != b.index) return a.index < b.index;
+            return a.id < b.id;
+        });
+        return ticks;
+    }
+
+    // Count one tick of a due status. Returns the ticks left; at 0 the
+    // status has worn off.
+    int tick(EntityStore& store, const StatusTick& due, int turn) {
+        const StatusInfo& info = statusInfo(due.id);
+        int left = --instances[due.instance].remaining;
+        info.set(store, due.index, std::max(0, left));
+        if (left <= 0) {
+            release(due.instance);
+        } else {
+            schedule(due.instance, turn + info.period);
+        }
+        return std::max(0, left);
+    }
+
+    // Rebuild from the store columns (after loading a snapshot, which is
+    // taken at the start of `turn`, before that turn's ticks).
+    void restore(const EntityStore& party, const EntityStore& enemies, int turn) {
+        clear(turn);
+        for (const EntityStore* store : {&party, &enemies}) {
+            for (uint32_t i = 0; i < store->size(); i++) {
+                for (int s = 0; s < STATUS_COUNT; s++) {
+                    const StatusInfo& info = statusTable[s];
+                    int remaining = info.get(*store, i);
+                    if (remaining <= 0) continue;
+                    uint32_t k = create(*store, i, (StatusId)s);
+                    instances[k].remaining = remaining;
+                    if (info.period > 0) schedule(k, turn);
+                }
+            }
+        }
+    }
+
+    void clear(int turn = 0) {
+        instances.clear();
+        freeInstances.clear();
+        for (auto& side : lookup) side.clear();
+        wheel.reset(turn);
+        active = 0;
+    }
+
+    // Statuses in force, counting any whose bearer has left but that
+    // have not been touched since
+    size_t size() const { return active; }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Instance {
+        EntityHandle bearer;
+        uint8_t side = 0;
+        StatusId id = StatusId::POISON;
+        bool live = false;
+        int stacks = 1;
+        int remaining = 0;
+        uint32_t generation = 0;  // Bumped on release, so stale timers miss
+    };
+
+    std::vector<Instance> instances;
+    std::vector<uint32_t> freeInstances;
+    std::vector<uint32_t> lookup[2];  // Per side: [entity slot * STATUS_COUNT + id] -> instance, NONE if none
+    TurnWheel wheel;
+    size_t active = 0;
+    std::vector<TurnWheel::Timer> dueTimers;  // Scratch for dueAt
+    std::vector<StatusTick> ticks;
+
+    uint32_t& lookupEntry(uint8_t side, uint32_t slot, StatusId id) {
+        std::vector<uint32_t>& table = lookup[side];
+        size_t at = (size_t)slot * STATUS_COUNT + (size_t)id;
+        if (at >= table.size()) table.resize(at + STATUS_COUNT, NONE);
+        return table[at];
+    }
+
+    // The row's instance of a status, or NONE. An instance left behind by
+    // an earlier occupant of the same slot is dropped on the way.
+    uint32_t find(const EntityStore& store, uint32_t index, StatusId id) {
+        EntityHandle bearer = store.handleAt(index);
+        uint32_t& entry = lookupEntry(store.side, bearer.slot, id);
+        if (entry == NONE) return NONE;
+        if (instances[entry].bearer == bearer) return entry;
+        release(entry);
+        return NONE;
+    }
+
+    uint32_t create(const EntityStore& store, uint32_t index, StatusId id) {
+        uint32_t k;
+        if (!freeInstances.empty()) {
+            k = freeInstances.back();
+            freeInstances.pop_back();
+        } else {
+            k = (uint32_t)instances.size();
+            instances.emplace_back();
+        }
+        Instance& status = instances[k];
+        status.bearer = store.handleAt(index);
+        status.side = store.side;
+        status.id = id;
+        status.live = true;
+        status.stacks = 1;
+        status.remaining = 0;
+        lookupEntry(store.side, status.bearer.slot, id) = k;
+        active++;
+        return k;
+    }
+
+    void release(uint32_t k) {
+        Instance& status = instances[k];
+        if (!status.live) return;
+        uint32_t& entry = lookupEntry(status.side, status.bearer.slot, status.id);
+        if (entry == k) entry = NONE;
+        status.live = false;
+        status.generation++;
+        freeInstances.push_back(k);
+        active--;
+    }
+
+    void schedule(uint32_t k, int turn) {
+        wheel.schedule(TurnWheel::Timer{k, instances[k].generation, turn});
+    }
+};
@@ -0,0 +1,297 @@
+#pragma once
+
+// Hot-path instrumentation: scoped zone timers and named counters, kept in
+// per-thread buffers and exported as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev).
+//
+// Everything here is compiled in only with -DTERMINAL_GAME_TRACE (the
+// TERMINAL_GAME_TRACE CMake option). Without it the macros expand to
+// nothing and none of the code below exists, so release builds pay
+// nothing at all.
+//
+//   TRACE_ZONE("enemy turns");          // Times the rest of the scope
+//   TRACE_COUNT("damage events", 1);    // Adds to a counter
+//   TRACE_TURN();                       // Turn boundary: counters go out, then reset
+//   TRACE_THREAD_NAME("sim worker");    // Label this thread in the viewer
+//   TRACE_ALLOCATION_HOOK()             // Once per program, at file scope:
+//                                       // counts heap allocations
+//   TRACE_MUTE();                       // Record nothing for the rest of the scope
+//
+// Names must be string literals (or otherwise outlive the trace); buffers
+// keep the pointers. Each thread writes only its own buffer, so recording
+// takes no locks; export once the threads being traced are done or idle.
+
+#ifdef TERMINAL_GAME_TRACE
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace trace {
+
+inline uint64_t nowNs() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch)
+        .count();
+}
+
+struct ZoneEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+struct CounterEvent {
+    const char* name;
+    uint64_t time;
+    int64_t value;
+};
+
+// One thread's recordings. Capped, so a long session or farm run cannot
+// eat the machine; what didn't fit is counted instead.
+struct ThreadBuffer {
+    static constexpr size_t MAX_EVENTS = 1u << 20;
+
+    uint32_t tid = 0;
+    std::string name;
+    std::vector<ZoneEvent> zones;
+    std::vector<CounterEvent> samples;
+    std::vector<std::pair<const char*, int64_t>> counters;  // Running totals this turn
+    uint64_t dropped = 0;
+
+    void zone(const char* zoneName, uint64_t start, uint64_t end) {
+        if (zones.size() >= MAX_EVENTS) {
+            dropped++;
+            return;
+        }
+        zones.push_back(ZoneEvent{zoneName, start, end - start});
+    }
+
+    void count(const char* counterName, int64_t delta) {
+        for (auto& counter : counters) {
+            if (counter.first == counterName) {
+                counter.second += delta;
+                return;
+            }
+        }
+        counters.emplace_back(counterName, delta);
+    }
+
+    // Sample every counter and start the next turn from zero.
+    void turn() {
+        uint64_t time = nowNs();
+        for (auto& counter : counters) {
+            if (samples.size() >= MAX_EVENTS) {
+                dropped++;
+            } else {
+                samples.push_back(CounterEvent{counter.first, time, counter.second});
+            }
+            counter.second = 0;
+        }
+    }
+};
+
+// Every thread's buffer, for export. Buffers stay registered after their
+// thread exits so a simulation's workers can be exported once joined.
+class Registry {
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    std::shared_ptr<ThreadBuffer> add() {
+        auto buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer->tid = nextTid++;
+        buffers.push_back(buffer);
+        return buffer;
+    }
+
+    // Write everything recorded so far as Chrome trace JSON.
+    bool writeChromeTrace(const std::string& path) {
+        FILE* out = std::fopen(path.c_str(), "w");
+        if (!out) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", out);
+        bool first = true;
+        auto separator = [&] {
+            if (!first) std::fputs(",\n", out);
+            first = false;
+        };
+        for (const auto& buffer : buffers) {
+            if (!buffer->name.empty()) {
+                separator();
+                std::fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                             buffer->tid);
+                writeString(out, buffer->name.c_str());
+                std::fputs("}}", out);
+            }
+            for (const ZoneEvent& zone : buffer->zones) {
+                separator();
+                std::fputs("{\"name\":", out);
+                writeString(out, zone.name);
+                std::fprintf(out, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buffer->tid,
+                             zone.start / 1000.0, zone.duration / 1000.0);
+            }
+            for (const CounterEvent& sample : buffer->samples) {
+                separator();
+                std::fputs("{\"name\":", out);
+                writeString(out, sample.name);
+                std::fprintf(out, ",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                             buffer->tid, sample.time / 1000.0, (long long)sample.value);
+            }
+            if (buffer->dropped) {
+                separator();
+                std::fprintf(out,
+                             "{\"name\":\"trace events dropped\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,"
+                             "\"ts\":0,\"args\":{\"count\":%llu}}",
+                             buffer->tid, (unsigned long long)buffer->dropped);
+            }
+        }
+        std::fputs("\n]}\n", out);
+        return std::fclose(out) == 0;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& buffer : buffers) {
+            buffer->zones.clear();
+            buffer->samples.clear();
+            buffer->counters.clear();
+            buffer->dropped = 0;
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    uint32_t nextTid = 1;
+
+    static void writeString(FILE* out, const char* text) {
+        std::fputc('"', out);
+        for (const char* c = text; *c; c++) {
+            if (*c == '"' || *c == '\\') std::fputc('\\', out);
+            std::fputc(*c, out);
+        }
+        std::fputc('"', out);
+    }
+};
+
+inline ThreadBuffer& local() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = Registry::instance().add();
+    return *buffer;
+}
+
+// Set while a thread records nothing (TRACE_MUTE)
+inline thread_local bool muted = false;
+
+// Set while the tracer itself is working, so the allocations it makes
+// (creating this thread's buffer, growing it) are not counted.
+inline thread_local bool inTracer = false;
+
+class TracerScope {
+public:
+    TracerScope() : saved(std::exchange(inTracer, true)) {}
+    ~TracerScope() { inTracer = saved; }
+
+private:
+    bool saved;
+};
+
+// Out of line so the compiler doesn't pair the free() with the new-
+// expressions it would otherwise be inlined into, and warn about it.
+[[gnu::noinline]] inline void release(void* p) noexcept {
+    std::free(p);
+}
+
+inline void countAllocation() {
+    if (inTracer || muted) return;
+    TracerScope scope;
+    local().count("allocations", 1);
+}
+
+class Zone {
+public:
+    explicit Zone(const char* zoneName) : name(muted ? nullptr : zoneName), start(name ? nowNs() : 0) {}
+    ~Zone() {
+        if (!name) return;
+        uint64_t end = nowNs();
+        TracerScope scope;
+        local().zone(name, start, end);
+    }
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+class Mute {
+public:
+    Mute() : saved(std::exchange(muted, true)) {}
+    ~Mute() { muted = saved; }
+    Mute(const Mute&) = delete;
+    Mute& operator=(const Mute&) = delete;
+
+private:
+    bool saved;
+};
+
+inline void count(const char* name, int64_t delta) {
+    if (muted) return;
+    TracerScope scope;
+    local().count(name, delta);
+}
+
+inline void turn() {
+    if (muted) return;
+    TracerScope scope;
+    local().turn();
+}
+
+inline void nameThread(const char* label) {
+    TracerScope scope;
+    local().name = label;
+}
+
+inline bool writeChromeTrace(const std::string& path) {
+    return Registry::instance().writeChromeTrace(path);
+}
+
+}  // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) ::trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_COUNT(name, delta) ::trace::count(name, delta)
+#define TRACE_TURN() ::trace::turn()
+#define TRACE_MUTE() ::trace::Mute TRACE_CONCAT(traceMute, __LINE__)
+#define TRACE_THREAD_NAME(label) ::trace::nameThread(label)
+#define TRACE_ALLOCATION_HOOK()                                                \
+    void* operator new(std::size_t size) {                                     \
+        ::trace::countAllocation();                                            \
+        if (void* p = std::malloc(size ? size : 1)) return p;                  \
+        throw std::bad_alloc();                                                \
+    }                                                                          \
+    void operator delete(void* p) noexcept { ::trace::release(p); }            \
+    void operator delete(void* p, std::size_t) noexcept { ::trace::release(p); }
+
+#else
+
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_COUNT(name, delta) ((void)0)
+#define TRACE_TURN() ((void)0)
+#define TRACE_MUTE() ((void)0)
+#define TRACE_THREAD_NAME(label) ((void)0)
+#define TRACE_ALLOCATION_HOOK()
+
+#endif
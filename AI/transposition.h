@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "game.h"
+
+// What searching one position found: for each enemy action, how many
+// rollouts tried it and the sum of their results (enemies' point of view,
+// each 0..1), as in the search tree's nodes.
+struct OutcomeEstimate {
+    uint32_t visits[ENEMY_ACTION_COUNT] = {};
+    double score[ENEMY_ACTION_COUNT] = {};
+
+    uint64_t totalVisits() const {
+        uint64_t total = 0;
+        for (uint32_t v : visits) total += v;
+        return total;
+    }
+
+    // Pool another estimate of the same position into this one
+    void merge(const OutcomeEstimate& other) {
+        for (int a = 0; a < ENEMY_ACTION_COUNT; a++) {
+            visits[a] += other.visits[a];
+            score[a] += other.score[a];
+        }
+    }
+};
+
+// Fixed-size, lock-free cache of outcome estimates keyed by position hash
+// (Game::stateHash), shared by any number of searching threads.
+//
+// An entry is four atomic words: each action's visits and mean result
+// packed into one word (a 32-bit fraction, so pooled scores come back
+// very slightly rounded), plus a check word holding the key XORed with the other
+// three (the lockless hashing trick). A reader that catches a write half
+// done sees a check that doesn't add up and takes it as a miss, so nobody
+// waits and a torn entry is never returned. Writers always replace: the
+// newest estimate of a slot wins.
+class TranspositionTable {
+public:
+    struct Stats {
+        uint64_t probes = 0;
+        uint64_t hits = 0;
+        uint64_t stores = 0;
+
+        double hitRate() const { return probes ? (double)hits / probes : 0.0; }
+    };
+
+    // Rounded down to a power-of-two number of entries, at least one
+    explicit TranspositionTable(size_t megabytes) {
+        size_t wanted = std::max<size_t>(1, megabytes * 1024 * 1024 / sizeof(Entry));
+        size_t count = 1;
+        while (count * 2 <= wanted) count *= 2;
+        entries = std::make_unique<Entry[]>(count);
+        mask = count - 1;
+    }
+
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    bool probe(uint64_t key, OutcomeEstimate& estimate) {
+        probes.fetch_add(1, std::memory_order_relaxed);
+        const Entry& entry = entries[key & mask];
+        uint64_t words[ENEMY_ACTION_COUNT];
+        uint64_t check = key;
+        for (int a = 0; a < ENEMY_ACTION_COUNT; a++) {
+            words[a] = entry.data[a].load(std::memory_order_relaxed);
+            check ^= words[a];
+        }
+        if (entry.check.load(std::memory_order_relaxed) != check) return false;
+        OutcomeEstimate found;
+        for (int a = 0; a < ENEMY_ACTION_COUNT; a++) {
+            found.visits[a] = (uint32_t)(words[a] >> 32);
+            found.score[a] = found.visits[a] * ((uint32_t)words[a] / (double)UINT32_MAX);
+        }
+        if (found.totalVisits() == 0) return false;  // Empty slot (or key 0)
+        estimate = found;
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void store(uint64_t key, const OutcomeEstimate& estimate) {
+        stores.fetch_add(1, std::memory_order_relaxed);
+        Entry& entry = entries[key & mask];
+        uint64_t check = key;
+        for (int a = 0; a < ENEMY_ACTION_COUNT; a++) {
+            double mean = estimate.visits[a] ? std::clamp(estimate.score[a] / estimate.visits[a], 0.0, 1.0) : 0.0;
+            uint64_t word = (uint64_t)estimate.visits[a] << 32 | (uint32_t)std::llround(mean * UINT32_MAX);
+            entry.data[a].store(word, std::memory_order_relaxed);
+            check ^= word;
+        }
+        entry.check.store(check, std::memory_order_relaxed);
+    }
+
+    // Forget every entry and zero the counters. Not safe while others
+    // probe or store.
+    void clear() {
+        for (size_t i = 0; i <= mask; i++) {
+            entries[i].check.store(0, std::memory_order_relaxed);
+            for (auto& word : entries[i].data) word.store(0, std::memory_order_relaxed);
+        }
+        probes = 0;
+        hits = 0;
+        stores = 0;
+    }
+
+    Stats stats() const {
+        Stats s;
+        s.probes = probes.load(std::memory_order_relaxed);
+        s.hits = hits.load(std::memory_order_relaxed);
+        s.stores = stores.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct alignas(32) Entry {
+        std::atomic<uint64_t> check{0};
+        std::atomic<uint64_t> data[ENEMY_ACTION_COUNT] = {};
+    };
+    static_assert(sizeof(Entry) == 32, "two entries to a cache line");
+
+    std::unique_ptr<Entry[]> entries;
+    size_t mask = 0;
+
+    // Counters on their own cache lines, away from each other and the table
+    alignas(64) std::atomic<uint64_t> probes{0};
+    alignas(64) std::atomic<uint64_t> hits{0};
+    alignas(64) std::atomic<uint64_t> stores{0};
+};
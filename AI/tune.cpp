@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "balance.h"
+#include "enemy_ai.h"
+#include "game.h"
+#include "policies.h"
+#include "rng.h"
+#include "simulator.h"
+
+using namespace std;
+
+// Balance tuning: sweeps balance parameters over grids of values and plays
+// headless battles against the standard enemy roster for every resulting
+// table, all cores at once. Prints one CSV row per table (the win-rate and
+// turn-length surfaces), plus a grid of each when exactly two parameters
+// are swept.
+//
+//   tune --param sword.damage=10:30:5 --param god.health=0,30,60 [options]
+//
+// Every table plays the same battle seeds, so differences between rows
+// come from the balance and not from luck. A table stops early once its
+// win rate is known to within --precision (95% interval), or, with
+// --target, once it is clearly off target. Finished tables are appended to
+// --cache and skipped when a later sweep asks for them again.
+
+// Part of every cache key. Bump it whenever a change to the combat rules,
+// the enemy roster or the policies would change results for the same
+// balance table, so old cache entries stop matching.
+constexpr uint64_t RULES_VERSION = 1;
+
+struct Axis {
+    const BalanceParam* param;
+    vector<double> values;
+};
+
+struct TuneOptions {
+    int gearChoice = 1;
+    string policy = "greedy";
+    string difficulty = "normal";
+    unsigned threads = 0;
+    uint64_t seed = 1;
+    int maxTurns = 500;
+    uint64_t batch = 256;
+    uint64_t maxBattles = 20000;
+    double precision = 0.01;
+    double target = -1.0;  // Win rate to aim for, < 0 for none
+    string cachePath = "tune.cache";
+};
+
+struct TuneResult {
+    uint64_t battles = 0;
+    uint64_t wins = 0;
+    uint64_t timeouts = 0;
+    uint64_t totalTurns = 0;
+    bool cached = false;
+
+    double winRate() const { return battles ? (double)wins / battles : 0.0; }
+    double averageTurns() const { return battles ? (double)totalTurns / battles : 0.0; }
+
+    // Wilson score interval at 95%
+    pair<double, double> interval() const {
+        if (battles == 0) return {0.0, 1.0};
+        const double z = 1.96;
+        double n = (double)battles;
+        double p = winRate();
+        double denominator = 1 + z * z / n;
+        double center = (p + z * z / (2 * n)) / denominator;
+        double half = z * sqrt(p * (1 - p) / n + z * z / (4 * n * n)) / denominator;
+        return {max(0.0, center - half), min(1.0, center + half)};
+    }
+};
+
+static void printUsage(const char* program) {
+    cout << "Usage: " << program << " --param NAME=LO:HI:STEP|V1,V2,... [--param ...]"
+         << " [--gear 1|2|3] [--policy greedy|random] [--difficulty normal|hard|brutal]"
+         << " [--threads T] [--seed S] [--max-turns N] [--max-battles N] [--precision P] [--target W] [--cache FILE|none] [--list]" << endl;
+}
+
+static bool parseAxis(const string& spec, Axis& axis) {
+    size_t equals = spec.find('=');
+    if (equals == string::npos) return false;
+    axis.param = findBalanceParam(string_view(spec).substr(0, equals));
+    if (!axis.param) return false;
+
+    string values = spec.substr(equals + 1);
+    if (count(values.begin(), values.end(), ':') == 2) {
+        double lo, hi, step;
+        char colon;
+        istringstream in(values);
+        if (!(in >> lo >> colon >> hi >> colon >> step) || step <= 0 || hi < lo) return false;
+        int steps = (int)floor((hi - lo) / step + 1e-9);
+        for (int k = 0; k <= steps; k++) {
+            axis.values.push_back(lo + k * step);
+        }
+    } else {
+        istringstream in(values);
+        string item;
+        while (getline(in, item, ',')) {
+            axis.values.push_back(atof(item.c_str()));
+        }
+    }
+    return !axis.values.empty();
+}
+
+// Same on every platform and standard library, unlike std::hash, so the
+// cache file stays valid wherever it is read
+static uint64_t textHash(const string& text) {
+    uint64_t hash = mix64(text.size());
+    for (char c : text) {
+        hash = deriveSeed(hash, (unsigned char)c);
+    }
+    return hash;
+}
+
+// Everything a result depends on besides the table itself
+static uint64_t resultKey(const Balance& balance, const TuneOptions& options) {
+    uint64_t key = deriveSeed(balanceHash(balance), RULES_VERSION);
+    key = deriveSeed(key, (uint64_t)options.gearChoice);
+    key = deriveSeed(key, textHash(options.policy));
+    key = deriveSeed(key, textHash(options.difficulty));
+    key = deriveSeed(key, options.seed);
+    key = deriveSeed(key, (uint64_t)options.maxTurns);
+    key = deriveSeed(key, options.batch);
+    key = deriveSeed(key, options.maxBattles);
+    key = deriveSeed(key, (uint64_t)llround(options.precision * 1e9));
+    key = deriveSeed(key, (uint64_t)llround(options.target * 1e9));
+    return key;
+}
+
+class ResultCache {
+public:
+    void load(const string& path) {
+        ifstream in(path);
+        string line;
+        while (getline(in, line)) {
+            istringstream fields(line);
+            uint64_t key;
+            TuneResult result;
+            if (fields >> hex >> key >> dec >> result.battles >> result.wins >> result.timeouts >> result.totalTurns) {
+                result.cached = true;
+                results[key] = result;
+            }
+        }
+        if (!path.empty()) out.open(path, ios::app);
+    }
+
+    bool find(uint64_t key, TuneResult& result) {
+        lock_guard<mutex> lock(guard);
+        auto it = results.find(key);
+        if (it == results.end()) return false;
+        result = it->second;
+        result.cached = true;
+        return true;
+    }
+
+    void store(uint64_t key, const TuneResult& result) {
+        lock_guard<mutex> lock(guard);
+        results[key] = result;
+        if (out) {
+            out << hex << key << dec << ' ' << result.battles << ' ' << result.wins << ' '
+                << result.timeouts << ' ' << result.totalTurns << '\n';
+            out.flush();
+        }
+    }
+
+private:
+    unordered_map<uint64_t, TuneResult> results;
+    ofstream out;
+    mutex guard;
+};
+
+// Plays batches of battles with the thread's current balance table until
+// the stopping rule is met.
+static TuneResult evaluate(const TuneOptions& options) {
+    TuneResult result;
+    auto enemyAi = makeEnemyAi(options.difficulty, 1, true);
+    while (result.battles < options.maxBattles) {
+        uint64_t end = min(result.battles + options.batch, options.maxBattles);
+        for (uint64_t i = result.battles; i < end; i++) {
+            uint64_t seed = deriveSeed(options.seed, i);
+            auto policy = makePolicy(options.policy, seed);
+            Game game(*policy, options.gearChoice, seed, options.maxTurns);
+            game.setEnemyPolicy(enemyAi.get());
+            BattleResult battle = game.run();
+            result.wins += battle.playerWon;
+            result.timeouts += battle.timedOut;
+            result.totalTurns += battle.turns;
+        }
+        result.battles = end;
+
+        auto [low, high] = result.interval();
+        if ((high - low) / 2 <= options.precision) break;
+        if (options.target >= 0 && (high < options.target - options.precision || low > options.target + options.precision)) {
+            break;  // Clearly off target; more battles won't change that
+        }
+    }
+    return result;
+}
+
+static void printGrid(const char* title, const vector<Axis>& axes, const vector<TuneResult>& results,
+                      double (TuneResult::*metric)() const, double scale) {
+    const Axis& rows = axes[0];
+    const Axis& columns = axes[1];
+    cout << "# " << title << ": rows " << rows.param->name << ", columns " << columns.param->name << "\n#" << setw(10) << "";
+    for (double value : columns.values) {
+        cout << setw(10) << value;
+    }
+    cout << "\n";
+    for (size_t r = 0; r < rows.values.size(); r++) {
+        cout << "#" << setw(10) << rows.values[r];
+        for (size_t c = 0; c < columns.values.size(); c++) {
+            cout << setw(10) << (results[r * columns.values.size() + c].*metric)() * scale;
+        }
+        cout << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    TuneOptions options;
+    vector<Axis> axes;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--list") {
+            for (const BalanceParam& param : balanceParams) {
+                cout << param.name << " = " << param.get(defaultBalance) << endl;
+            }
+            return 0;
+        } else if (arg == "--param" && hasValue) {
+            Axis axis;
+            if (!parseAxis(argv[++i], axis)) {
+                cout << "Bad parameter range " << argv[i] << " (see --list for names)" << endl;
+                return 1;
+            }
+            axes.push_back(move(axis));
+        } else if (arg == "--gear" && hasValue) {
+            options.gearChoice = atoi(argv[++i]);
+        } else if (arg == "--policy" && hasValue) {
+            options.policy = argv[++i];
+        } else if (arg == "--difficulty" && hasValue) {
+            options.difficulty = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--max-turns" && hasValue) {
+            options.maxTurns = atoi(argv[++i]);
+        } else if (arg == "--max-battles" && hasValue) {
+            options.maxBattles = max<uint64_t>(1, strtoull(argv[++i], nullptr, 10));
+        } else if (arg == "--precision" && hasValue) {
+            options.precision = atof(argv[++i]);
+        } else if (arg == "--target" && hasValue) {
+            options.target = atof(argv[++i]);
+        } else if (arg == "--cache" && hasValue) {
+            options.cachePath = argv[++i];
+            if (options.cachePath == "none") options.cachePath.clear();
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (axes.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Every combination of axis values, first axis slowest
+    vector<Balance> tables(1, defaultBalance);
+    for (const Axis& axis : axes) {
+        vector<Balance> expanded;
+        expanded.reserve(tables.size() * axis.values.size());
+        for (const Balance& table : tables) {
+            for (double value : axis.values) {
+                Balance next = table;
+                axis.param->set(next, value);
+                expanded.push_back(next);
+            }
+        }
+        tables = move(expanded);
+    }
+
+    ResultCache cache;
+    cache.load(options.cachePath);
+
+    unsigned threads = options.threads ? options.threads : max(1u, thread::hardware_concurrency());
+    vector<TuneResult> results(tables.size());
+    atomic<size_t> next{0};
+    atomic<size_t> done{0};
+    mutex progress;
+    auto worker = [&] {
+        while (true) {
+            size_t k = next.fetch_add(1);
+            if (k >= tables.size()) break;
+            uint64_t key = resultKey(tables[k], options);
+            if (!cache.find(key, results[k])) {
+                gameBalance = &tables[k];
+                results[k] = evaluate(options);
+                gameBalance = &defaultBalance;
+                cache.store(key, results[k]);
+            }
+            lock_guard<mutex> lock(progress);
+            cerr << "\r" << ++done << "/" << tables.size() << " tables" << flush;
+        }
+    };
+    vector<thread> pool;
+    for (unsigned i = 1; i < threads; i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool) {
+        t.join();
+    }
+    cerr << endl;
+
+    for (const Axis& axis : axes) {
+        cout << axis.param->name << ",";
+    }
+    cout << "battles,win_rate,win_low,win_high,avg_turns,timeouts,cached\n";
+    for (size_t k = 0; k < tables.size(); k++) {
+        const TuneResult& r = results[k];
+        for (const Axis& axis : axes) {
+            cout << axis.param->get(tables[k]) << ",";
+        }
+        auto [low, high] = r.interval();
+        cout << r.battles << "," << fixed << setprecision(4) << r.winRate() << "," << low << "," << high << ","
+             << setprecision(2) << r.averageTurns() << defaultfloat << setprecision(6) << "," << r.timeouts << ","
+             << (r.cached ? 1 : 0) << "\n";
+    }
+    if (axes.size() == 2) {
+        cout << fixed << setprecision(1);
+        printGrid("win rate (%)", axes, results, &TuneResult::winRate, 100.0);
+        printGrid("average turns", axes, results, &TuneResult::averageTurns, 1.0);
+    }
+    return 0;
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "abilities.h"
+#include "balance.h"
+#include "game.h"
+#include "rng.h"
+#include "search_threads.h"
+#include "trace.h"
+
+// Many independent battles stepped together, for training policies: one
+// action per battle in, one observation, reward and done flag per battle
+// out, all in flat arrays the caller owns (combat_env.h wraps this in a C
+// ABI). Battles are the headless Game stepped by toDecision()/decide(),
+// so they play by exactly the rules the game does, and a battle that ends
+// starts its next episode at once (auto-reset).
+//
+// Observation, OBSERVATION_SIZE floats per battle, raw game numbers:
+//   [0, 9)   the player: health, max health, damage, armor, gear level
+//            (0 normal, 1 demon, 2 god), souls, worshippers, poison
+//            turns, restrained turns
+//   9        enemies left
+//   10       turn
+//   then ENEMY_SLOTS enemies of ENEMY_FEATURES: present (0/1), health,
+//            max health, damage, armor, gear level, poison, restrained
+//
+// Actions, 0 to ACTION_COUNT - 1:
+//   0 heal, 1 skip, then 2 + kind * ENEMY_SLOTS + target, where kind 0
+//   attacks and kind 1 + id uses ability id. An action Game rejects (an
+//   ability the gear lacks, an empty slot) wastes the turn, as at the
+//   menus; actionMask() marks the ones that don't.
+//
+// Reward per step: the share of the episode's starting enemy health
+// removed, minus the share of the player's max health lost, plus 1 for a
+// win or -1 for a loss.
+//
+// Each battle is only ever touched by one worker per step and draws its
+// dice from its own seed (deriveSeed(seed, env), then the episode), so
+// results never depend on the thread count.
+//
+// A battle that throws (out of memory, say) is dropped: its outputs for
+// that call are left as they were and its next step starts a new episode.
+// reset() and step() return false when any battle did.
+class VecEnv {
+public:
+    static constexpr int ENEMY_SLOTS = 4;
+    static constexpr int PLAYER_FEATURES = 11;
+    static constexpr int ENEMY_FEATURES = 8;
+    static constexpr int OBSERVATION_SIZE = PLAYER_FEATURES + ENEMY_SLOTS * ENEMY_FEATURES;
+    static constexpr int ACTION_KINDS = 1 + ABILITY_COUNT;
+    static constexpr int ACTION_COUNT = 2 + ACTION_KINDS * ENEMY_SLOTS;
+
+    struct Config {
+        uint32_t envs = 1;
+        unsigned threads = 0;  // 0 = one per hardware thread; never changes the result
+        int gearChoice = 1;
+        int maxTurns = 100;    // Per episode, so a stalling policy still finishes
+        uint64_t seed = 1;
+    };
+
+    explicit VecEnv(const Config& envConfig)
+        : config(envConfig),
+          pool(std::min<unsigned>(std::max(1u, config.threads ? config.threads : std::thread::hardware_concurrency()),
+                                  std::max(1u, config.envs))),
+          envs(config.envs) {}
+
+    uint32_t size() const { return (uint32_t)envs.size(); }
+    unsigned threads() const { return pool.size(); }
+
+    // Start a fresh episode everywhere and write the first observations
+    // (unless null)
+    bool reset(float* observations) {
+        return forEachShare([&](uint32_t i) {
+            Env& env = envs[i];
+            env.episode = 0;
+            begin(i);
+            if (observations) observe(env, observations + (size_t)i * OBSERVATION_SIZE);
+        });
+    }
+
+    // Play actions[i] in battle i. Any of the outputs may be null.
+    bool step(const int32_t* actions, float* observations, float* rewards, uint8_t* dones) {
+        TRACE_ZONE("vec env step");
+        return forEachShare([&](uint32_t i) {
+            Env& env = envs[i];
+            if (!env.game) begin(i);
+            float reward = 0.0f;
+            bool done = false;
+            play(env, actions[i], reward, done);
+            if (done) {
+                env.episode++;
+                begin(i);
+            }
+            if (observations) observe(env, observations + (size_t)i * OBSERVATION_SIZE);
+            if (rewards) rewards[i] = reward;
+            if (dones) dones[i] = done;
+        });
+    }
+
+    // 1 for every action that Game would carry out, ACTION_COUNT per battle
+    void actionMask(uint8_t* masks) const {
+        for (uint32_t i = 0; i < size(); i++) {
+            uint8_t* mask = masks + (size_t)i * ACTION_COUNT;
+            std::fill(mask, mask + ACTION_COUNT, 0);
+            mask[0] = mask[1] = 1;
+            const Game* game = envs[i].game.get();
+            if (!game) continue;
+            int enemies = std::min<int>((int)game->getEnemies().size(), ENEMY_SLOTS);
+            std::fill(mask + 2, mask + 2 + enemies, 1);
+            const Gear* gear = game->getParty().gearAt(game->getPlayerIndex());
+            if (!gear) continue;
+            gear->abilities.forEach([&](AbilityId id) {
+                const AbilityInfo& info = abilityInfo(id);
+                if (info.passive) return;
+                uint8_t* targets = mask + 2 + (1 + (int)id) * ENEMY_SLOTS;
+                std::fill(targets, targets + (info.needsTarget ? enemies : 1), 1);
+            });
+        }
+    }
+
+    static PlayerAction decodeAction(int32_t action) {
+        PlayerAction decoded;
+        if (action == 0) {
+            decoded.type = ActionType::HEAL;
+        } else if (action >= 2 && action < ACTION_COUNT) {
+            int kind = (action - 2) / ENEMY_SLOTS;
+            decoded.target = (action - 2) % ENEMY_SLOTS;
+            if (kind == 0) {
+                decoded.type = ActionType::ATTACK;
+            } else {
+                decoded.type = ActionType::ABILITY;
+                decoded.ability = (AbilityId)(kind - 1);
+            }
+        }
+        return decoded;
+    }
+
+private:
+    struct Env {
+        std::unique_ptr<Game> game;
+        uint64_t episode = 0;
+        int64_t enemyHealth = 0;       // Now, alive enemies only
+        int64_t startEnemyHealth = 1;  // At the start of the episode
+        int playerHealth = 0;
+    };
+
+    Config config;
+    SearchThreads pool;
+    std::vector<Env> envs;
+
+    // Battle i's share of the work on every worker, each playing by the
+    // caller's balance table. Nothing may leave a worker thread, so a
+    // battle that throws is dropped there; false if any did.
+    template <typename F>
+    bool forEachShare(const F& work) {
+        const Balance* balance = gameBalance;
+        uint32_t count = size();
+        unsigned workers = pool.size();
+        std::atomic<uint32_t> failed{0};
+        pool.run([&](unsigned id) {
+            gameBalance = balance;
+            uint32_t begin = (uint32_t)((uint64_t)count * id / workers);
+            uint32_t end = (uint32_t)((uint64_t)count * (id + 1) / workers);
+            for (uint32_t i = begin; i < end; i++) {
+                try {
+                    work(i);
+                } catch (...) {
+                    envs[i].game.reset();
+                    failed.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+        return failed.load() == 0;
+    }
+
+    static int64_t enemyHealthOf(const Game& game) {
+        int64_t total = 0;
+        for (int health : game.getEnemies().currentHealth) total += std::max(0, health);
+        return total;
+    }
+
+    void begin(uint32_t i) {
+        Env& env = envs[i];
+        uint64_t seed = deriveSeed(deriveSeed(config.seed, i), env.episode);
+        env.game = std::make_unique<Game>(config.gearChoice, seed, config.maxTurns, "Agent");
+        env.game->journalBattleStart();
+        env.game->toDecision();
+        env.enemyHealth = enemyHealthOf(*env.game);
+        env.startEnemyHealth = std::max<int64_t>(1, env.enemyHealth);
+        env.playerHealth = env.game->getParty().currentHealth[env.game->getPlayerIndex()];
+    }
+
+    static void play(Env& env, int32_t action, float& reward, bool& done) {
+        Game& game = *env.game;
+        game.decide(decodeAction(action));
+        done = !game.toDecision();
+
+        const EntityStore& party = game.getParty();
+        uint32_t self = game.getPlayerIndex();
+        int health = party.currentHealth[self];
+        int64_t enemyHealth = enemyHealthOf(game);
+        reward = (float)(env.enemyHealth - enemyHealth) / (float)env.startEnemyHealth +
+                 (float)(std::max(0, health) - std::max(0, env.playerHealth)) / (float)std::max(1, party.maxHealth[self]);
+        if (done && health > 0 && game.getEnemies().empty()) reward += 1.0f;
+        if (done && health <= 0) reward -= 1.0f;
+        env.enemyHealth = enemyHealth;
+        env.playerHealth = health;
+    }
+
+    static void observe(const Env& env, float* out) {
+        const Game& game = *env.game;
+        const EntityStore& party = game.getParty();
+        const EntityStore& enemies = game.getEnemies();
+        uint32_t self = game.getPlayerIndex();
+        *out++ = (float)party.currentHealth[self];
+        *out++ = (float)party.maxHealth[self];
+        *out++ = (float)party.cachedDamage[self];
+        *out++ = (float)party.cachedArmor[self];
+        *out++ = (float)party.gearLevel[self];
+        *out++ = (float)party.souls[self];
+        *out++ = (float)party.worshippers[self];
+        *out++ = (float)party.poisonTurns[self];
+        *out++ = (float)party.restrained[self];
+        *out++ = (float)enemies.size();
+        *out++ = (float)game.getTurn();
+        for (uint32_t e = 0; e < (uint32_t)ENEMY_SLOTS; e++) {
+            if (e >= enemies.size()) {
+                std::fill(out, out + ENEMY_FEATURES, 0.0f);
+            } else {
+                out[0] = 1.0f;
+                out[1] = (float)enemies.currentHealth[e];
+                out[2] = (float)enemies.maxHealth[e];
+                out[3] = (float)enemies.cachedDamage[e];
+                out[4] = (float)enemies.cachedArmor[e];
+                out[5] = (float)enemies.gearLevel[e];
+                out[6] = (float)enemies.poisonTurns[e];
+                out[7] = (float)enemies.restrained[e];
+            }
+            out += ENEMY_FEATURES;
+        }
+    }
+};
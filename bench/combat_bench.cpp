@@ -0,0 +1,418 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bot_protocol.h"
+#include "character.h"
+#include "encounter.h"
+#include "entity_store.h"
+#include "event_loop.h"
+#include "game.h"
+#include "gear.h"
+#include "policies.h"
+#include "trace.h"
+#include "vec_env.h"
+
+using namespace std;
+
+TRACE_ALLOCATION_HOOK()
+
+// Micro and macro benchmarks for the combat rules, from a single stat
+// lookup up to whole battles against waves of thousands. Each benchmark
+// repeats until it has run for at least --min-time milliseconds, and the
+// results go out as JSON (stdout, or --out FILE) for comparing builds:
+//
+//   combat_bench [--filter SUBSTRING] [--min-time MS] [--out FILE]
+//
+// Nothing is printed or journalled while benchmarks run.
+
+using Clock = chrono::steady_clock;
+
+// Keeps a value alive as far as the optimiser can tell.
+template <typename T>
+static void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile T sink;
+    sink = value;
+#endif
+}
+
+// Timing for one run of a benchmark body, which may pause it around setup.
+class Stopwatch {
+public:
+    void start() { begin = Clock::now(); }
+    void pause() { elapsed += Clock::now() - begin; }
+    void resume() { begin = Clock::now(); }
+    double seconds() const { return chrono::duration<double>(elapsed).count(); }
+
+private:
+    Clock::time_point begin;
+    Clock::duration elapsed{};
+};
+
+// A body runs `iterations` times over and returns how many units of work
+// (hits, turns, battles) that was.
+using BenchBody = function<uint64_t(uint64_t iterations, Stopwatch& watch)>;
+
+struct Benchmark {
+    string name;
+    string unit;
+    BenchBody body;
+};
+
+struct BenchResult {
+    string name;
+    string unit;
+    uint64_t iterations = 0;
+    uint64_t ops = 0;
+    double seconds = 0.0;
+
+    double nsPerOp() const { return ops ? seconds * 1e9 / ops : 0.0; }
+    double opsPerSecond() const { return seconds > 0 ? ops / seconds : 0.0; }
+};
+
+// Double the iteration count until one run lasts minSeconds.
+static BenchResult measure(const Benchmark& bench, double minSeconds) {
+    BenchResult result;
+    result.name = bench.name;
+    result.unit = bench.unit;
+    for (uint64_t iterations = 1;; iterations *= 2) {
+        Stopwatch watch;
+        watch.start();
+        uint64_t ops = bench.body(iterations, watch);
+        watch.pause();
+        result.iterations = iterations;
+        result.ops = ops;
+        result.seconds = watch.seconds();
+        if (result.seconds >= minSeconds || iterations >= (1ull << 40)) break;
+    }
+    return result;
+}
+
+static const char* simdPath() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static string jsonString(const string& text) {
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void writeJson(ostream& out, const vector<BenchResult>& results) {
+    out << "{\n";
+    out << "  \"suite\": \"combat_bench\",\n";
+    out << "  \"context\": {\n";
+#if defined(__clang__)
+    out << "    \"compiler\": " << jsonString(string("clang ") + __clang_version__) << ",\n";
+#elif defined(__GNUC__)
+    out << "    \"compiler\": " << jsonString(string("gcc ") + __VERSION__) << ",\n";
+#else
+    out << "    \"compiler\": \"unknown\",\n";
+#endif
+#ifdef NDEBUG
+    out << "    \"optimized\": true,\n";
+#else
+    out << "    \"optimized\": false,\n";
+#endif
+    out << "    \"simd\": \"" << simdPath() << "\",\n";
+    out << "    \"hardware_threads\": " << thread::hardware_concurrency() << "\n";
+    out << "  },\n";
+    out << "  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        ostringstream line;
+        line.precision(6);
+        line << fixed;
+        line << (i ? ",\n" : "\n") << "    {\"name\": " << jsonString(r.name) << ", \"unit\": " << jsonString(r.unit)
+             << ", \"iterations\": " << r.iterations << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds
+             << ", \"ns_per_op\": " << r.nsPerOp() << ", \"ops_per_second\": " << r.opsPerSecond() << "}";
+        out << line.str();
+    }
+    out << "\n  ]\n}\n";
+}
+
+// `count` rows of the standard enemy kinds, health set so high nobody
+// dies however long a benchmark runs.
+static void fillEnemies(EntityStore& store, uint32_t count) {
+    store.clear();
+    store.side = SIDE_ENEMIES;
+    store.rng = Rng(1, 2);
+    int kinds[] = {
+        store.addGear(makeGear("Rusty Dagger", GearType::SWORD, GearLevel::NORMAL)),
+        store.addGear(makeGear("Hell Sword", GearType::SWORD, GearLevel::DEMON)),
+        store.addGear(makeGear("Celestial Spear", GearType::SPEAR, GearLevel::GOD)),
+    };
+    for (uint32_t i = 0; i < count; i++) {
+        EntityHandle enemy = store.create("Enemy", 1 << 30, 10 + (int)(i % 7), 2 + (int)(i % 13));
+        store.equip(store.indexOf(enemy), kinds[i % 3]);
+    }
+}
+
+static void fillHero(EntityStore& store, GearLevel level) {
+    store.clear();
+    store.side = SIDE_PARTY;
+    store.rng = Rng(1, 1);
+    store.create("Hero", 1 << 30, 20, 5);
+    Character(store, 0).equipGear(makeGear("Bench Blade", GearType::SWORD, level));
+}
+
+static vector<Benchmark> statBenchmarks() {
+    vector<Benchmark> list;
+    list.push_back({"gear/initialize", "gear", [](uint64_t iterations, Stopwatch&) {
+        Gear gear("Bench Gear", GearType::SPEAR, GearLevel::GOD);
+        for (uint64_t i = 0; i < iterations; i++) {
+            gear.level = (GearLevel)(i % 3);
+            gear.initializeGear();
+            keep(gear.damageBonus);
+        }
+        return iterations;
+    }});
+    // The cached reads every attack makes, and what a change costs to refresh
+    const char* stats[] = {"total_damage", "total_armor", "refresh"};
+    for (int which = 0; which < 3; which++) {
+        list.push_back({string("stats/") + stats[which], "row", [which](uint64_t iterations, Stopwatch& watch) {
+            watch.pause();
+            EntityStore store;
+            fillEnemies(store, 1024);
+            watch.resume();
+            for (uint64_t i = 0; i < iterations; i++) {
+                Character row(store, (uint32_t)(i & 1023));
+                if (which == 0) {
+                    keep(row.getTotalDamage());
+                } else if (which == 1) {
+                    keep(row.getTotalArmor());
+                } else {
+                    store.refreshStats(row.index);
+                    keep(store.cachedDamage[row.index]);
+                }
+            }
+            return iterations;
+        }});
+    }
+    list.push_back({"combat/take_damage", "hit", [](uint64_t iterations, Stopwatch& watch) {
+        watch.pause();
+        EntityStore store;
+        fillEnemies(store, 1024);
+        watch.resume();
+        for (uint64_t i = 0; i < iterations; i++) {
+            Character(store, (uint32_t)(i & 1023)).takeDamage(40);
+        }
+        keep(store.currentHealth[0]);
+        return iterations;
+    }});
+    return list;
+}
+
+// One attack on every enemy of a wave: row by row as single strikes, and
+// through the batched kernel
+static vector<Benchmark> areaBenchmarks() {
+    vector<Benchmark> list;
+    for (uint32_t count : {16u, 256u, 4096u}) {
+        for (bool batched : {false, true}) {
+            string name = string(batched ? "combat/strike_all/" : "combat/strike_each/") + to_string(count);
+            list.push_back({name, "hit", [count, batched](uint64_t iterations, Stopwatch& watch) {
+                watch.pause();
+                EntityStore party, enemies;
+                fillHero(party, GearLevel::GOD);
+                fillEnemies(enemies, count);
+                Character hero(party, 0);
+                watch.resume();
+                for (uint64_t i = 0; i < iterations; i++) {
+                    if (batched) {
+                        hero.strikeAll(enemies, 40);
+                    } else {
+                        for (uint32_t e = 0; e < count; e++) {
+                            hero.strike(Character(enemies, e), 40);
+                        }
+                    }
+                }
+                keep(enemies.currentHealth[0]);
+                return iterations * count;
+            }});
+        }
+    }
+    return list;
+}
+
+// Whole turns: headless with the greedy player, and the interactive game
+// (coroutines and event loop) reading a scripted keyboard from a file.
+static vector<Benchmark> gameBenchmarks() {
+    vector<Benchmark> list;
+    list.push_back({"game/headless_turn", "turn", [](uint64_t iterations, Stopwatch&) {
+        GreedyPolicy policy;
+        uint64_t turns = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            Game game(policy, 1 + (int)(i % 3), deriveSeed(7, i), 500);
+            turns += game.run().turns;
+        }
+        return turns;
+    }});
+#ifdef EVENT_LOOP_POSIX
+    list.push_back({"game/scripted_turn", "turn", [](uint64_t iterations, Stopwatch& watch) {
+        watch.pause();
+        string keys = "Bench\n1\n";
+        for (int i = 0; i < 500; i++) keys += "1\n1\n";  // Attack the first enemy
+        FILE* script = tmpfile();
+        if (!script) return (uint64_t)0;
+        fwrite(keys.data(), 1, keys.size(), script);
+        fflush(script);
+        int fd = fileno(script);
+        watch.resume();
+        uint64_t turns = 0;
+        for (uint64_t i = 0; i < iterations; i++) {
+            lseek(fd, 0, SEEK_SET);
+            EventLoop input(fd);
+            Game game(input, deriveSeed(11, i));
+            turns += game.getTurn();
+        }
+        fclose(script);
+        return turns;
+    }});
+#endif
+    return list;
+}
+
+// Battles against waves of N of the standard enemies; the player usually
+// falls within a turn or two, so this is mostly N enemies acting.
+static vector<Benchmark> encounterBenchmarks() {
+    vector<Benchmark> list;
+    for (uint32_t count : {100u, 1000u, 10000u}) {
+        list.push_back({"encounter/wave/" + to_string(count), "battle", [count](uint64_t iterations, Stopwatch& watch) {
+            GreedyPolicy policy;
+            for (uint64_t i = 0; i < iterations; i++) {
+                watch.pause();
+                Game game(policy, 1 + (int)(i % 3), deriveSeed(13, i), 20);
+                game.createWave(count);
+                watch.resume();
+                keep(game.run().turns);
+            }
+            return iterations;
+        }});
+    }
+    // Building a horde wave from scratch, on one thread and on all of them
+    for (unsigned threads : {1u, 0u}) {
+        string name = "encounter/generate/50000/" + (threads ? to_string(threads) + "t" : string("all"));
+        list.push_back({name, "enemy", [threads](uint64_t iterations, Stopwatch& watch) {
+            EncounterSpec spec;
+            spec.count = 50000;
+            spec.threads = threads;
+            EntityStore store;
+            for (uint64_t i = 0; i < iterations; i++) {
+                watch.pause();
+                store.clear();
+                watch.resume();
+                spec.seed = i;
+                generateEncounter(store, spec);
+                keep(store.currentHealth[0]);
+            }
+            return iterations * spec.count;
+        }});
+    }
+    // Battles played over the bot protocol, five moves to a request,
+    // replies formatted but not written anywhere
+    list.push_back({"bot_protocol/batch5", "turn", [](uint64_t iterations, Stopwatch& watch) {
+        (void)watch;
+        BotProtocol bots(BotConfig{});
+        string out;
+        uint64_t moves = bots.getMovesPlayed();
+        for (uint64_t i = 0; i < iterations; i++) {
+            out.clear();
+            bots.handle("new", out);
+            while (out.rfind("state", 0) == 0) {
+                out.clear();
+                bots.handle("act a0 a0 a0 h a0", out);
+            }
+        }
+        keep(out);
+        return bots.getMovesPlayed() - moves;
+    }});
+    // Training-style stepping: 4096 battles attacking their first enemy,
+    // on one thread and on all of them
+    for (unsigned threads : {1u, 0u}) {
+        string name = "vec_env/step/4096/" + (threads ? to_string(threads) + "t" : string("all"));
+        list.push_back({name, "step", [threads](uint64_t iterations, Stopwatch& watch) {
+            watch.pause();
+            VecEnv::Config config;
+            config.envs = 4096;
+            config.threads = threads;
+            VecEnv env(config);
+            vector<float> observations(config.envs * VecEnv::OBSERVATION_SIZE), rewards(config.envs);
+            vector<uint8_t> dones(config.envs);
+            vector<int32_t> actions(config.envs, 2);
+            env.reset(observations.data());
+            watch.resume();
+            for (uint64_t i = 0; i < iterations; i++) {
+                env.step(actions.data(), observations.data(), rewards.data(), dones.data());
+            }
+            keep(rewards[0]);
+            return iterations * config.envs;
+        }});
+    }
+    return list;
+}
+
+int main(int argc, char* argv[]) {
+    string filter, outPath;
+    double minMs = 200.0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) {
+            filter = argv[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            minMs = atof(argv[++i]);
+        } else if (arg == "--out" && hasValue) {
+            outPath = argv[++i];
+        } else {
+            cerr << "Usage: " << argv[0] << " [--filter SUBSTRING] [--min-time MS] [--out FILE]" << endl;
+            return 1;
+        }
+    }
+
+    vector<Benchmark> benchmarks;
+    for (auto group : {statBenchmarks, areaBenchmarks, gameBenchmarks, encounterBenchmarks}) {
+        for (Benchmark& bench : group()) {
+            if (bench.name.find(filter) != string::npos) benchmarks.push_back(move(bench));
+        }
+    }
+
+    vector<BenchResult> results;
+    for (const Benchmark& bench : benchmarks) {
+        results.push_back(measure(bench, minMs / 1000.0));
+        const BenchResult& r = results.back();
+        cerr << r.name << ": " << r.nsPerOp() << " ns/" << r.unit << endl;
+    }
+
+    if (outPath.empty()) {
+        writeJson(cout, results);
+        return 0;
+    }
+    ofstream out(outPath);
+    writeJson(out, results);
+    if (!out) {
+        cerr << "Cannot write " << outPath << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,29 @@
+-- DEMON gear: abilities and enemy AI.
+-- Precompile with `luac -s -o lua/demon.luac lua/demon.lua`; the game
+-- prefers the .luac when both exist.
+
+local abilities = {}
+
+-- Poison bites on contact as well as over time
+function abilities.poison(target)
+  game.poison(game.ENEMIES, target, 3)
+  game.hit(game.ENEMIES, target, 5)
+  game.say("The venom burns on contact!")
+end
+
+-- Demons smell weakness: they press a dying hero and poison a healthy one
+local function enemy_turn(self)
+  local hp, max = game.health(game.PARTY, 1), game.max_health(game.PARTY, 1)
+  if hp * 4 < max then
+    return game.ATTACK
+  end
+  if game.poison_turns(game.PARTY, 1) == 0 and game.roll(1, 3) == 1 then
+    return game.SPECIAL
+  end
+  if game.health(game.ENEMIES, self) * 3 < game.max_health(game.ENEMIES, self) then
+    return game.HEAL
+  end
+  return game.ATTACK
+end
+
+return { abilities = abilities, enemy_turn = enemy_turn }
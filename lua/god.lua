@@ -0,0 +1,25 @@
+-- GOD gear: abilities and enemy AI.
+-- Precompile with `luac -s -o lua/god.luac lua/god.lua`; the game
+-- prefers the .luac when both exist.
+
+local abilities = {}
+
+-- Holy Takedown with a little divine luck on top
+function abilities.holy_takedown(target)
+  local bonus = game.roll(0, 5)
+  game.hit(game.ENEMIES, target, game.damage(game.PARTY, 1) + game.armor(game.PARTY, 1) + bonus)
+end
+
+-- Guardians restrain a hero that is winning and mend themselves otherwise
+local function enemy_turn(self)
+  local hp, max = game.health(game.ENEMIES, self), game.max_health(game.ENEMIES, self)
+  if not game.is_restrained(game.PARTY, 1) and hp * 2 < max then
+    return game.SPECIAL
+  end
+  if hp * 4 < max then
+    return game.HEAL
+  end
+  return game.ATTACK
+end
+
+return { abilities = abilities, enemy_turn = enemy_turn }
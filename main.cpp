@@ -1,36 +1,42 @@
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <utility>
+#include "AI/gear_catalog.h"
+#include "AI/inventory.h"
 using namespace std;
-enum GearLevel { DEMON, GOD };
-  class Gear {
-    string gName;
-    string gType;
-    GearLevel gLevel;
-
-    public:
-      Gear(string name, string type,GearLevel level){
-        gName = name;
-        gType = type;
-        gLevel = level;
-        }
-  };
+  // Gear lives in the shared gear catalog (AI/gear_catalog.h), the same one
+  // the combat game maps; a player just keeps the id of what it holds.
   class player {
     private:
       int lvl;
-      Gear equipment;
+      string name;
+      const GearCatalog& catalog;
+      uint32_t equipment;
       int health;
       int damage;
       int armor;
-      int inventory;
+      Inventory inventory;  // Items hold catalog ids
     public:
-      player(int level = 1,string name = "wfogame", Gear gear){
+      player(const GearCatalog& gear, uint32_t gearId, int level = 1, string name = "wfogame")
+        : name(std::move(name)), catalog(gear) {
         lvl = level;
-        equipment = gear;
+        equipment = gearId;
         health = lvl;
         damage = lvl;
         armor = lvl;
-        inventory= lvl;
+        if (equipment != NO_GEAR) {
+          inventory.setEquipped(pickUp(equipment));
+        }
+      }
 
+      ItemHandle pickUp(uint32_t gearId) {
+        return inventory.add(gearId, *catalog.makeGear(gearId));
       }
-  };
 
+      const string& getName() const { return name; }
+
+      string_view gearName() const {
+        return equipment == NO_GEAR ? string_view("nothing") : catalog.name(equipment);
+      }
+  };
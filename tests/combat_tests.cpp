@@ -0,0 +1,1202 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bot_protocol.h"
+#include "character.h"
+#include "damage_kernel.h"
+#include "encounter.h"
+#include "entity_store.h"
+#include "event_loop.h"
+#include "game.h"
+#include "gear_catalog.h"
+#include "inventory.h"
+#include "journal.h"
+#include "lockstep.h"
+#include "policies.h"
+#include "pvp.h"
+#include "scripting.h"
+#include "server.h"
+#include "simulator.h"
+#include "snapshot.h"
+#include "status_effects.h"
+#include "transposition.h"
+#include "vec_env.h"
+
+#ifdef EVENT_LOOP_POSIX
+#include <sys/stat.h>
+#endif
+#ifdef SERVER_EPOLL
+#include <sys/ioctl.h>
+#endif
+
+using namespace std;
+
+// Regression tests for the combat rules and the machinery under them.
+// Each test is a plain function; CHECK records a failure and carries on.
+// Exits non-zero if anything failed (run by ctest).
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                   \
+    do {                                                                                   \
+        if (!(condition)) {                                                                \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #condition << endl; \
+            failures++;                                                                    \
+        }                                                                                  \
+    } while (0)
+
+static EntityStore makeWave(uint32_t count, uint64_t seed) {
+    EntityStore store;
+    store.side = SIDE_ENEMIES;
+    store.rng = Rng(seed, 2);
+    int kinds[] = {
+        store.addGear(makeGear("Rusty Dagger", GearType::SWORD, GearLevel::NORMAL)),
+        store.addGear(makeGear("Hell Sword", GearType::SWORD, GearLevel::DEMON)),
+        store.addGear(makeGear("Celestial Spear", GearType::SPEAR, GearLevel::GOD)),
+    };
+    for (uint32_t i = 0; i < count; i++) {
+        EntityHandle enemy = store.create("Enemy", 20 + (int)(i % 90), 10, (int)(i % 17));
+        store.equip(store.indexOf(enemy), kinds[i % 3]);
+    }
+    return store;
+}
+
+// The simulator's checksum pins down the rules: any change in who wins,
+// or in how many turns, changes it. Thread count must not matter.
+static void testSimulationChecksum() {
+    const uint64_t expected[] = {0xf825f99d62ae4ab4, 0xb46fd5a7e26449be, 0xdfec4f4eeb6d696b};
+    for (int gear = 1; gear <= 3; gear++) {
+        SimulationConfig config;
+        config.battles = 2000;
+        config.seed = 7;
+        config.gearChoice = gear;
+        config.threads = 1;
+        SimulationReport single = runSimulation(config);
+        config.threads = 3;
+        SimulationReport spread = runSimulation(config);
+        CHECK(single.checksum == expected[gear - 1]);
+        CHECK(spread.checksum == single.checksum);
+        CHECK(single.battles == 2000);
+    }
+}
+
+static void testCachedStats() {
+    EntityStore store;
+    EntityHandle demon = store.create("Demon", 100, 20, 5);
+    uint32_t i = store.indexOf(demon);
+    CHECK(totalDamage(store, i) == 20);
+    Character(store, i).equipGear(makeGear("Hell Sword", GearType::SWORD, GearLevel::DEMON));
+    int healthy = totalDamage(store, i);
+    CHECK(healthy == 20 + 15 + 10);
+
+    // Rage below half health, fury below a quarter
+    store.setHealth(i, store.maxHealth[i] / 2 - 1);
+    CHECK(totalDamage(store, i) == (int)(healthy * 1.5));
+    store.setHealth(i, 1);
+    CHECK(totalDamage(store, i) == (int)((int)(healthy * 1.5) * 2.0));
+    store.setHealth(i, store.maxHealth[i]);
+    store.addSouls(i, 3);
+    CHECK(totalDamage(store, i) == healthy + 3 * 2);
+
+    EntityHandle angel = store.create("Angel", 100, 10, 10);
+    uint32_t j = store.indexOf(angel);
+    Character(store, j).equipGear(makeGear("Celestial Spear", GearType::SPEAR, GearLevel::GOD));
+    int guarded = totalArmor(store, j);
+    CHECK(guarded == (int)((10 + 2 + 20) * 1.5));
+    store.setHealth(j, 10);
+    CHECK(totalArmor(store, j) == 10 + 2 + 20);
+    store.addWorshippers(j, 2);
+    CHECK(totalDamage(store, j) == 10 + 20 + 2 * 5);
+
+    // Swap-remove carries the cache along with the row
+    store.removeAt(i);
+    uint32_t moved = store.indexOf(angel);
+    CHECK(totalArmor(store, moved) == 10 + 2 + 20);
+}
+
+// Integer scaling truncates like the float casts it replaced, minus their
+// rounding slips (90 * 0.7 came out as 62)
+static void testFixedPoint() {
+    CHECK(MultiAttackDamage::scale(90) == 63 && MultiAttackDamage::scale(-90) == -63);
+    CHECK(HolyDamage::scale(7) == 10 && DarkEnergyDamage::scale(25) == 30);
+    CHECK(!ExecutionBelow::fractionBelow(3, 10) && ExecutionBelow::fractionBelow(29, 100));
+    CHECK(ExecutionBelow::fractionBelow(-5, 10));
+
+    StatFactor half = StatFactor::fromDouble(0.5);
+    CHECK(half.raw() == StatFactor::ONE / 2 && half.toDouble() == 0.5);
+    CHECK(half.fractionBelow(49, 100) && !half.fractionBelow(50, 100) && half.fractionAbove(51, 100));
+    CHECK(StatFactor::fromDouble(1.5).scale(45) == 67 && StatFactor::fromDouble(-0.25).raw() == -StatFactor::ONE / 4);
+    for (int damage = 0; damage < 5000; damage++) {
+        CHECK(StatFactor::fromDouble(1.5).scale(damage) == (int)(damage * 1.5));
+    }
+
+    // Tuned decimals keep the nearest step
+    Balance balance;
+    const BalanceParam* rage = findBalanceParam("demon.rage_multiplier");
+    rage->set(balance, 1.3);
+    CHECK(balance.demonRageMultiplier.raw() == 85197 && rage->get(balance) > 1.29999 && rage->get(balance) < 1.30001);
+}
+
+static void testDamageKernel() {
+    mt19937 random(3);
+    for (int round = 0; round < 500; round++) {
+        size_t count = random() % 40;
+        int damage = (int)(random() % 80) - 10;
+        bool holy = random() & 1;
+        vector<int> armor(count), health(count), dealt(count);
+        vector<GearLevel> level(count);
+        vector<uint8_t> blocked(count);
+        for (size_t i = 0; i < count; i++) {
+            armor[i] = (int)(random() % 60) - 5;
+            health[i] = (int)(random() % 200) - 20;
+            level[i] = (GearLevel)(random() % 3);
+            blocked[i] = random() % 5 == 0;
+        }
+        vector<int> before = health;
+        applyHits(damage, holy, armor.data(), level.data(), blocked.data(), health.data(), dealt.data(), count);
+        for (size_t i = 0; i < count; i++) {
+            int taken = max(1, damage - armor[i]);
+            if (holy && level[i] == GearLevel::DEMON) taken = taken * 1.5;
+            if (blocked[i]) taken = 0;
+            CHECK(dealt[i] == taken);
+            CHECK(health[i] == before[i] - taken);
+        }
+    }
+}
+
+// One batched attack must leave both sides exactly as one strike per row
+// would, dice included.
+static void testStrikeAllMatchesStrikes() {
+    for (GearLevel level : {GearLevel::NORMAL, GearLevel::DEMON, GearLevel::GOD}) {
+        EntityStore heroes[2], waves[2];
+        for (int k = 0; k < 2; k++) {
+            heroes[k].side = SIDE_PARTY;
+            heroes[k].rng = Rng(5, 1);
+            heroes[k].create("Hero", 100, 20, 5);
+            Character(heroes[k], 0).equipGear(makeGear("Blade", GearType::SWORD, level));
+            waves[k] = makeWave(37, 5);
+        }
+        Character(heroes[0], 0).strikeAll(waves[0], 45);
+        for (uint32_t i = 0; i < waves[1].size(); i++) {
+            Character(heroes[1], 0).strike(Character(waves[1], i), 45);
+        }
+        CHECK(waves[0].sameRows(waves[1]));
+        CHECK(waves[0].cachedArmor == waves[1].cachedArmor);
+        CHECK(heroes[0].sameRows(heroes[1]));
+        CHECK(waves[0].rng.next() == waves[1].rng.next());
+        CHECK(heroes[0].rng.next() == heroes[1].rng.next());
+    }
+}
+
+static void testTurnWheel() {
+    TurnWheel wheel;
+    wheel.reset(5);
+    mt19937 random(1);
+    vector<int> due;
+    for (uint32_t i = 0; i < 5000; i++) {
+        int turn = 5 + (int)(random() % 300000);
+        wheel.schedule(TurnWheel::Timer{i, 0, turn});
+        due.push_back(turn);
+    }
+    wheel.schedule(TurnWheel::Timer{5000, 0, 2});  // Already past: due next advance
+    due.push_back(5);
+    vector<TurnWheel::Timer> fired;
+    size_t total = 0;
+    for (int turn = 5; turn <= 300010; turn++) {
+        fired.clear();
+        wheel.advance(turn, fired);
+        for (const TurnWheel::Timer& timer : fired) CHECK(due[timer.item] == turn);
+        total += fired.size();
+    }
+    CHECK(total == due.size());
+}
+
+static void testStatusEffects() {
+    EntityStore store = makeWave(4, 9);
+    StatusEffects effects;
+    effects.clear(1);
+    CHECK(effects.apply(store, 2, StatusId::POISON, 3, 1) == 3);
+    CHECK(store.poisonTurns[2] == 3);
+    CHECK(effects.apply(store, 2, StatusId::POISON, 2, 1) == 2);  // REPLACE
+    CHECK(store.poisonTurns[2] == 2);
+
+    EntityStore none;
+    CHECK(effects.dueAt(1, none, store).empty());
+    const vector<StatusTick>& due = effects.dueAt(2, none, store);
+    CHECK(due.size() == 1 && due[0].index == 2 && due[0].id == StatusId::POISON);
+    CHECK(effects.tick(store, due[0], 2) == 1);
+    const vector<StatusTick>& last = effects.dueAt(3, none, store);
+    CHECK(last.size() == 1);
+    CHECK(effects.tick(store, last[0], 3) == 0);
+    CHECK(store.poisonTurns[2] == 0);
+    CHECK(effects.dueAt(4, none, store).empty());
+    CHECK(effects.size() == 0);
+
+    // Restraint costs exactly one turn
+    effects.apply(store, 1, StatusId::RESTRAIN, 1, 4);
+    CHECK(store.restrained[1] == 1);
+    const StatusInfo* lost = effects.skipTurn(store, 1);
+    CHECK(lost && lost == &statusInfo(StatusId::RESTRAIN));
+    CHECK(effects.skipTurn(store, 1) == nullptr);
+
+    // Effects follow their bearer through a swap-remove, and die with it
+    effects.apply(store, 3, StatusId::POISON, 2, 4);
+    EntityHandle bearer = store.handleAt(3);
+    store.removeAt(0);
+    CHECK(store.poisonTurns[store.indexOf(bearer)] == 2);
+    const vector<StatusTick>& moved = effects.dueAt(5, none, store);
+    CHECK(moved.size() == 1 && moved[0].index == store.indexOf(bearer));
+    effects.tick(store, moved[0], 5);
+    store.remove(bearer);
+    CHECK(effects.dueAt(6, none, store).empty());
+}
+
+static void testSnapshotRoundTrip() {
+    GreedyPolicy policy;
+    Game game(policy, 2, 42, 4);
+    game.run();
+    string path = "combat_tests_snapshot.bin";
+    {
+        SnapshotWriter writer(path);
+        CHECK(game.saveSnapshot(writer));
+    }
+    Game loaded(policy);
+    string error;
+    CHECK(loaded.loadSnapshot(path, error));
+    CHECK(loaded.sameBattle(game));
+    CHECK(loaded.getParty().cachedDamage == game.getParty().cachedDamage);
+    CHECK(loaded.getInventory().size() == game.getInventory().size());
+    std::remove(path.c_str());
+    std::remove(snapshotAltPath(path).c_str());
+}
+
+// Saves alternate between two files, so a crash while writing one leaves
+// the checkpoint before it in the other
+static void testSnapshotAlternates() {
+    EntityStore party;
+    BattleState state;
+    state.player = party.create("Hero", 100, 20, 5);
+    EntityStore enemies = makeWave(3000, 9);
+    string path = "combat_tests_alternates.bin";
+    string alt = snapshotAltPath(path);
+    auto loadedTurn = [&] {
+        EntityStore loadedParty, loadedEnemies;
+        BattleState loadedState;
+        string error;
+        return loadSnapshot(path, loadedParty, loadedEnemies, loadedState, error) ? loadedState.turn : -1;
+    };
+
+    FILE* stale = fopen(alt.c_str(), "wb");  // Left by an earlier run
+    fclose(stale);
+    SnapshotWriter writer(path);
+    vector<char> image;
+    for (int turn = 1; turn <= 3; turn++) {
+        state.turn = turn;
+        enemies.setHealth(2000, 40 - turn);
+        CHECK(writer.save(party, enemies, state));
+        if (turn == 1) {
+            FILE* left = fopen(alt.c_str(), "rb");
+            CHECK(!left);
+            if (left) fclose(left);
+        }
+        buildSnapshotImage(image, party, enemies, state, turn);
+    }
+    CHECK(writer.getBytesWritten() < image.size() / 4);  // Turn 3 rewrote only what changed since turn 1
+    CHECK(loadedTurn() == 3);
+
+    FILE* file = fopen(path.c_str(), "r+b");  // Turn 3's save, cut short
+    fseek(file, (long)image.size() / 2, SEEK_SET);
+    fputc(0x5a ^ fgetc(file), file);
+    fclose(file);
+    CHECK(loadedTurn() == 2);
+    std::remove(alt.c_str());
+    CHECK(loadedTurn() == -1);
+    std::remove(path.c_str());
+
+    // Simulations checkpoint each worker's battle as they go
+    SimulationConfig sim;
+    sim.battles = 2;
+    sim.threads = 1;
+    sim.horde = 500;
+    sim.savePath = "combat_tests_sim";
+    SimulationReport report = runSimulation(sim);
+    CHECK(report.battles == 2 && report.checkpointErrors == 0);
+    path = sim.savePath + ".0";
+    CHECK(loadedTurn() >= 1);
+    std::remove(path.c_str());
+    std::remove(snapshotAltPath(path).c_str());
+}
+
+// A save torn part way, or slot arrays that don't agree, must not load
+static void testSnapshotRejectsDamage() {
+    EntityStore party;
+    BattleState state;
+    state.player = party.create("Hero", 100, 20, 5);
+    EntityStore enemies = makeWave(40, 3);
+    enemies.remove(enemies.handleAt(7));
+
+    string path = "combat_tests_damaged.bin";
+    auto loads = [&](const vector<char>& image, string& error) {
+        FILE* file = fopen(path.c_str(), "wb");
+        fwrite(image.data(), 1, image.size(), file);
+        fclose(file);
+        EntityStore loadedParty, loadedEnemies;
+        BattleState loadedState;
+        return loadSnapshot(path, loadedParty, loadedEnemies, loadedState, error);
+    };
+    vector<char> image;
+    buildSnapshotImage(image, party, enemies, state, 1);
+    string error;
+    CHECK(loads(image, error));
+
+    // A block of the next turn's save landed, the header didn't
+    vector<char> torn = image;
+    torn[torn.size() - 1] ^= 1;
+    CHECK(!loads(torn, error) && error.find("checksum") != string::npos);
+
+    // Well-formed file, but a slot points at the wrong row
+    vector<char> bad = image;
+    SnapshotHeader header;
+    memcpy(&header, bad.data(), sizeof(header));
+    for (uint32_t i = 0; i < header.sectionCount; i++) {
+        SnapshotSection section;
+        memcpy(&section, bad.data() + sizeof(header) + i * sizeof(section), sizeof(section));
+        if (section.store == 1 && section.field == 13) {
+            uint32_t wrong = 3;
+            memcpy(bad.data() + section.offset, &wrong, sizeof(wrong));
+        }
+    }
+    header.checksum = snapshotChecksum(bad.data(), bad.size());
+    memcpy(bad.data(), &header, sizeof(header));
+    CHECK(!loads(bad, error) && error.find("inconsistent") != string::npos);
+    std::remove(path.c_str());
+}
+
+static void testInventory() {
+    Inventory inventory;
+    auto sword = makeGear("Sword", GearType::SWORD, GearLevel::DEMON);
+    auto spear = makeGear("Spear", GearType::SPEAR, GearLevel::GOD);
+    auto bow = makeGear("Bow", GearType::ARROW, GearLevel::NORMAL);
+    ItemHandle a = inventory.add(0, *sword);
+    ItemHandle b = inventory.add(1, *spear);
+    ItemHandle c = inventory.add(2, *bow);
+    CHECK(inventory.size() == 3);
+    CHECK(inventory.setEquipped(b));
+    CHECK(inventory.isEquipped(b) && !inventory.isEquipped(a));
+    CHECK(inventory.ofLevel(GearLevel::GOD).size() == 1);
+    const Inventory::Bucket& byDamage = inventory.sortedBy(ItemStat::DAMAGE);  // Best first
+    for (size_t i = 1; i < byDamage.size(); i++) {
+        CHECK(inventory.get(inventory.handleAt(byDamage[i - 1])).stats[(int)ItemStat::DAMAGE] >=
+              inventory.get(inventory.handleAt(byDamage[i])).stats[(int)ItemStat::DAMAGE]);
+    }
+    CHECK(inventory.remove(c));
+    CHECK(!inventory.contains(c));
+    CHECK(inventory.ofType(GearType::ARROW).empty());
+    CHECK(inventory.size() == 2);
+}
+
+// Compile, map and look up; damaged files and out-of-range stats are refused
+static void testGearCatalog() {
+    istringstream source(
+        "# name | type | level [| health | armor | damage]\n"
+        "Hell Sword | sword | demon\n"
+        "Rusty Dagger | sword | normal | 5 | 0 | 3\n"
+        "Celestial Spear | spear | god\n"
+        "Longbow | arrow | normal | 0 | 1 | 4\n"
+        "Short Sword | sword | normal\n");
+    vector<char> image;
+    string error;
+    CHECK(compileGearCatalog(source, image, error));
+
+    string path = "combat_tests_catalog.bin";
+    auto opens = [&](const vector<char>& bytes) {
+        FILE* file = fopen(path.c_str(), "wb");
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+        GearCatalog catalog;
+        return catalog.open(path, error);
+    };
+    CHECK(opens(image));
+    {
+        GearCatalog catalog;
+        CHECK(catalog.open(path, error) && catalog.size() == 5);
+        auto [begin, end] = catalog.range(GearType::SWORD, GearLevel::NORMAL);
+        CHECK(end - begin == 2 && catalog.name(begin) == "Rusty Dagger" && catalog.name(begin + 1) == "Short Sword");
+        CHECK(catalog.range(GearType::SWORD).second - catalog.range(GearType::SWORD).first == 3);
+        uint32_t bow = catalog.find("Longbow");
+        CHECK(bow != NO_GEAR && catalog.find("Longsword") == NO_GEAR);
+        auto gear = catalog.makeGear(bow);
+        CHECK(gear->name.view() == "Longbow" && gear->type == GearType::ARROW && gear->damageBonus == 4);
+        CHECK(catalog.record(catalog.find("Hell Sword")).flags & CATALOG_BALANCED_STATS);
+    }
+
+    auto damaged = [&](auto change) {
+        vector<char> bytes = image;
+        CatalogHeader header;
+        memcpy(&header, bytes.data(), sizeof(header));
+        CatalogRecord* records = reinterpret_cast<CatalogRecord*>(bytes.data() + header.recordsOffset);
+        change(header, records);
+        memcpy(bytes.data(), &header, sizeof(header));
+        return bytes;
+    };
+    CHECK(!opens(damaged([](CatalogHeader& h, CatalogRecord*) { swap(h.groupStart[0], h.groupStart[1]); })));
+    CHECK(!opens(damaged([](CatalogHeader& h, CatalogRecord*) { h.groupStart[4] = h.count + 1; })));
+    CHECK(!opens(damaged([](CatalogHeader&, CatalogRecord* r) { r[0].type = GEAR_TYPE_COUNT; })));
+    CHECK(!opens(damaged([](CatalogHeader&, CatalogRecord* r) { r[0].level = 200; })));
+    CHECK(!opens(damaged([](CatalogHeader&, CatalogRecord* r) { r[0].level = (uint8_t)GearLevel::GOD; })));
+    CHECK(!opens(damaged([](CatalogHeader& h, CatalogRecord*) { h.stringsOffset = UINT64_MAX - 2; })));
+    CHECK(!opens(damaged([](CatalogHeader& h, CatalogRecord*) { h.recordsOffset = UINT64_MAX - 7; })));
+    CHECK(!opens(damaged([](CatalogHeader& h, CatalogRecord*) { h.count = UINT32_MAX; })));
+    std::remove(path.c_str());
+
+    istringstream huge("Big Sword | sword | god | 3000000000 | 0 | 0\n");
+    CHECK(!compileGearCatalog(huge, image, error) && error.find("out of range") != string::npos);
+    istringstream negative("Cursed Ring | sword | normal | -2147483648 | 0 | 0\n");
+    CHECK(compileGearCatalog(negative, image, error));
+}
+
+// Columns allocate from the store's resource, and names are shared copies
+static void testArenaAndNames() {
+    struct CountingResource : pmr::memory_resource {
+        size_t allocations = 0;
+        void* do_allocate(size_t bytes, size_t align) override {
+            allocations++;
+            return pmr::new_delete_resource()->allocate(bytes, align);
+        }
+        void do_deallocate(void* p, size_t bytes, size_t align) override {
+            pmr::new_delete_resource()->deallocate(p, bytes, align);
+        }
+        bool do_is_equal(const pmr::memory_resource& other) const noexcept override { return this == &other; }
+    } counting;
+
+    EntityStore store(&counting);
+    store.create("Goblin", 50, 10, 2);
+    CHECK(counting.allocations >= 16);
+    size_t before = counting.allocations;
+    EntityStore copy = store;  // Copies go on the heap
+    CHECK(counting.allocations == before && copy.sameRows(store));
+    store = copy;  // Assignment keeps the store's own resource
+    CHECK(store.currentHealth.get_allocator().resource() == &counting);
+
+    string built = string("Gob") + "lin";
+    Name goblin(built);
+    CHECK(goblin.data() == store.names[0].data());
+    CHECK(goblin.view() == "Goblin" && !(goblin == Name("Goblins")));
+
+    // Free-form text is owned by its names, never added to the table
+    size_t interned = NameTable::instance().size();
+    Name player = Name::owned(built + " the Bold");
+    Name copied = player;
+    CHECK(NameTable::instance().size() == interned);
+    CHECK(copied.view() == "Goblin the Bold" && copied.data() == player.data());
+    CHECK(Name::owned("Goblin") == goblin && Name::owned("Goblin").data() != goblin.data());
+}
+
+// Same seed, same wave, however many threads build it; the budget and
+// the faction mix steer what comes out
+static void testEncounterGenerator() {
+    EncounterSpec spec;
+    spec.seed = 5;
+    spec.count = 20000;
+    spec.threads = 1;
+    EntityStore single;
+    generateEncounter(single, spec);
+    spec.threads = 4;
+    EntityStore spread;
+    generateEncounter(spread, spec);
+    CHECK(single.size() == 20000 && single.sameRows(spread));
+    bool sameNames = true;
+    for (uint32_t i = 0; i < single.size(); i++) {
+        sameNames = sameNames && single.names[i] == spread.names[i];
+    }
+    CHECK(sameNames);
+
+    // Rows match what create() and equip() would have made
+    EntityStore built;
+    for (const auto& gear : single.armory) built.addGear(gear);
+    for (uint32_t i = 0; i < 50; i++) {
+        EntityHandle enemy = built.create(single.names[i], single.maxHealth[i] - single.armory[single.gearId[i]]->healthBonus,
+                                          single.baseDamage[i], single.armor[i]);
+        built.equip(built.indexOf(enemy), single.gearId[i]);
+        CHECK(built.cachedDamage[i] == single.cachedDamage[i] && built.cachedArmor[i] == single.cachedArmor[i]);
+        CHECK(built.currentHealth[i] == single.currentHealth[i] && built.handleAt(i) == single.handleAt(i));
+    }
+
+    // Only Demons when the mix says so, and a bigger budget buys more health
+    spec.count = 1000;
+    spec.mix = {1, 0, 0};
+    EntityStore demons;
+    generateEncounter(demons, spec);
+    bool allDemons = true;
+    long weak = 0;
+    for (uint32_t i = 0; i < demons.size(); i++) {
+        allDemons = allDemons && demons.gearLevel[i] == GearLevel::DEMON;
+        weak += demons.maxHealth[i];
+    }
+    CHECK(allDemons);
+    spec.budget = spec.count * EncounterSpec::DEFAULT_THREAT * 3;
+    EntityStore strong;
+    generateEncounter(strong, spec);
+    long total = 0;
+    for (uint32_t i = 0; i < strong.size(); i++) total += strong.maxHealth[i];
+    CHECK(total > weak * 2);
+
+    // Handles stay valid and removal still works on generated rows
+    EntityHandle last = strong.handleAt(999);
+    strong.removeAt(0);
+    CHECK(strong.contains(last) && strong.indexOf(last) == 0);
+}
+
+// The incrementally kept state hash always equals one computed from
+// scratch, and the table hands back what went in, or nothing
+static void testStateHashAndTable() {
+    for (uint64_t seed = 0; seed < 20; seed++) {
+        auto policy = makePolicy("random", seed);
+        Game game(*policy, 1 + (int)(seed % 3), seed, 60);
+        game.run();
+        CHECK(game.getParty().stateHash() == game.getParty().computeHash());
+        CHECK(game.getEnemies().stateHash() == game.getEnemies().computeHash());
+    }
+
+    EntityStore store = makeWave(40, 3);
+    uint64_t fresh = store.stateHash();
+    CHECK(fresh == store.computeHash() && fresh != 0);
+    EntityStore hero;
+    hero.create("Hero", 100, 30, 5);
+    Character(hero, 0).strikeAll(store, 60);
+    CHECK(store.stateHash() == store.computeHash() && store.stateHash() != fresh);
+    uint64_t struck = store.stateHash();
+    store.setPoisonTurns(4, 2);
+    CHECK(store.stateHash() != struck);
+    store.setPoisonTurns(4, 0);
+    CHECK(store.stateHash() == struck);
+    EntityStore copy = store;
+    CHECK(copy.stateHash() == struck);
+    store.removeAt(7);
+    CHECK(store.stateHash() == store.computeHash());
+
+    // Gear counts by what it does, wherever it sits in the armory
+    EntityStore first, second;
+    first.create("Knight", 80, 15, 8);
+    second.create("Knight", 80, 15, 8);
+    second.addGear(makeGear("Rusty Dagger", GearType::SWORD, GearLevel::NORMAL));
+    first.equip(0, first.addGear(makeGear("Hell Sword", GearType::SWORD, GearLevel::DEMON)));
+    second.equip(0, second.addGear(makeGear("Hell Sword", GearType::SWORD, GearLevel::DEMON)));
+    CHECK(first.stateHash() == second.stateHash());
+    second.equip(0, 0);
+    CHECK(first.stateHash() != second.stateHash() && second.stateHash() == second.computeHash());
+
+    EncounterSpec spec;
+    spec.count = 9000;
+    spec.threads = 3;
+    EntityStore horde;
+    generateEncounter(horde, spec);
+    CHECK(horde.stateHash() == horde.computeHash());
+
+    TranspositionTable table(1);
+    OutcomeEstimate estimate;
+    estimate.visits[0] = 30;
+    estimate.score[0] = 12.0;
+    estimate.visits[2] = 10;
+    estimate.score[2] = 9.0;
+    OutcomeEstimate found;
+    CHECK(!table.probe(42, found));
+    table.store(42, estimate);
+    CHECK(table.probe(42, found));
+    CHECK(found.visits[0] == 30 && found.visits[1] == 0 && found.visits[2] == 10);
+    CHECK(found.score[0] > 11.999 && found.score[0] < 12.001 && found.score[2] > 8.999);
+    CHECK(!table.probe(42 + table.capacity(), found));  // Same slot, other position
+    TranspositionTable::Stats stats = table.stats();
+    CHECK(stats.probes == 3 && stats.hits == 1 && stats.stores == 1);
+
+    // Writers racing over a handful of slots: every hit is an entry some
+    // writer stored whole
+    TranspositionTable shared(1);
+    atomic<int> torn{0};
+    vector<thread> racers;
+    for (int t = 0; t < 4; t++) {
+        racers.emplace_back([&shared, &torn, t] {
+            for (uint32_t i = 0; i < 20000; i++) {
+                uint64_t key = 1 + (i + t) % 8;
+                OutcomeEstimate write;
+                for (int a = 0; a < ENEMY_ACTION_COUNT; a++) write.visits[a] = (uint32_t)(key * 1000 + i % 7);
+                shared.store(key, write);
+                OutcomeEstimate read;
+                if (shared.probe(1 + i % 8, read) &&
+                    (read.visits[0] != read.visits[1] || read.visits[0] / 1000 != 1 + i % 8)) {
+                    torn++;
+                }
+            }
+        });
+    }
+    for (auto& racer : racers) racer.join();
+    CHECK(torn == 0);
+
+    // Searches reuse what the table holds
+    SimulationConfig config;
+    config.battles = 40;
+    config.seed = 7;
+    config.difficulty = "hard";
+    config.threads = 1;
+    config.tableMegabytes = 4;
+    SimulationReport report = runSimulation(config);
+    CHECK(report.table.hits > 0 && report.tableAnswers > 0 && report.battles == 40);
+}
+
+// Plays like GreedyPolicy and writes each move down in the bot protocol.
+class RecordingPolicy : public PlayerPolicy {
+public:
+    string moves;
+
+    PlayerAction chooseAction(const Game& game) override {
+        PlayerAction action = greedy.chooseAction(game);
+        moves += ' ';
+        if (action.type == ActionType::ATTACK) {
+            moves += "a" + to_string(action.target);
+        } else if (action.type == ActionType::HEAL) {
+            moves += "h";
+        } else if (action.type == ActionType::ABILITY) {
+            moves += string(abilityInfo(action.ability).key) + ":" + to_string(action.target);
+        } else {
+            moves += "s";
+        }
+        return action;
+    }
+
+private:
+    GreedyPolicy greedy;
+};
+
+static void testBotProtocol() {
+    BotProtocol bots(BotConfig{});
+    string out;
+    CHECK(bots.handle("act a0", out) && out == "error no battle; send new\n");
+
+    // Moves sent in one batch end the battle exactly as the policy did
+    for (uint64_t seed = 1; seed <= 40; seed++) {
+        int gear = 1 + (int)(seed % 3);
+        RecordingPolicy recorder;
+        BattleResult result = Game(recorder, gear, seed).run();
+        out.clear();
+        CHECK(bots.handle("new " + to_string(seed) + " " + to_string(gear), out));
+        CHECK(out.rfind("state ", 0) == 0 && out.find(" legal ") != string::npos);
+        out.clear();
+        CHECK(bots.handle("act" + recorder.moves + " a0 a0", out));
+        string expected = "end " + to_string(seed) + (result.playerWon ? " 1 " : " 0 ") +
+                          (result.timedOut ? "1 " : "0 ") + to_string(result.turns) + " ";
+        CHECK(out.rfind(expected, 0) == 0);
+    }
+
+    out.clear();
+    CHECK(bots.handle("new 3 2", out));
+    string first = out;
+    out.clear();
+    CHECK(bots.handle("act nonsense", out) && out == "error bad move 'nonsense'\n" + first);
+    out.clear();
+    CHECK(bots.handle("state", out) && out == first);
+    CHECK(bots.handle("new 3 7", out) && out.find("error gear") != string::npos);
+    CHECK(!bots.handle("quit", out));
+}
+
+// Always attacks the first enemy, counting its moves
+class FirstTargetPolicy : public PlayerPolicy {
+public:
+    int moves = 0;
+
+    PlayerAction chooseAction(const Game&) override {
+        moves++;
+        PlayerAction action;
+        action.type = ActionType::ATTACK;
+        return action;
+    }
+};
+
+static void testVecEnv() {
+    // The first episode of each battle plays like the headless game
+    VecEnv::Config config;
+    config.envs = 6;
+    config.threads = 1;
+    config.gearChoice = 2;
+    config.maxTurns = 50;
+    config.seed = 9;
+    VecEnv env(config);
+    vector<float> observations(config.envs * VecEnv::OBSERVATION_SIZE);
+    vector<float> rewards(config.envs);
+    vector<uint8_t> dones(config.envs);
+    vector<int32_t> attack(config.envs, 2);
+    env.reset(observations.data());
+    for (uint32_t i = 0; i < config.envs; i++) {
+        FirstTargetPolicy policy;
+        BattleResult result = Game(policy, config.gearChoice, deriveSeed(deriveSeed(config.seed, i), 0), 50).run();
+        int steps = 0;
+        do {
+            CHECK(steps < 200);
+            env.step(attack.data(), observations.data(), rewards.data(), dones.data());
+            steps++;
+        } while (!dones[i] && steps < 200);
+        CHECK(steps == policy.moves);
+        CHECK((rewards[i] > 0.5f) == result.playerWon && (rewards[i] < -0.5f) == (!result.playerWon && !result.timedOut));
+        CHECK(observations[i * VecEnv::OBSERVATION_SIZE + 10] == 1.0f);  // Reset to the next episode
+        env.reset(observations.data());
+    }
+
+    // Masks: heal, skip and attacks on the enemies there are
+    vector<uint8_t> masks(config.envs * VecEnv::ACTION_COUNT);
+    env.actionMask(masks.data());
+    CHECK(masks[0] && masks[1] && masks[2] && masks[4] && !masks[5]);
+    PlayerAction poison = VecEnv::decodeAction(2 + (1 + (int)AbilityId::POISON) * VecEnv::ENEMY_SLOTS + 3);
+    CHECK(poison.type == ActionType::ABILITY && poison.ability == AbilityId::POISON && poison.target == 3);
+
+    // Thread count never changes the outcome
+    config.envs = 40;
+    vector<vector<float>> runs;
+    for (unsigned threads : {1u, 3u}) {
+        config.threads = threads;
+        VecEnv many(config);
+        vector<float> seen(config.envs * VecEnv::OBSERVATION_SIZE), got(config.envs);
+        vector<int32_t> actions(config.envs);
+        many.reset(seen.data());
+        vector<float> trace;
+        for (int step = 0; step < 60; step++) {
+            for (uint32_t i = 0; i < config.envs; i++) actions[i] = (int32_t)((step + i) % VecEnv::ACTION_COUNT);
+            many.step(actions.data(), seen.data(), got.data(), nullptr);
+            trace.insert(trace.end(), got.begin(), got.end());
+        }
+        trace.insert(trace.end(), seen.begin(), seen.end());
+        runs.push_back(trace);
+    }
+    CHECK(runs[0] == runs[1]);
+}
+
+static void testRollbackSession() {
+    // Two sessions whose inputs reach each other a few frames late, newest
+    // first: both must end where the match played offline does.
+    const int players = 2, frames = 400, lag = 5;
+    const uint64_t seed = 11;
+    PvpMatch offline = playBots(players, seed, frames);
+    CHECK(offline.over() && offline.getFrame() < frames);
+
+    PvpMatch start(players, seed, frames);
+    RollbackSession sessions[2] = {RollbackSession(start, 0, 8), RollbackSession(start, 1, 8)};
+
+    // Before any frame: nothing held, and frame -1 must not index the window
+    PvpInput none;
+    uint64_t noHash = 0;
+    CHECK(sessions[0].hashedFrame() == -1);
+    CHECK(!sessions[0].inputAt(0, -1, none) && !sessions[0].inputAt(1, -1, none));
+    CHECK(!sessions[0].confirmedHash(sessions[0].hashedFrame(), noHash) && !sessions[0].confirmedHash(-1, noHash));
+    for (int tick = 0; tick < frames + 2 * lag; tick++) {
+        for (int p = 0; p < players; p++) {
+            RollbackSession& session = sessions[p];
+            RollbackSession& other = sessions[1 - p];
+            if (session.nextLocalFrame() == session.getFrame() && !session.state().over()) {
+                session.addLocalInput(botInput(seed, p, players, session.nextLocalFrame()));
+            }
+            for (int f = tick - lag; f > session.confirmedThrough(1 - p); f--) {
+                PvpInput input;
+                if (other.inputAt(1 - p, f, input)) session.addRemoteInput(1 - p, f, input);
+            }
+            session.advance();
+        }
+    }
+    for (const RollbackSession& session : sessions) {
+        CHECK(session.finished());
+        CHECK(session.getFinalHash() == offline.stateHash() && session.getWinner() == offline.winner());
+        CHECK(session.stats().rollbacks > 0 && session.stats().desyncs == 0);
+        CHECK(session.stats().deepestRollback <= 9);
+    }
+
+    // A wrong hash for a confirmed frame counts as a desync
+    uint64_t hash = 0;
+    CHECK(sessions[0].confirmedHash(sessions[0].hashedFrame(), hash));
+    sessions[0].checkRemoteHash(sessions[0].hashedFrame(), hash ^ 1);
+    CHECK(sessions[0].stats().desyncs == 1);
+}
+
+// A battle back out of its journal: the ring wraps, close() flushes what
+// is left, a torn tail is ignored and replaying the events lands on the
+// battle's final state
+static void testJournal() {
+    string path = "combat_tests_journal.bin";
+    Journal journal;
+    CHECK(journal.open(path));
+    Journal* saved = combatJournal;
+    combatJournal = &journal;
+    uint64_t filler = Journal::CAPACITY * 2 + 7;
+    record(EventType::BATTLE_START, {});
+    for (uint64_t i = 0; i < filler; i++) record(EventType::TURN_START, {}, {}, (int)i);
+    GreedyPolicy policy;
+    Game game(policy, 2, 5, 30);
+    game.run();
+    combatJournal = saved;
+    uint64_t written = journal.getEventCount();
+    CHECK(journal.close() && journal.getWriteErrors() == 0);
+
+    JournalReader reader;
+    string error;
+    CHECK(reader.open(path, error));
+    CHECK(reader.size() == written && reader.battleCount() == 2);
+    auto padding = reader.battle(0);
+    CHECK(padding.second - padding.first == filler + 1);
+    bool ordered = true;
+    for (uint64_t i = 0; i < filler; i++) ordered = ordered && reader.data()[padding.first + 1 + i].amount == (int)i;
+    CHECK(ordered);
+
+    vector<ReplayEntity> entities;
+    auto range = reader.battle(1);
+    applyEvents(reader.data(), range.first, range.second, entities);
+    size_t alive = 0;
+    for (const ReplayEntity& entity : entities) alive += entity.alive;
+    size_t rows = 0;
+    for (const EntityStore* store : {&game.getParty(), &game.getEnemies()}) {
+        for (uint32_t i = 0; i < store->size(); i++) {
+            uint32_t slot = store->handleAt(i).slot;
+            auto found = find_if(entities.begin(), entities.end(), [&](const ReplayEntity& e) {
+                return e.side == store->side && e.slot == slot;
+            });
+            CHECK(found != entities.end() && found->health == store->currentHealth[i]);
+            rows += store->currentHealth[i] > 0;
+        }
+    }
+    CHECK(alive == rows);
+
+    FILE* file = fopen(path.c_str(), "ab");
+    fwrite("torn", 1, 4, file);  // Part of an event, as a crash mid-write leaves
+    fclose(file);
+    JournalReader torn;
+    CHECK(torn.open(path, error) && torn.size() == written);
+    std::remove(path.c_str());
+
+#ifdef __linux__
+    Journal full;
+    CHECK(full.open("/dev/full"));
+    combatJournal = &full;
+    for (int i = 0; i < 10; i++) record(EventType::TURN_START, {});
+    combatJournal = saved;
+    CHECK(!full.close() && full.getWriteErrors() > 0);
+#endif
+}
+
+#ifdef EVENT_LOOP_POSIX
+// The disk (a pipe nobody reads yet) falls a full ring behind: the producer
+// waits instead of dropping events, and every event arrives in order
+static void testJournalStall() {
+    string fifo = "combat_tests_journal.fifo";
+    std::remove(fifo.c_str());
+    CHECK(mkfifo(fifo.c_str(), 0600) == 0);
+    uint64_t events = Journal::CAPACITY * 3 + 5;
+    uint64_t received = 0;
+    bool ordered = true;
+    thread disk([&] {
+        FILE* in = fopen(fifo.c_str(), "rb");
+        JournalHeader header;
+        ordered = fread(&header, sizeof(header), 1, in) == 1;
+        this_thread::sleep_for(chrono::milliseconds(200));
+        CombatEvent event;
+        while (fread(&event, sizeof(event), 1, in) == 1) {
+            ordered = ordered && event.amount == (int)received;
+            received++;
+        }
+        fclose(in);
+    });
+    Journal journal;
+    CHECK(journal.open(fifo));
+    for (uint64_t i = 0; i < events; i++) {
+        journal.append(CombatEvent{0, EventType::TURN_START, 0, 0, 0, NO_ENTITY, NO_ENTITY, (int)i, 0});
+    }
+    CHECK(journal.getStallCount() > 0);
+    CHECK(journal.close());
+    disk.join();
+    CHECK(received == events && ordered);
+    std::remove(fifo.c_str());
+}
+
+static void testEventLoop() {
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    const char keys[] = "first\nsecond";
+    CHECK(write(fds[1], keys, sizeof(keys) - 1) == (ssize_t)(sizeof(keys) - 1));
+    close(fds[1]);
+
+    EventLoop loop(fds[0]);
+    vector<string> lines;
+    int slices = 0;
+    loop.post([&slices] { return ++slices < 3; });
+    auto reader = [&](EventLoop& from) -> Task<> {
+        lines.push_back(co_await from.readLine());
+        lines.push_back(co_await from.readLine());
+        lines.push_back(co_await from.readLine());
+    };
+    loop.run(reader(loop));
+    close(fds[0]);
+    CHECK(lines.size() == 3);
+    CHECK(lines[0] == "first" && lines[1] == "second" && lines[2].empty());
+
+    // Fed input: run() returns at the first wait, each feed() carries on
+    EventLoop fed(EventLoop::FED_INPUT);
+    lines.clear();
+    fed.run(reader(fed));
+    CHECK(lines.empty() && !fed.finished());
+    fed.feed("fir");
+    CHECK(lines.empty());
+    fed.feed("st\r\nsecond\n");
+    CHECK(lines.size() == 2 && lines[0] == "first" && lines[1] == "second");
+    fed.finishInput();
+    CHECK(fed.finished() && lines.size() == 3 && lines[2].empty());
+}
+#endif
+
+#ifdef SERVER_EPOLL
+// Reads from a blocking socket until the text so far ends with `prompt`.
+static string readUntil(int fd, const string& prompt) {
+    string text;
+    char buffer[4096];
+    while (text.size() < prompt.size() || text.compare(text.size() - prompt.size(), prompt.size(), prompt) != 0) {
+        ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+        if (count <= 0) break;
+        text.append(buffer, (size_t)count);
+    }
+    return text;
+}
+
+static void testServerSession() {
+    ServerConfig config;
+    config.address = "unix:/tmp/combat_tests." + to_string(getpid()) + ".sock";
+    config.workers = 2;
+    Server server(config);
+    string error;
+    CHECK(server.listen(error));
+    thread serving([&] { CHECK(server.run(error)); });
+
+    SocketAddress address;
+    CHECK(address.parse(config.address, error));
+    for (int player = 0; player < 2; player++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        CHECK(connect(fd, address.get(), address.length) == 0);
+        CHECK(readUntil(fd, "name: ").find("GODS VS DEMONS") != string::npos);
+        CHECK(send(fd, "Tester\n", 7, 0) == 7);
+        CHECK(readUntil(fd, "Choice: ").find("Choose your starting gear") != string::npos);
+        CHECK(send(fd, "1\n", 2, 0) == 2);
+        CHECK(readUntil(fd, "Choice: ").find("TURN 1") != string::npos);
+        close(fd);
+    }
+
+    server.stop();
+    serving.join();
+    CHECK(server.sessionsAccepted() == 2);
+
+    // Nothing to watch without listen(): run() says so instead of waiting forever
+    Server unbound(config);
+    error.clear();
+    CHECK(!unbound.run(error) && error.find("cannot watch") != string::npos);
+}
+
+// A client that keeps typing but never reads: the session stops reading
+// once its outbox is MAX_OUTBOX behind, and drops EPOLLIN until it drains.
+static void testServerBackpressure() {
+    int pair[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pair) == 0);
+    int client = pair[1];
+    ServerSession session(pair[0], 7);
+    session.start();
+    CHECK(send(client, "Tester\n1\n", 9, 0) == 9);
+    CHECK(session.receive() && session.send());
+
+    // Looking at the enemies takes no turn and prints a page each time
+    string burst;
+    for (int i = 0; i < 2048; i++) burst += "4\n";
+    bool throttled = false;
+    for (int round = 0; round < 100000 && !throttled; round++) {
+        ssize_t count = send(client, burst.data(), burst.size(), MSG_DONTWAIT);
+        CHECK(count > 0 || errno == EAGAIN);
+        CHECK(session.receive() && session.send());
+        throttled = !(session.wanted() & EPOLLIN);
+    }
+    CHECK(throttled && session.hasOutput());
+
+    // More input waits in the socket; reading again takes none of it
+    CHECK(send(client, burst.data(), burst.size(), MSG_DONTWAIT) > 0);
+    int pending = 0;
+    CHECK(ioctl(pair[0], FIONREAD, &pending) == 0 && pending > 0);
+    CHECK(session.receive());
+    int after = 0;
+    CHECK(ioctl(pair[0], FIONREAD, &after) == 0 && after == pending);
+
+    // Once the client reads, the session wants input again
+    char buffer[65536];
+    while (session.hasOutput()) {
+        while (recv(client, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+        CHECK(session.send());
+    }
+    CHECK(session.wanted() & EPOLLIN);
+    close(client);
+}
+#endif
+
+#ifdef LOCKSTEP_UDP
+static void testLockstepLoopback() {
+    LockstepConfig config;
+    config.players = 2;
+    config.seed = 5;
+    config.frames = 300;
+    config.frameMs = 1;
+    config.delayMs = 4;
+    config.jitterMs = 3;
+    config.lossPercent = 15;
+    config.ports = {0, 0};
+    vector<unique_ptr<LockstepPeer>> peers;
+    for (int p = 0; p < config.players; p++) {
+        config.self = p;
+        peers.push_back(make_unique<LockstepPeer>(config));
+        string error;
+        CHECK(peers.back()->open(error));
+    }
+    for (auto& peer : peers) {
+        for (int p = 0; p < config.players; p++) peer->setPort(p, peers[p]->localPort());
+    }
+
+    bool done = false, lost = false;
+    while (!done && !lost) {
+        int64_t now = LockstepPeer::clockMs();
+        done = true;
+        for (auto& peer : peers) {
+            peer->poll(now);
+            done = done && peer->done(now);
+            lost = lost || peer->timedOut(now);
+        }
+        this_thread::sleep_for(chrono::microseconds(200));
+    }
+    CHECK(!lost);
+
+    PvpMatch offline = playBots(config.players, config.seed, config.frames);
+    for (auto& peer : peers) {
+        const RollbackSession& session = peer->getSession();
+        CHECK(session.finished() && session.getFinalHash() == offline.stateHash());
+        CHECK(session.stats().rollbacks > 0 && session.stats().desyncs == 0);
+    }
+}
+#endif
+
+#ifdef TERMINAL_GAME_LUA
+// Keeps what the game says, to look for script errors in it
+class CapturedOutput : public Renderer {
+public:
+    explicit CapturedOutput(string& text) : text(text) {}
+    void write(const Line& line) override {
+        appendColoredText(text, line);
+        text += '\n';
+    }
+    void prompt(const vector<Line>&, string_view question) override { text += question; }
+    void present() override {}
+
+private:
+    string& text;
+};
+
+// The shipped lua/demon.lua and lua/god.lua load, and each runs one
+// ability and one enemy turn against a real battle's stores
+static void testLuaScripts() {
+    ScriptEngine scripts;
+    string error;
+    CHECK(scripts.load(TERMINAL_GAME_LUA_DIR, error));
+    CHECK(scripts.hasAbility(GearLevel::DEMON, AbilityId::POISON));
+    CHECK(scripts.hasAbility(GearLevel::GOD, AbilityId::HOLY_TAKEDOWN));
+    CHECK(!scripts.hasAbility(GearLevel::DEMON, AbilityId::HOLY_TAKEDOWN));
+    CHECK(scripts.hasEnemyAi(GearLevel::DEMON) && scripts.hasEnemyAi(GearLevel::GOD));
+    CHECK(!scripts.hasEnemyAi(GearLevel::NORMAL));
+
+    EntityStore party;
+    party.side = SIDE_PARTY;
+    uint32_t hero = party.indexOf(party.create("Hero", 100, 20, 5));
+    EntityStore enemies;
+    enemies.side = SIDE_ENEMIES;
+    for (GearLevel level : {GearLevel::NORMAL, GearLevel::DEMON, GearLevel::GOD}) {
+        uint32_t i = enemies.indexOf(enemies.create("Enemy", 200, 10, 0));
+        Character(enemies, i).equipGear(makeGear("Blade", GearType::SWORD, level));
+    }
+    Rng rng(5);
+    StatusEffects effects;
+    effects.clear(1);
+    string said;
+    CapturedOutput output(said);
+    Renderer* saved = exchange(gameOut, &output);
+
+    // Neither target is GOD geared, so no Divine Protection can eat a hit
+    ScriptWorld world{&party, &enemies, &rng, &effects, 1, SIDE_PARTY, hero};
+    CHECK(scripts.runAbility(GearLevel::DEMON, AbilityId::POISON, world, 0));
+    CHECK(enemies.poisonTurns[0] == 3 && enemies.currentHealth[0] < 200);
+    CHECK(scripts.runAbility(GearLevel::GOD, AbilityId::HOLY_TAKEDOWN, world, 1));
+    CHECK(enemies.currentHealth[1] < 200);
+
+    for (uint32_t i : {1u, 2u}) {
+        ScriptWorld turn{&party, &enemies, &rng, &effects, 1, SIDE_ENEMIES, i};
+        CHECK(scripts.enemyTurn(enemies.gearLevel[i], turn) != ScriptedAction::NONE);
+    }
+    gameOut = saved;
+    CHECK(said.find("Script error") == string::npos);
+}
+#endif
+
+int main() {
+    struct TestCase {
+        const char* name;
+        void (*run)();
+    };
+    const TestCase tests[] = {
+        {"simulation_checksum", testSimulationChecksum},
+        {"cached_stats", testCachedStats},
+        {"fixed_point", testFixedPoint},
+        {"damage_kernel", testDamageKernel},
+        {"strike_all_matches_strikes", testStrikeAllMatchesStrikes},
+        {"turn_wheel", testTurnWheel},
+        {"status_effects", testStatusEffects},
+        {"snapshot_round_trip", testSnapshotRoundTrip},
+        {"snapshot_alternates", testSnapshotAlternates},
+        {"snapshot_rejects_damage", testSnapshotRejectsDamage},
+        {"inventory", testInventory},
+        {"gear_catalog", testGearCatalog},
+        {"arena_and_names", testArenaAndNames},
+        {"encounter_generator", testEncounterGenerator},
+        {"state_hash_and_table", testStateHashAndTable},
+        {"bot_protocol", testBotProtocol},
+        {"vec_env", testVecEnv},
+        {"rollback_session", testRollbackSession},
+        {"journal", testJournal},
+#ifdef EVENT_LOOP_POSIX
+        {"journal_stall", testJournalStall},
+        {"event_loop", testEventLoop},
+#endif
+#ifdef SERVER_EPOLL
+        {"server_session", testServerSession},
+        {"server_backpressure", testServerBackpressure},
+#endif
+#ifdef LOCKSTEP_UDP
+        {"lockstep_loopback", testLockstepLoopback},
+#endif
+#ifdef TERMINAL_GAME_LUA
+        {"lua_scripts", testLuaScripts},
+#endif
+    };
+    for (const TestCase& test : tests) {
+        int before = failures;
+        test.run();
+        cout << (failures == before ? "ok    " : "FAIL  ") << test.name << endl;
+    }
+    if (failures) {
+        cout << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    return 0;
+}